@@ -710,6 +710,15 @@ usage(int error_code)
 		"  --use-pixman\t\tUse the pixman (CPU) renderer (default: no rendering)\n"
 		"  --use-gl\t\tUse the GL renderer (default: no rendering)\n"
 		"  --no-outputs\t\tDo not create any virtual outputs\n"
+		"  --vsync-refresh=MHZ\tSimulate a display clock at this refresh rate,\n"
+		"\t\t\tin mHz (default: plain timer)\n"
+		"  --vsync-latency=US\tScanout latency of the simulated display\n"
+		"  --vsync-jitter=US\tLargest vblank jitter of the simulated display\n"
+		"  --vsync-jitter-distribution=D\n"
+		"\t\t\tJitter distribution, uniform or normal\n"
+		"  --vsync-miss-percent=P\n"
+		"\t\t\tChance of a frame missing its vblank\n"
+		"  --vsync-seed=SEED\tSeed for the simulated jitter and misses\n"
 		"\n");
 #endif
 
@@ -2677,6 +2686,9 @@ load_headless_backend(struct weston_compositor *c,
 	bool no_outputs = false;
 	int ret = 0;
 	char *transform = NULL;
+	char *jitter_distribution = NULL;
+	char *jitter_distribution_option = NULL;
+	int seed;
 
 	struct wet_output_config *parsed_options = wet_init_parsed_options(c);
 	if (!parsed_options)
@@ -2688,6 +2700,19 @@ load_headless_backend(struct weston_compositor *c,
 	weston_config_section_get_bool(section, "use-gl", &config.use_gl,
 				       false);
 
+	section = weston_config_get_section(wc, "headless", NULL, NULL);
+	weston_config_section_get_int(section, "vsync-refresh",
+				      &config.vsync.refresh, 0);
+	weston_config_section_get_int(section, "vsync-latency",
+				      &config.vsync.scanout_latency_usec, 0);
+	weston_config_section_get_int(section, "vsync-jitter",
+				      &config.vsync.jitter_usec, 0);
+	weston_config_section_get_string(section, "vsync-jitter-distribution",
+					 &jitter_distribution, NULL);
+	weston_config_section_get_int(section, "vsync-miss-percent",
+				      &config.vsync.miss_percent, 0);
+	weston_config_section_get_int(section, "vsync-seed", &seed, 1);
+
 	const struct weston_option options[] = {
 		{ WESTON_OPTION_INTEGER, "width", 0, &parsed_options->width },
 		{ WESTON_OPTION_INTEGER, "height", 0, &parsed_options->height },
@@ -2696,6 +2721,12 @@ load_headless_backend(struct weston_compositor *c,
 		{ WESTON_OPTION_BOOLEAN, "use-gl", 0, &config.use_gl },
 		{ WESTON_OPTION_STRING, "transform", 0, &transform },
 		{ WESTON_OPTION_BOOLEAN, "no-outputs", 0, &no_outputs },
+		{ WESTON_OPTION_INTEGER, "vsync-refresh", 0, &config.vsync.refresh },
+		{ WESTON_OPTION_INTEGER, "vsync-latency", 0, &config.vsync.scanout_latency_usec },
+		{ WESTON_OPTION_INTEGER, "vsync-jitter", 0, &config.vsync.jitter_usec },
+		{ WESTON_OPTION_STRING, "vsync-jitter-distribution", 0, &jitter_distribution_option },
+		{ WESTON_OPTION_INTEGER, "vsync-miss-percent", 0, &config.vsync.miss_percent },
+		{ WESTON_OPTION_INTEGER, "vsync-seed", 0, &seed },
 	};
 
 	parse_options(options, ARRAY_LENGTH(options), argc, argv);
@@ -2708,6 +2739,24 @@ load_headless_backend(struct weston_compositor *c,
 		free(transform);
 	}
 
+	if (jitter_distribution_option) {
+		free(jitter_distribution);
+		jitter_distribution = jitter_distribution_option;
+	}
+
+	if (!jitter_distribution || strcmp(jitter_distribution, "uniform") == 0) {
+		config.vsync.jitter_distribution = WESTON_HEADLESS_JITTER_UNIFORM;
+	} else if (strcmp(jitter_distribution, "normal") == 0) {
+		config.vsync.jitter_distribution = WESTON_HEADLESS_JITTER_NORMAL;
+	} else {
+		weston_log("Invalid jitter distribution \"%{public}s\"\n",
+			   jitter_distribution);
+		free(jitter_distribution);
+		return -1;
+	}
+	free(jitter_distribution);
+	config.vsync.seed = seed;
+
 	config.base.struct_version = WESTON_HEADLESS_BACKEND_CONFIG_VERSION;
 	config.base.struct_size = sizeof(struct weston_headless_backend_config);
 
@@ -49,6 +49,9 @@
 #include "shared/timespec-util.h"
 #include "fullscreen-shell-unstable-v1-client-protocol.h"
 
+/* Buffers the parent may hold at once before we wait for a release */
+#define SS_MAX_SHM_BUFFERS 3
+
 struct shared_output {
 	struct weston_output *output;
 	struct wl_listener output_destroyed;
@@ -58,17 +61,17 @@ struct shared_output {
 		struct wl_display *display;
 		struct wl_registry *registry;
 		struct wl_compositor *compositor;
+		uint32_t compositor_version;
 		struct wl_shm *shm;
 		uint32_t shm_formats;
 		struct zwp_fullscreen_shell_v1 *fshell;
 		struct wl_output *output;
 		struct wl_surface *surface;
-		struct wl_callback *frame_cb;
 		struct zwp_fullscreen_shell_mode_feedback_v1 *mode_feedback;
 	} parent;
 
 	struct wl_event_source *event_source;
-	struct wl_listener frame_listener;
+	struct weston_capture_stream *stream;
 
 	struct {
 		int32_t width, height;
@@ -78,9 +81,8 @@ struct shared_output {
 	} shm;
 
 	int cache_dirty;
+	/* The capture stream's copy of the output, in buffer coordinates */
 	pixman_image_t *cache_image;
-	uint32_t *tmp_data;
-	size_t tmp_data_size;
 };
 
 struct ss_seat {
@@ -107,6 +109,7 @@ struct ss_shm_buffer {
 	struct wl_buffer *buffer;
 	void *data;
 	size_t size;
+	/* What this buffer misses from cache_image, in buffer coordinates */
 	pixman_region32_t damage;
 
 	pixman_image_t *pm_image;
@@ -412,52 +415,102 @@ ss_shm_buffer_destroy(struct ss_shm_buffer *buffer)
 	free(buffer);
 }
 
+static void
+shared_output_update(struct shared_output *so);
+
 static void
 buffer_release(void *data, struct wl_buffer *buffer)
 {
 	struct ss_shm_buffer *sb = data;
+	struct shared_output *so = sb->output;
 
-	if (sb->output) {
-		wl_list_insert(&sb->output->shm.free_buffers, &sb->free_link);
-	} else {
+	if (!so) {
 		ss_shm_buffer_destroy(sb);
+		return;
 	}
+
+	wl_list_insert(&so->shm.free_buffers, &sb->free_link);
+
+	/* A frame was held back because every buffer was busy */
+	if (so->cache_dirty)
+		shared_output_update(so);
 }
 
 static const struct wl_buffer_listener buffer_listener = {
 	buffer_release
 };
 
-static struct ss_shm_buffer *
-shared_output_get_shm_buffer(struct shared_output *so)
+/* Whether the parent can take the output's transform and scale itself,
+ * so that buffers can hold the output in its own buffer coordinates. */
+static bool
+shared_output_is_direct(struct shared_output *so)
+{
+	return so->parent.compositor_version >= 3 ||
+	       (so->output->transform == WL_OUTPUT_TRANSFORM_NORMAL &&
+		so->output->current_scale == 1);
+}
+
+static void
+shared_output_check_shm_size(struct shared_output *so)
 {
 	struct ss_shm_buffer *sb, *bnext;
-	struct wl_shm_pool *pool;
-	int width, height, stride;
-	int fd;
-	unsigned char *data;
+	int width, height;
 
-	width = so->output->width;
-	height = so->output->height;
-	stride = width * 4;
+	if (shared_output_is_direct(so)) {
+		width = so->output->current_mode->width;
+		height = so->output->current_mode->height;
+	} else {
+		width = so->output->width;
+		height = so->output->height;
+	}
 
 	/* If the size of the output changed, we free the old buffers and
 	 * make new ones. */
-	if (so->shm.width != width ||
-	    so->shm.height != height) {
+	if (so->shm.width == width && so->shm.height == height)
+		return;
 
-		/* Destroy free buffers */
-		wl_list_for_each_safe(sb, bnext, &so->shm.free_buffers, free_link)
-			ss_shm_buffer_destroy(sb);
+	/* Destroy free buffers */
+	wl_list_for_each_safe(sb, bnext, &so->shm.free_buffers, free_link)
+		ss_shm_buffer_destroy(sb);
+
+	/* Orphan in-use buffers so they get destroyed */
+	wl_list_for_each(sb, &so->shm.buffers, link)
+		sb->output = NULL;
+
+	so->shm.width = width;
+	so->shm.height = height;
+}
+
+static bool
+shared_output_shm_busy(struct shared_output *so)
+{
+	struct ss_shm_buffer *sb;
+	int count = 0;
 
-		/* Orphan in-use buffers so they get destroyed */
-		wl_list_for_each(sb, &so->shm.buffers, link)
-			sb->output = NULL;
+	if (!wl_list_empty(&so->shm.free_buffers))
+		return false;
 
-		so->shm.width = width;
-		so->shm.height = height;
+	wl_list_for_each(sb, &so->shm.buffers, link) {
+		if (sb->output)
+			count++;
 	}
 
+	return count >= SS_MAX_SHM_BUFFERS;
+}
+
+static struct ss_shm_buffer *
+shared_output_get_shm_buffer(struct shared_output *so)
+{
+	struct ss_shm_buffer *sb;
+	struct wl_shm_pool *pool;
+	int width, height, stride;
+	int fd;
+	unsigned char *data;
+
+	width = so->shm.width;
+	height = so->shm.height;
+	stride = width * 4;
+
 	if (!wl_list_empty(&so->shm.free_buffers)) {
 		sb = container_of(so->shm.free_buffers.next,
 				  struct ss_shm_buffer, free_link);
@@ -574,73 +627,22 @@ output_compute_transform(struct weston_output *output,
 static void
 shared_output_destroy(struct shared_output *so);
 
-static int
-shared_output_ensure_tmp_data(struct shared_output *so,
-			      pixman_region32_t *region)
-{
-	pixman_box32_t *ext;
-	size_t size;
-
-	if (!pixman_region32_not_empty(region))
-		return 0;
-
-	ext = pixman_region32_extents(region);
-
-	/* Damage is in output coordinates.
-	 *
-	 * We are multiplying by 4 because the temporary data needs to be able
-	 * to store an 32 bit-per-pixel buffer.
-	 */
-	size = 4 * (ext->x2 - ext->x1) * (ext->y2 - ext->y1)
-		 * so->output->current_scale * so->output->current_scale;
-
-	if (so->tmp_data != NULL && size <= so->tmp_data_size)
-		return 0;
-
-	free(so->tmp_data);
-	so->tmp_data = malloc(size);
-	if (so->tmp_data == NULL) {
-		so->tmp_data_size = 0;
-		errno = ENOMEM;
-		return -1;
-	}
-
-	so->tmp_data_size = size;
-
-	return 0;
-}
-
-static void
-shared_output_update(struct shared_output *so);
-
-static void
-shared_output_frame_callback(void *data, struct wl_callback *cb, uint32_t time)
-{
-	struct shared_output *so = data;
-
-	if (cb != so->parent.frame_cb)
-		return;
-
-	wl_callback_destroy(cb);
-	so->parent.frame_cb = NULL;
-
-	shared_output_update(so);
-}
-
-static const struct wl_callback_listener shared_output_frame_listener = {
-	shared_output_frame_callback
-};
-
 static void
 shared_output_update(struct shared_output *so)
 {
+	struct weston_output *output = so->output;
 	struct ss_shm_buffer *sb;
 	pixman_box32_t *r;
 	int i, nrects;
 	pixman_transform_t transform;
+	bool direct;
 
 	/* Only update if we need to */
-	if (!so->cache_dirty || so->parent.frame_cb)
+	if (!so->cache_dirty || !so->cache_image)
+		return;
+
+	shared_output_check_shm_size(so);
+	if (shared_output_shm_busy(so))
 		return;
 
 	sb = shared_output_get_shm_buffer(so);
@@ -649,50 +651,79 @@ shared_output_update(struct shared_output *so)
 		return;
 	}
 
-	output_compute_transform(so->output, &transform);
-	pixman_image_set_transform(so->cache_image, &transform);
-
-	pixman_image_set_clip_region32(sb->pm_image, &sb->damage);
+	direct = shared_output_is_direct(so);
+	if (direct) {
+		/* Same coordinates on both sides: copy only what this buffer
+		 * misses, there is nothing to transform. */
+		r = pixman_region32_rectangles(&sb->damage, &nrects);
+		for (i = 0; i < nrects; ++i)
+			pixman_image_composite32(PIXMAN_OP_SRC,
+						 so->cache_image, NULL,
+						 sb->pm_image,
+						 r[i].x1, r[i].y1,
+						 0, 0,
+						 r[i].x1, r[i].y1,
+						 r[i].x2 - r[i].x1,
+						 r[i].y2 - r[i].y1);
+	} else {
+		output_compute_transform(output, &transform);
+		pixman_image_set_transform(so->cache_image, &transform);
+		if (output->current_scale != 1)
+			pixman_image_set_filter(so->cache_image,
+						PIXMAN_FILTER_BILINEAR,
+						NULL, 0);
 
-	if (so->output->current_scale == 1) {
+		pixman_image_composite32(PIXMAN_OP_SRC,
+					 so->cache_image, /* src */
+					 NULL, /* mask */
+					 sb->pm_image, /* dest */
+					 0, 0, /* src_x, src_y */
+					 0, 0, /* mask_x, mask_y */
+					 0, 0, /* dest_x, dest_y */
+					 output->width, /* width */
+					 output->height /* height */);
+
+		pixman_image_set_transform(so->cache_image, NULL);
 		pixman_image_set_filter(so->cache_image,
 					PIXMAN_FILTER_NEAREST, NULL, 0);
-	} else {
-		pixman_image_set_filter(so->cache_image,
-					PIXMAN_FILTER_BILINEAR, NULL, 0);
 	}
 
-	pixman_image_composite32(PIXMAN_OP_SRC,
-				 so->cache_image, /* src */
-				 NULL, /* mask */
-				 sb->pm_image, /* dest */
-				 0, 0, /* src_x, src_y */
-				 0, 0, /* mask_x, mask_y */
-				 0, 0, /* dest_x, dest_y */
-				 so->output->width, /* width */
-				 so->output->height /* height */);
-
-	pixman_image_set_transform(sb->pm_image, NULL);
-	pixman_image_set_clip_region32(sb->pm_image, NULL);
+	if (so->parent.compositor_version >= 3) {
+		wl_surface_set_buffer_transform(so->parent.surface,
+						output->transform);
+		wl_surface_set_buffer_scale(so->parent.surface,
+					    output->current_scale);
+	}
 
-	r = pixman_region32_rectangles(&sb->damage, &nrects);
-	for (i = 0; i < nrects; ++i)
-		wl_surface_damage(so->parent.surface, r[i].x1, r[i].y1,
-				  r[i].x2 - r[i].x1, r[i].y2 - r[i].y1);
+	if (so->parent.compositor_version >=
+	    WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION) {
+		r = pixman_region32_rectangles(&sb->damage, &nrects);
+		for (i = 0; i < nrects; ++i)
+			wl_surface_damage_buffer(so->parent.surface,
+						 r[i].x1, r[i].y1,
+						 r[i].x2 - r[i].x1,
+						 r[i].y2 - r[i].y1);
+	} else if (direct && output->transform == WL_OUTPUT_TRANSFORM_NORMAL &&
+		   output->current_scale == 1) {
+		r = pixman_region32_rectangles(&sb->damage, &nrects);
+		for (i = 0; i < nrects; ++i)
+			wl_surface_damage(so->parent.surface,
+					  r[i].x1, r[i].y1,
+					  r[i].x2 - r[i].x1,
+					  r[i].y2 - r[i].y1);
+	} else {
+		wl_surface_damage(so->parent.surface,
+				  0, 0, INT32_MAX, INT32_MAX);
+	}
 
 	wl_surface_attach(so->parent.surface, sb->buffer, 0, 0);
-
-	so->parent.frame_cb = wl_surface_frame(so->parent.surface);
-	wl_callback_add_listener(so->parent.frame_cb,
-				 &shared_output_frame_listener, so);
-
 	wl_surface_commit(so->parent.surface);
 	wl_callback_destroy(wl_display_sync(so->parent.display));
 	wl_display_flush(so->parent.display);
 
 	/* Clear the buffer damage */
-	pixman_region32_fini(&sb->damage);
-	pixman_region32_init(&sb->damage);
+	pixman_region32_clear(&sb->damage);
+	so->cache_dirty = 0;
 }
 
 static void
@@ -714,9 +745,11 @@ registry_handle_global(void *data, struct wl_registry *registry,
 	struct shared_output *so = data;
 
 	if (strcmp(interface, "wl_compositor") == 0) {
+		so->parent.compositor_version = MIN(version, 4);
 		so->parent.compositor =
 			wl_registry_bind(registry,
-					 id, &wl_compositor_interface, 1);
+					 id, &wl_compositor_interface,
+					 so->parent.compositor_version);
 	} else if (strcmp(interface, "wl_output") == 0 && !so->parent.output) {
 		so->parent.output =
 			wl_registry_bind(registry,
@@ -814,116 +847,29 @@ struct zwp_fullscreen_shell_mode_feedback_v1_listener mode_feedback_listener = {
 };
 
 static void
-shared_output_repainted(struct wl_listener *listener, void *data)
+shared_output_frame(struct weston_capture_frame *frame, void *data)
 {
-	struct shared_output *so =
-		container_of(listener, struct shared_output, frame_listener);
-	pixman_region32_t damage;
-	pixman_region32_t *current_damage = data;
+	struct shared_output *so = data;
 	struct ss_shm_buffer *sb;
-	int32_t x, y, width, height, stride;
-	int i, nrects, do_yflip, y_orig;
-	pixman_box32_t *r;
-	pixman_image_t *damaged_image;
-	pixman_transform_t transform;
-
-	width = so->output->current_mode->width;
-	height = so->output->current_mode->height;
-	stride = width;
 
-	if (!so->cache_image ||
-	    pixman_image_get_width(so->cache_image) != width ||
-	    pixman_image_get_height(so->cache_image) != height) {
+	/* The stream keeps updating the same image until the output
+	 * changes size, so holding on to it is enough to read the latest
+	 * content whenever a buffer comes back. */
+	if (so->cache_image != frame->image) {
 		if (so->cache_image)
 			pixman_image_unref(so->cache_image);
-
-		so->cache_image =
-			pixman_image_create_bits(PIXMAN_a8r8g8b8,
-						 width, height, NULL,
-						 stride);
-		if (!so->cache_image)
-			goto err_shared_output;
-
-		pixman_region32_init_rect(&damage, 0, 0, width, height);
-	} else {
-		/* Damage in output coordinates */
-		pixman_region32_init(&damage);
-		pixman_region32_intersect(&damage, &so->output->region, current_damage);
-		pixman_region32_translate(&damage, -so->output->x, -so->output->y);
+		so->cache_image = pixman_image_ref(frame->image);
 	}
 
+	if (!pixman_region32_not_empty(frame->damage))
+		return;
+
 	/* Apply damage to all buffers */
 	wl_list_for_each(sb, &so->shm.buffers, link)
-		pixman_region32_union(&sb->damage, &sb->damage, &damage);
-
-	/* Transform to buffer coordinates */
-	weston_transformed_region(so->output->width, so->output->height,
-				  so->output->transform,
-				  so->output->current_scale,
-				  &damage, &damage);
-
-	if (shared_output_ensure_tmp_data(so, &damage) < 0)
-		goto err_pixman_init;
-
-	do_yflip = !!(so->output->compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP);
-
-	r = pixman_region32_rectangles(&damage, &nrects);
-	for (i = 0; i < nrects; ++i) {
-		x = r[i].x1;
-		y = r[i].y1;
-		width = r[i].x2 - r[i].x1;
-		height = r[i].y2 - r[i].y1;
-
-		if (do_yflip)
-			y_orig = so->output->current_mode->height - r[i].y2;
-		else
-			y_orig = y;
-
-		so->output->compositor->renderer->read_pixels(
-			so->output, PIXMAN_a8r8g8b8, so->tmp_data,
-			x, y_orig, width, height);
-
-		damaged_image = pixman_image_create_bits(PIXMAN_a8r8g8b8,
-							 width, height,
-							 so->tmp_data,
-				(PIXMAN_FORMAT_BPP(PIXMAN_a8r8g8b8) / 8) * width);
-		if (!damaged_image)
-			goto err_pixman_init;
-
-		if (do_yflip) {
-			pixman_transform_init_scale(&transform,
-						    pixman_fixed_1,
-						    pixman_fixed_minus_1);
-
-			pixman_transform_translate(&transform, NULL,
-						   0,
-						   pixman_int_to_fixed(height));
-
-			pixman_image_set_transform(damaged_image, &transform);
-		}
-
-		pixman_image_composite32(PIXMAN_OP_SRC,
-					 damaged_image,
-					 NULL,
-					 so->cache_image,
-					 0, 0,
-					 0, 0,
-					 x, y,
-					 width, height);
-		pixman_image_unref(damaged_image);
-	}
+		pixman_region32_union(&sb->damage, &sb->damage, frame->damage);
 
 	so->cache_dirty = 1;
-
-	pixman_region32_fini(&damage);
 	shared_output_update(so);
-
-	return;
-
-err_pixman_init:
-	pixman_region32_fini(&damage);
-err_shared_output:
-	shared_output_destroy(so);
 }
 
 static struct shared_output *
@@ -1008,14 +954,20 @@ shared_output_create(struct weston_output *output, int parent_fd)
 	wl_list_init(&so->shm.free_buffers);
 
 	so->output = output;
+
+	/* Subscribe first, so that the stream's output destroy listener
+	 * runs before ours. */
+	so->stream = weston_capture_stream_subscribe(output,
+						     shared_output_frame, so);
+	if (!so->stream) {
+		weston_log("Screen share failed: could not capture output\n");
+		wl_event_source_remove(so->event_source);
+		goto err_display;
+	}
+
 	so->output_destroyed.notify = output_destroyed;
 	wl_signal_add(&so->output->destroy_signal, &so->output_destroyed);
 
-	so->frame_listener.notify = shared_output_repainted;
-	wl_signal_add(&output->frame_signal, &so->frame_listener);
-	weston_output_disable_planes_incr(output);
-	weston_output_damage(output);
-
 	return so;
 
 err_display:
@@ -1034,7 +986,7 @@ shared_output_destroy(struct shared_output *so)
 {
 	struct ss_shm_buffer *buffer, *bnext;
 
-	weston_output_disable_planes_decr(so->output);
+	weston_capture_stream_unsubscribe(so->stream);
 
 	wl_list_for_each_safe(buffer, bnext, &so->shm.buffers, link)
 		ss_shm_buffer_destroy(buffer);
@@ -1045,10 +997,9 @@ shared_output_destroy(struct shared_output *so)
 	wl_event_source_remove(so->event_source);
 
 	wl_list_remove(&so->output_destroyed.link);
-	wl_list_remove(&so->frame_listener.link);
 
-	pixman_image_unref(so->cache_image);
-	free(so->tmp_data);
+	if (so->cache_image)
+		pixman_image_unref(so->cache_image);
 
 	free(so);
 }
@@ -480,6 +480,9 @@ shell_configuration(struct desktop_shell *shell)
 				       "allow-zap", &allow_zap, true);
 	shell->allow_zap = allow_zap;
 
+	weston_config_section_get_bool(section, "resize-pacing",
+				       &shell->resize_pacing, false);
+
 	weston_config_section_get_string(section,
 					 "binding-modifier", &s, "super");
 	shell->binding_modifier = get_modifier(s);
@@ -994,9 +997,16 @@ view_translate(struct workspace *ws, struct weston_view *view, double d)
 	if (!transform)
 		return;
 
+	/* Whole pixel offsets keep the renderers on their plain translation
+	 * path, and frames that do not move the slide by a whole pixel
+	 * leave the view alone. */
+	d = round(d);
+
 	if (wl_list_empty(&transform->link))
 		wl_list_insert(view->geometry.transformation_list.prev,
 			       &transform->link);
+	else if (transform->matrix.d[13] == d)
+		return;
 
 	weston_matrix_init(&transform->matrix);
 	weston_matrix_translate(&transform->matrix,
@@ -5217,6 +5227,7 @@ wet_shell_init(struct weston_compositor *ec,
 	shell->desktop = weston_desktop_create(ec, &shell_desktop_api, shell);
 	if (!shell->desktop)
 		return -1;
+	weston_desktop_set_resize_pacing(shell->desktop, shell->resize_pacing);
 
 	if (wl_global_create(ec->wl_display,
 			     &weston_desktop_shell_interface, 1,
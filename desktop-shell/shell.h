@@ -199,6 +199,7 @@ struct desktop_shell {
 	struct exposay exposay;
 
 	bool allow_zap;
+	bool resize_pacing;
 	uint32_t binding_modifier;
 	uint32_t exposay_modifier;
 	enum animation_type win_animation_type;
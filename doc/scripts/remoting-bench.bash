@@ -0,0 +1,72 @@
+#!/bin/bash
+
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+#
+# The above copyright notice and this permission notice (including the
+# next paragraph) shall be included in all copies or substantial
+# portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+# BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+# ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+# Measures the CPU time weston spends and the bytes the remoting plugin
+# produces over a period. Weston must already be running with a
+# remote-output whose gst-pipeline ends in a filesink, for example:
+#
+#	[remote-output]
+#	name=remote-1
+#	mode=1920x1080@60
+#	gst-pipeline=appsrc name=src ! videoconvert ! video/x-raw,format=I420 ! jpegenc ! filesink name=sink location=/tmp/remoting.mjpeg
+#
+# Usage:
+#	remoting-bench.bash <OUTPUT FILE> [SECONDS]
+
+file=$1
+seconds=${2:-10}
+
+if [ -z "$file" ]; then
+	echo "usage: $0 <OUTPUT FILE> [SECONDS]" >&2
+	exit 1
+fi
+
+pid=$(pidof -s weston)
+if [ -z "$pid" ]; then
+	echo "weston is not running" >&2
+	exit 1
+fi
+
+cpu_ticks() {
+	# utime and stime, fields 14 and 15 of /proc/<pid>/stat
+	awk '{ print $14 + $15 }' /proc/$pid/stat
+}
+
+file_size() {
+	stat -c %s "$file" 2>/dev/null || echo 0
+}
+
+hz=$(getconf CLK_TCK)
+cpu0=$(cpu_ticks)
+size0=$(file_size)
+
+sleep "$seconds"
+
+cpu1=$(cpu_ticks)
+size1=$(file_size)
+
+awk -v t="$seconds" -v hz="$hz" -v c0="$cpu0" -v c1="$cpu1" \
+    -v s0="$size0" -v s1="$size1" 'BEGIN {
+	printf "weston CPU: %.1f%%\n", 100 * (c1 - c0) / hz / t
+	printf "stream:     %.1f kB/s\n", (s1 - s0) / 1024 / t
+}'
@@ -123,6 +123,8 @@ weston_desktop_create(struct weston_compositor *compositor,
 		      const struct weston_desktop_api *api, void *user_data);
 void
 weston_desktop_destroy(struct weston_desktop *desktop);
+void
+weston_desktop_set_resize_pacing(struct weston_desktop *desktop, bool enabled);
 
 struct wl_client *
 weston_desktop_client_get_client(struct weston_desktop_client *client);
@@ -163,6 +163,33 @@ weston_drm_virtual_output_get_api(struct weston_compositor *compositor)
 	return (const struct weston_drm_virtual_output_api *)api;
 }
 
+#define WESTON_DRM_TEST_COMMIT_API_NAME "weston_drm_test_commit_api_v1"
+
+/** Atomic TEST_ONLY commit counters since the backend started */
+struct weston_drm_test_commit_stats {
+	uint64_t tests;
+	/** tests answered from the test-commit cache */
+	uint64_t hits;
+	/** tests that reached the kernel */
+	uint64_t ioctls;
+	uint64_t failures;
+};
+
+struct weston_drm_test_commit_api {
+	void (*get_stats)(struct weston_compositor *compositor,
+			  struct weston_drm_test_commit_stats *stats);
+};
+
+static inline const struct weston_drm_test_commit_api *
+weston_drm_test_commit_get_api(struct weston_compositor *compositor)
+{
+	const void *api;
+	api = weston_plugin_api_get(compositor,
+				    WESTON_DRM_TEST_COMMIT_API_NAME,
+				    sizeof(struct weston_drm_test_commit_api));
+	return (const struct weston_drm_test_commit_api *)api;
+}
+
 /** The backend configuration struct.
  *
  * weston_drm_backend_config contains the configuration used by a DRM
@@ -34,7 +34,36 @@ extern "C" {
 
 #include <libweston/libweston.h>
 
-#define WESTON_HEADLESS_BACKEND_CONFIG_VERSION 2
+#define WESTON_HEADLESS_BACKEND_CONFIG_VERSION 3
+
+enum weston_headless_jitter {
+	/** Evenly spread over [-jitter, +jitter] */
+	WESTON_HEADLESS_JITTER_UNIFORM = 0,
+	/** Approximately normal, clamped to [-jitter, +jitter] */
+	WESTON_HEADLESS_JITTER_NORMAL,
+};
+
+/** Simulated display clock
+ *
+ * With refresh left at 0, frames complete on a plain timer and no vblank
+ * sequence is reported. Otherwise every output runs a fake display
+ * clock: a repainted frame is presented at the first vblank after the
+ * repaint, plus the scanout latency, and reported with the vblank
+ * sequence number. The random jitter and missed vblanks are drawn from a
+ * generator seeded with seed, so runs repeat.
+ */
+struct weston_headless_vsync_config {
+	/** Refresh rate in mHz */
+	int refresh;
+	/** Time from vblank to presentation in microseconds */
+	int scanout_latency_usec;
+	/** Largest deviation of a vblank in microseconds */
+	int jitter_usec;
+	enum weston_headless_jitter jitter_distribution;
+	/** Chance of a frame missing its vblank, in percent */
+	int miss_percent;
+	uint32_t seed;
+};
 
 struct weston_headless_backend_config {
 	struct weston_backend_config base;
@@ -44,6 +73,9 @@ struct weston_headless_backend_config {
 
 	/** Whether to use the GL renderer, conflicts with use_pixman */
 	bool use_gl;
+
+	/** Simulated display clock, see weston_headless_vsync_config */
+	struct weston_headless_vsync_config vsync;
 };
 
 #ifdef  __cplusplus
@@ -82,6 +82,9 @@ struct weston_recorder;
 struct weston_pointer_constraint;
 struct ro_anonymous_file;
 
+/* Number of hash buckets per binding type, must be a power of two */
+#define WESTON_BINDING_TABLE_SIZE 64
+
 enum weston_keyboard_modifier {
 	MODIFIER_CTRL = (1 << 0),
 	MODIFIER_ALT = (1 << 1),
@@ -613,6 +616,16 @@ struct weston_touch {
 	struct timespec grab_time;
 
 	struct wl_list timestamps_list;
+
+	/* Affine global-to-surface transform of the focus view, cached
+	 * for the touch sequence; see weston_touch_from_global_fixed() */
+	struct {
+		struct weston_view *view;
+		uint32_t serial;
+		bool affine;
+		float xx, xy, x0;
+		float yx, yy, y0;
+	} focus_transform;
 };
 
 void
@@ -715,6 +728,8 @@ weston_pointer_start_drag(struct weston_pointer *pointer,
 struct weston_xkb_info {
 	struct xkb_keymap *keymap;
 	struct ro_anonymous_file *keymap_rofile;
+	char *keymap_string;
+	struct wl_list link; /* weston_compositor::xkb_info_list */
 	int32_t ref_count;
 	xkb_mod_index_t shift_mod;
 	xkb_mod_index_t caps_mod;
@@ -1061,6 +1076,16 @@ struct weston_compositor {
 	struct wl_list axis_binding_list;
 	struct wl_list debug_binding_list;
 
+	/* Buckets indexing the binding lists above by (code, modifier),
+	 * so that dispatch does not walk every installed binding. */
+	struct wl_list key_binding_table[WESTON_BINDING_TABLE_SIZE];
+	struct wl_list button_binding_table[WESTON_BINDING_TABLE_SIZE];
+	struct wl_list touch_binding_table[WESTON_BINDING_TABLE_SIZE];
+	struct wl_list axis_binding_table[WESTON_BINDING_TABLE_SIZE];
+	/* Bumped on every key, button and axis press; a modifier binding
+	 * only fires if nothing was pressed since it was primed. */
+	uint32_t modifier_binding_serial;
+
 	uint32_t state;
 	struct wl_event_source *idle_source;
 	uint32_t idle_inhibit;
@@ -1090,6 +1115,8 @@ struct weston_compositor {
 	struct xkb_rule_names xkb_names;
 	struct xkb_context *xkb_context;
 	struct weston_xkb_info *xkb_info;
+	/* Live keymaps, shared by content between all seats */
+	struct wl_list xkb_info_list; /* weston_xkb_info::link */
 
 	int32_t kb_repeat_rate;
 	int32_t kb_repeat_delay;
@@ -1281,6 +1308,9 @@ struct weston_view {
 	 */
 	struct {
 		int dirty;
+		/* bumped by weston_view_geometry_dirty(), lets users of
+		 * the matrices below know when to refresh copies of them */
+		uint32_t serial;
 
 		/* Approximations in global coordinates:
 		 * - boundingbox is guaranteed to include the whole view in
@@ -1877,6 +1907,34 @@ weston_recorder_start(struct weston_output *output, const char *filename);
 void
 weston_recorder_stop(struct weston_recorder *recorder);
 
+struct weston_capture_stream;
+
+/** One frame of a capture stream
+ *
+ * \c image is the stream's persistent copy of the whole output, in buffer
+ * coordinates, top row first. \c damage is the part of it that changed
+ * since this subscriber's previous frame; the first frame a subscriber
+ * receives covers the whole image. Both stay owned by libweston and are
+ * only valid during the callback.
+ */
+struct weston_capture_frame {
+	struct weston_output *output;
+	uint32_t seq;
+	const struct timespec *frame_time;
+	pixman_image_t *image;
+	pixman_region32_t *damage;
+};
+
+typedef void (*weston_capture_stream_func_t)(struct weston_capture_frame *frame,
+					     void *data);
+
+struct weston_capture_stream *
+weston_capture_stream_subscribe(struct weston_output *output,
+				weston_capture_stream_func_t frame,
+				void *data);
+void
+weston_capture_stream_unsubscribe(struct weston_capture_stream *stream);
+
 struct weston_view_animation;
 typedef	void (*weston_view_animation_done_func_t)(struct weston_view_animation *animation, void *data);
 
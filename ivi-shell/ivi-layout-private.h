@@ -43,10 +43,17 @@ struct ivi_layout_view {
 
 	struct ivi_layout_surface *ivisurf;
 	struct ivi_layout_layer *on_layer;
+
+	/* ivi_layout::commit_serial of the last commit that visited it */
+	uint32_t commit_serial;
 };
 
+#define IVI_LAYOUT_ID_TABLE_SIZE 256
+
 struct ivi_layout_surface {
 	struct wl_list link;	/* ivi_layout::surface_list */
+	struct wl_list id_link;	/* ivi_layout::surface_id_table */
+	struct wl_list dirty_link;	/* ivi_layout::dirty_surface_list */
 	struct wl_signal property_changed;
 	int32_t update_count;
 	uint32_t id_surface;
@@ -58,6 +65,7 @@ struct ivi_layout_surface {
 	struct ivi_layout_surface_properties prop;
 
 	struct {
+		int dirty;
 		struct ivi_layout_surface_properties prop;
 	} pending;
 
@@ -66,6 +74,8 @@ struct ivi_layout_surface {
 
 struct ivi_layout_layer {
 	struct wl_list link;	/* ivi_layout::layer_list */
+	struct wl_list id_link;	/* ivi_layout::layer_id_table */
+	struct wl_list dirty_link;	/* ivi_layout::dirty_layer_list */
 	struct wl_signal property_changed;
 	uint32_t id_layer;
 
@@ -75,6 +85,7 @@ struct ivi_layout_layer {
 	struct ivi_layout_layer_properties prop;
 
 	struct {
+		int dirty;
 		struct ivi_layout_layer_properties prop;
 		struct wl_list view_list;	/* ivi_layout_view::pending_link */
 		struct wl_list link;	/* ivi_layout_screen::pending.layer_list */
@@ -89,6 +100,22 @@ struct ivi_layout_layer {
 	int32_t ref_count;
 };
 
+struct ivi_layout_screen {
+	struct wl_list link;	/* ivi_layout::screen_list */
+
+	struct ivi_layout *layout;
+	struct weston_output *output;
+
+	struct {
+		struct wl_list layer_list;	/* ivi_layout_layer::pending.link */
+	} pending;
+
+	struct {
+		int dirty;
+		struct wl_list layer_list;	/* ivi_layout_layer::order.link */
+	} order;
+};
+
 struct ivi_layout {
 	struct weston_compositor *compositor;
 
@@ -97,6 +124,20 @@ struct ivi_layout {
 	struct wl_list screen_list;	/* ivi_layout_screen::link */
 	struct wl_list view_list;	/* ivi_layout_view::link */
 
+	/* Buckets keyed on id_surface and id_layer, so id lookups do not
+	 * have to walk surface_list and layer_list. Surfaces without an id
+	 * (IVI_INVALID_ID) are not hashed. */
+	struct wl_list surface_id_table[IVI_LAYOUT_ID_TABLE_SIZE];	/* ivi_layout_surface::id_link */
+	struct wl_list layer_id_table[IVI_LAYOUT_ID_TABLE_SIZE];	/* ivi_layout_layer::id_link */
+
+	/* Surfaces and layers commit_changes has to visit: those with
+	 * pending changes, and those whose committed event_mask still has
+	 * to be cleared by the next commit. */
+	struct wl_list dirty_surface_list;	/* ivi_layout_surface::dirty_link */
+	struct wl_list dirty_layer_list;	/* ivi_layout_layer::dirty_link */
+	bool view_list_dirty;
+	uint32_t commit_serial;
+
 	struct {
 		struct wl_signal created;
 		struct wl_signal removed;
@@ -125,8 +166,14 @@ struct ivi_layout *get_instance(void);
 struct ivi_layout_transition;
 
 struct ivi_layout_transition_set {
+	struct weston_compositor *compositor;
 	struct wl_event_source  *event_source;
 	struct wl_list          transition_list;
+
+	/* stepped from the repaint of 'output' while it is non-NULL */
+	struct weston_animation animation;
+	struct weston_output    *output;
+	struct wl_listener      output_destroy_listener;
 };
 
 typedef void (*ivi_layout_transition_destroy_user_func)(void *user_data);
@@ -134,6 +181,9 @@ typedef void (*ivi_layout_transition_destroy_user_func)(void *user_data);
 struct ivi_layout_transition_set *
 ivi_layout_transition_set_create(struct weston_compositor *ec);
 
+void
+ivi_layout_transition_set_schedule(struct ivi_layout_transition_set *transitions);
+
 void
 ivi_layout_transition_move_resize_view(struct ivi_layout_surface *surface,
 				       int32_t dest_x, int32_t dest_y,
@@ -54,6 +54,9 @@ struct ivi_layout_surface*
 ivi_layout_surface_create(struct weston_surface *wl_surface,
 			  uint32_t id_surface);
 
+void
+ivi_layout_surface_committed(struct ivi_layout_surface *ivisurf);
+
 void
 ivi_layout_init_with_compositor(struct weston_compositor *ec);
 
@@ -35,6 +35,8 @@
 #include "ivi-shell.h"
 #include "ivi-layout-export.h"
 #include "ivi-layout-private.h"
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
 
 struct ivi_layout_transition;
 
@@ -156,32 +158,143 @@ do_transition_frame(struct ivi_layout_transition *transition,
 		layout_transition_destroy(transition);
 }
 
+static void
+run_transition_frames(struct ivi_layout_transition_set *transitions,
+		      uint32_t msec)
+{
+	struct transition_node *node = NULL;
+	struct transition_node *next = NULL;
+
+	wl_list_for_each_safe(node, next, &transitions->transition_list, link) {
+		do_transition_frame(node->transition, msec);
+	}
+
+	ivi_layout_commit_changes();
+}
+
+static void
+transition_set_stop(struct ivi_layout_transition_set *transitions)
+{
+	if (!transitions->output)
+		return;
+
+	wl_list_remove(&transitions->animation.link);
+	wl_list_init(&transitions->animation.link);
+	wl_list_remove(&transitions->output_destroy_listener.link);
+	transitions->output = NULL;
+}
+
+/*
+ * Transitions are stepped from the repaint of one output, like the
+ * desktop-shell animations. The frame callback runs right after that
+ * output has been repainted, so whatever the transitions change now is
+ * drawn by its next repaint and presented one refresh after the frame
+ * being repainted, two refreshes after 'time'. Evaluate the transitions
+ * at that instant rather than at the time the callback happens to run.
+ */
+static void
+layout_transition_animation_frame(struct weston_animation *animation,
+				  struct weston_output *output,
+				  const struct timespec *time)
+{
+	struct ivi_layout_transition_set *transitions =
+		container_of(animation, struct ivi_layout_transition_set,
+			     animation);
+	struct timespec target;
+	int64_t refresh_nsec = 1000000000LL / 60;
+
+	if (wl_list_empty(&transitions->transition_list)) {
+		transition_set_stop(transitions);
+		return;
+	}
+
+	if (output->current_mode && output->current_mode->refresh > 0)
+		refresh_nsec = millihz_to_nsec(output->current_mode->refresh);
+
+	if (timespec_is_zero(time))
+		weston_compositor_read_presentation_clock(output->compositor,
+							  &target);
+	else
+		target = *time;
+
+	timespec_add_nsec(&target, &target, 2 * refresh_nsec);
+
+	run_transition_frames(transitions, timespec_to_msec(&target));
+
+	if (wl_list_empty(&transitions->transition_list))
+		transition_set_stop(transitions);
+	else
+		weston_output_schedule_repaint(output);
+}
+
+/* Fallback for when no output is enabled to pace the transitions. */
 static int32_t
 layout_transition_frame(void *data)
 {
 	struct ivi_layout_transition_set *transitions = data;
 	uint32_t fps = 30;
 	struct timespec timestamp = {};
-	uint32_t msec = 0;
-	struct transition_node *node = NULL;
-	struct transition_node *next = NULL;
 
 	if (wl_list_empty(&transitions->transition_list)) {
 		wl_event_source_timer_update(transitions->event_source, 0);
 		return 1;
 	}
 
+	/* an output showed up in the meantime */
+	if (!wl_list_empty(&transitions->compositor->output_list)) {
+		wl_event_source_timer_update(transitions->event_source, 0);
+		ivi_layout_transition_set_schedule(transitions);
+		return 1;
+	}
+
+	weston_compositor_read_presentation_clock(transitions->compositor,
+						  &timestamp);
+	run_transition_frames(transitions, timespec_to_msec(&timestamp));
+
+	/* re-arm after the commit, which asks for an immediate frame */
 	wl_event_source_timer_update(transitions->event_source, 1000 / fps);
 
-	clock_gettime(CLOCK_MONOTONIC, &timestamp);/* FIXME */
-	msec = (1e+3 * timestamp.tv_sec + 1e-6 * timestamp.tv_nsec);
+	return 1;
+}
 
-	wl_list_for_each_safe(node, next, &transitions->transition_list, link) {
-		do_transition_frame(node->transition, msec);
+static void
+transition_set_handle_output_destroy(struct wl_listener *listener, void *data)
+{
+	struct ivi_layout_transition_set *transitions =
+		container_of(listener, struct ivi_layout_transition_set,
+			     output_destroy_listener);
+
+	transition_set_stop(transitions);
+	ivi_layout_transition_set_schedule(transitions);
+}
+
+void
+ivi_layout_transition_set_schedule(struct ivi_layout_transition_set *transitions)
+{
+	struct weston_output *output;
+
+	if (wl_list_empty(&transitions->transition_list))
+		return;
+
+	if (transitions->output) {
+		weston_output_schedule_repaint(transitions->output);
+		return;
 	}
 
-	ivi_layout_commit_changes();
-	return 1;
+	if (wl_list_empty(&transitions->compositor->output_list)) {
+		wl_event_source_timer_update(transitions->event_source, 1);
+		return;
+	}
+
+	output = container_of(transitions->compositor->output_list.next,
+			      struct weston_output, link);
+
+	transitions->output = output;
+	wl_list_insert(&output->animation_list, &transitions->animation.link);
+	wl_signal_add(&output->destroy_signal,
+		      &transitions->output_destroy_listener);
+
+	weston_output_schedule_repaint(output);
 }
 
 struct ivi_layout_transition_set *
@@ -190,14 +303,20 @@ ivi_layout_transition_set_create(struct weston_compositor *ec)
 	struct ivi_layout_transition_set *transitions;
 	struct wl_event_loop *loop;
 
-	transitions = malloc(sizeof(*transitions));
+	transitions = zalloc(sizeof(*transitions));
 	if (transitions == NULL) {
 		weston_log("%s: memory allocation fails\n", __func__);
 		return NULL;
 	}
 
+	transitions->compositor = ec;
 	wl_list_init(&transitions->transition_list);
 
+	transitions->animation.frame = layout_transition_animation_frame;
+	wl_list_init(&transitions->animation.link);
+	transitions->output_destroy_listener.notify =
+		transition_set_handle_output_destroy;
+
 	loop = wl_display_get_event_loop(ec->wl_display);
 	transitions->event_source =
 		wl_event_loop_add_timer(loop, layout_transition_frame,
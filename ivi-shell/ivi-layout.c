@@ -79,22 +79,6 @@ DEFINE_LOG_LABEL("IVILayout");
 
 struct ivi_layout;
 
-struct ivi_layout_screen {
-	struct wl_list link;	/* ivi_layout::screen_list */
-
-	struct ivi_layout *layout;
-	struct weston_output *output;
-
-	struct {
-		struct wl_list layer_list;	/* ivi_layout_layer::pending.link */
-	} pending;
-
-	struct {
-		int dirty;
-		struct wl_list layer_list;	/* ivi_layout_layer::order.link */
-	} order;
-};
-
 struct ivi_rectangle
 {
 	int32_t x;
@@ -115,12 +99,25 @@ get_instance(void)
 /**
  * Internal API to add/remove an ivi_layer to/from ivi_screen.
  */
+static struct wl_list *
+id_table_bucket(struct wl_list *table, uint32_t id)
+{
+	/* ids are often allocated in strides, e.g. per screen, so spread
+	 * them with a multiplicative hash rather than taking the low bits */
+	static_assert(IVI_LAYOUT_ID_TABLE_SIZE == 256,
+		      "id_table_bucket() assumes an 8-bit bucket index");
+
+	return &table[(id * 2654435761u) >> 24];
+}
+
 static struct ivi_layout_surface *
-get_surface(struct wl_list *surf_list, uint32_t id_surface)
+get_surface(struct ivi_layout *layout, uint32_t id_surface)
 {
 	struct ivi_layout_surface *ivisurf;
+	struct wl_list *bucket;
 
-	wl_list_for_each(ivisurf, surf_list, link) {
+	bucket = id_table_bucket(layout->surface_id_table, id_surface);
+	wl_list_for_each(ivisurf, bucket, id_link) {
 		if (ivisurf->id_surface == id_surface) {
 			return ivisurf;
 		}
@@ -130,11 +127,13 @@ get_surface(struct wl_list *surf_list, uint32_t id_surface)
 }
 
 static struct ivi_layout_layer *
-get_layer(struct wl_list *layer_list, uint32_t id_layer)
+get_layer(struct ivi_layout *layout, uint32_t id_layer)
 {
 	struct ivi_layout_layer *ivilayer;
+	struct wl_list *bucket;
 
-	wl_list_for_each(ivilayer, layer_list, link) {
+	bucket = id_table_bucket(layout->layer_id_table, id_layer);
+	wl_list_for_each(ivilayer, bucket, id_link) {
 		if (ivilayer->id_layer == id_layer) {
 			return ivilayer;
 		}
@@ -143,6 +142,44 @@ get_layer(struct wl_list *layer_list, uint32_t id_layer)
 	return NULL;
 }
 
+static void
+surface_hash_id(struct ivi_layout *layout, struct ivi_layout_surface *ivisurf)
+{
+	wl_list_remove(&ivisurf->id_link);
+
+	if (ivisurf->id_surface == IVI_INVALID_ID) {
+		wl_list_init(&ivisurf->id_link);
+		return;
+	}
+
+	wl_list_insert(id_table_bucket(layout->surface_id_table,
+				       ivisurf->id_surface),
+		       &ivisurf->id_link);
+}
+
+static void
+dirty_list_insert(struct wl_list *dirty_list, struct wl_list *dirty_link)
+{
+	if (wl_list_empty(dirty_link))
+		wl_list_insert(dirty_list->prev, dirty_link);
+}
+
+static void
+surface_mark_dirty(struct ivi_layout_surface *ivisurf)
+{
+	ivisurf->pending.dirty = 1;
+	dirty_list_insert(&ivisurf->layout->dirty_surface_list,
+			  &ivisurf->dirty_link);
+}
+
+static void
+layer_mark_dirty(struct ivi_layout_layer *ivilayer)
+{
+	ivilayer->pending.dirty = 1;
+	dirty_list_insert(&ivilayer->layout->dirty_layer_list,
+			  &ivilayer->dirty_link);
+}
+
 static bool
 ivi_view_is_rendered(struct ivi_layout_view *view)
 {
@@ -265,6 +302,8 @@ ivi_layout_surface_destroy(struct ivi_layout_surface *ivisurf)
 	}
 
 	wl_list_remove(&ivisurf->link);
+	wl_list_remove(&ivisurf->id_link);
+	wl_list_remove(&ivisurf->dirty_link);
 
 	wl_list_for_each_safe(ivi_view, next, &ivisurf->view_list, surf_link) {
 		ivi_view_destroy(ivi_view);
@@ -632,23 +671,51 @@ ivi_view_is_mapped(struct ivi_layout_view *ivi_view)
 		ivi_view->ivisurf->prop.visibility);
 }
 
+static void
+commit_view(struct ivi_layout *layout, struct ivi_layout_view *ivi_view)
+{
+	/* a view can be reached through both its layer and its surface */
+	if (ivi_view->commit_serial == layout->commit_serial)
+		return;
+
+	ivi_view->commit_serial = layout->commit_serial;
+
+	/*
+	 * If the view is not on the currently rendered scenegraph,
+	 * we do not need to update its properties.
+	 */
+	if (!ivi_view_is_mapped(ivi_view))
+		return;
+
+	update_prop(ivi_view);
+}
+
 static void
 commit_changes(struct ivi_layout *layout)
 {
     LOG_PASS();
-	struct ivi_layout_view *ivi_view  = NULL;
+	struct ivi_layout_layer *ivilayer = NULL;
+	struct ivi_layout_surface *ivisurf = NULL;
+	struct ivi_layout_view *ivi_view = NULL;
 
-	wl_list_for_each(ivi_view, &layout->view_list, link) {
-		/*
-		 * If the view is not on the currently rendered scenegraph,
-		 * we do not need to update its properties.
-		 */
-        LOG_PASS();
-		if (!ivi_view_is_mapped(ivi_view))
+	layout->commit_serial++;
+
+	/* Only views whose layer or surface has a non-empty event_mask are
+	 * updated by update_prop(), and all of those are on a dirty list. */
+	wl_list_for_each(ivilayer, &layout->dirty_layer_list, dirty_link) {
+		if (!ivilayer->prop.event_mask)
+			continue;
+
+		wl_list_for_each(ivi_view, &ivilayer->order.view_list, order_link)
+			commit_view(layout, ivi_view);
+	}
+
+	wl_list_for_each(ivisurf, &layout->dirty_surface_list, dirty_link) {
+		if (!ivisurf->prop.event_mask)
 			continue;
 
-        LOG_PASS();
-		update_prop(ivi_view);
+		wl_list_for_each(ivi_view, &ivisurf->view_list, surf_link)
+			commit_view(layout, ivi_view);
 	}
 }
 
@@ -662,7 +729,9 @@ commit_surface_list(struct ivi_layout *layout)
 	int32_t dest_height = 0;
 	int32_t configured = 0;
 
-	wl_list_for_each(ivisurf, &layout->surface_list, link) {
+	wl_list_for_each(ivisurf, &layout->dirty_surface_list, dirty_link) {
+		ivisurf->pending.dirty = 0;
+
 		if (ivisurf->pending.prop.transition_type == IVI_LAYOUT_TRANSITION_VIEW_DEFAULT) {
 			dest_x = ivisurf->prop.dest_x;
 			dest_y = ivisurf->prop.dest_y;
@@ -751,6 +820,9 @@ commit_surface_list(struct ivi_layout *layout)
 							    ivisurf->prop.dest_height);
 			}
 		}
+
+		if (ivisurf->prop.event_mask & IVI_NOTIFICATION_VISIBILITY)
+			layout->view_list_dirty = true;
 	}
 }
 
@@ -761,7 +833,9 @@ commit_layer_list(struct ivi_layout *layout)
 	struct ivi_layout_layer   *ivilayer = NULL;
 	struct ivi_layout_view *next     = NULL;
 
-	wl_list_for_each(ivilayer, &layout->layer_list, link) {
+	wl_list_for_each(ivilayer, &layout->dirty_layer_list, dirty_link) {
+		ivilayer->pending.dirty = 0;
+
 		if (ivilayer->pending.prop.transition_type == IVI_LAYOUT_TRANSITION_LAYER_MOVE) {
 			ivi_layout_transition_move_layer(ivilayer, ivilayer->pending.prop.dest_x, ivilayer->pending.prop.dest_y, ivilayer->pending.prop.transition_duration);
 		} else if (ivilayer->pending.prop.transition_type == IVI_LAYOUT_TRANSITION_LAYER_FADE) {
@@ -774,6 +848,9 @@ commit_layer_list(struct ivi_layout *layout)
 
 		ivilayer->prop = ivilayer->pending.prop;
 
+		if (ivilayer->prop.event_mask & IVI_NOTIFICATION_VISIBILITY)
+			layout->view_list_dirty = true;
+
 		if (!ivilayer->order.dirty) {
 			continue;
 		}
@@ -783,6 +860,8 @@ commit_layer_list(struct ivi_layout *layout)
 			wl_list_remove(&ivi_view->order_link);
 			wl_list_init(&ivi_view->order_link);
 			ivi_view->ivisurf->prop.event_mask |= IVI_NOTIFICATION_REMOVE;
+			dirty_list_insert(&layout->dirty_surface_list,
+					  &ivi_view->ivisurf->dirty_link);
 		}
 
 		assert(wl_list_empty(&ivilayer->order.view_list));
@@ -792,9 +871,12 @@ commit_layer_list(struct ivi_layout *layout)
 			wl_list_remove(&ivi_view->order_link);
 			wl_list_insert(&ivilayer->order.view_list, &ivi_view->order_link);
 			ivi_view->ivisurf->prop.event_mask |= IVI_NOTIFICATION_ADD;
+			dirty_list_insert(&layout->dirty_surface_list,
+					  &ivi_view->ivisurf->dirty_link);
 		}
 
 		ivilayer->order.dirty = 0;
+		layout->view_list_dirty = true;
 	}
 }
 
@@ -813,6 +895,8 @@ commit_screen_list(struct ivi_layout *layout)
 				wl_list_remove(&ivilayer->order.link);
 				wl_list_init(&ivilayer->order.link);
 				ivilayer->prop.event_mask |= IVI_NOTIFICATION_REMOVE;
+				dirty_list_insert(&layout->dirty_layer_list,
+						  &ivilayer->dirty_link);
 			}
 
 			assert(wl_list_empty(&iviscrn->order.layer_list));
@@ -826,9 +910,12 @@ commit_screen_list(struct ivi_layout *layout)
 					       &ivilayer->order.link);
 				ivilayer->on_screen = iviscrn;
 				ivilayer->prop.event_mask |= IVI_NOTIFICATION_ADD;
+				dirty_list_insert(&layout->dirty_layer_list,
+						  &ivilayer->dirty_link);
 			}
 
 			iviscrn->order.dirty = 0;
+			layout->view_list_dirty = true;
 		}
 	}
 }
@@ -840,6 +927,14 @@ build_view_list(struct ivi_layout *layout)
 	struct ivi_layout_layer   *ivilayer;
 	struct ivi_layout_view   *ivi_view;
 
+	/* Which views are mapped, and in which order, only depends on the
+	 * screen and layer render orders and on visibility. Property-only
+	 * commits leave the scenegraph as it is. */
+	if (!layout->view_list_dirty)
+		return;
+
+	layout->view_list_dirty = false;
+
 	/* If ivi_view is not part of the scenegrapgh, we have to unmap
 	 * weston_views
 	 */
@@ -882,7 +977,7 @@ commit_transition(struct ivi_layout* layout)
 
 	wl_list_init(&layout->pending_transition_list);
 
-	wl_event_source_timer_update(layout->transitions->event_source, 1);
+	ivi_layout_transition_set_schedule(layout->transitions);
 }
 
 static void
@@ -905,17 +1000,55 @@ send_prop(struct ivi_layout *layout)
 	struct ivi_layout_layer   *ivilayer = NULL;
 	struct ivi_layout_surface *ivisurf  = NULL;
 
-	wl_list_for_each_reverse(ivilayer, &layout->layer_list, link) {
+	wl_list_for_each_reverse(ivilayer, &layout->dirty_layer_list, dirty_link) {
 		if (ivilayer->prop.event_mask)
 			send_layer_prop(ivilayer);
 	}
 
-	wl_list_for_each_reverse(ivisurf, &layout->surface_list, link) {
+	wl_list_for_each_reverse(ivisurf, &layout->dirty_surface_list, dirty_link) {
 		if (ivisurf->prop.event_mask)
 			send_surface_prop(ivisurf);
 	}
 }
 
+/*
+ * Drops surfaces and layers from the dirty lists once committing them
+ * again would not change anything. A committed event_mask is only cleared
+ * by the following commit, and a surface in a move/resize transition keeps
+ * its old destination rectangle until then, so those stay for one more
+ * round; so does anything a property_changed listener touched.
+ */
+static void
+settle_dirty_lists(struct ivi_layout *layout)
+{
+	struct ivi_layout_layer   *ivilayer, *next_layer;
+	struct ivi_layout_surface *ivisurf, *next_surf;
+
+	wl_list_for_each_safe(ivilayer, next_layer,
+			      &layout->dirty_layer_list, dirty_link) {
+		if (ivilayer->pending.dirty || ivilayer->prop.event_mask)
+			continue;
+
+		wl_list_remove(&ivilayer->dirty_link);
+		wl_list_init(&ivilayer->dirty_link);
+	}
+
+	wl_list_for_each_safe(ivisurf, next_surf,
+			      &layout->dirty_surface_list, dirty_link) {
+		if (ivisurf->pending.dirty || ivisurf->prop.event_mask)
+			continue;
+
+		if (ivisurf->prop.dest_x != ivisurf->pending.prop.dest_x ||
+		    ivisurf->prop.dest_y != ivisurf->pending.prop.dest_y ||
+		    ivisurf->prop.dest_width != ivisurf->pending.prop.dest_width ||
+		    ivisurf->prop.dest_height != ivisurf->pending.prop.dest_height)
+			continue;
+
+		wl_list_remove(&ivisurf->dirty_link);
+		wl_list_init(&ivisurf->dirty_link);
+	}
+}
+
 static void
 clear_view_pending_list(struct ivi_layout_layer *ivilayer)
 {
@@ -1039,30 +1172,16 @@ static struct ivi_layout_layer *
 ivi_layout_get_layer_from_id(uint32_t id_layer)
 {
 	struct ivi_layout *layout = get_instance();
-	struct ivi_layout_layer *ivilayer = NULL;
-
-	wl_list_for_each(ivilayer, &layout->layer_list, link) {
-		if (ivilayer->id_layer == id_layer) {
-			return ivilayer;
-		}
-	}
 
-	return NULL;
+	return get_layer(layout, id_layer);
 }
 
 struct ivi_layout_surface *
 ivi_layout_get_surface_from_id(uint32_t id_surface)
 {
 	struct ivi_layout *layout = get_instance();
-	struct ivi_layout_surface *ivisurf = NULL;
 
-	wl_list_for_each(ivisurf, &layout->surface_list, link) {
-		if (ivisurf->id_surface == id_surface) {
-			return ivisurf;
-		}
-	}
-
-	return NULL;
+	return get_surface(layout, id_surface);
 }
 
 static int32_t
@@ -1307,7 +1426,7 @@ ivi_layout_layer_create_with_dimension(uint32_t id_layer,
 	struct ivi_layout *layout = get_instance();
 	struct ivi_layout_layer *ivilayer = NULL;
 
-	ivilayer = get_layer(&layout->layer_list, id_layer);
+	ivilayer = get_layer(layout, id_layer);
 	if (ivilayer != NULL) {
 		weston_log("id_layer is already created\n");
 		++ivilayer->ref_count;
@@ -1335,6 +1454,9 @@ ivi_layout_layer_create_with_dimension(uint32_t id_layer,
 	wl_list_init(&ivilayer->order.link);
 
 	wl_list_insert(&layout->layer_list, &ivilayer->link);
+	wl_list_insert(id_table_bucket(layout->layer_id_table, id_layer),
+		       &ivilayer->id_link);
+	wl_list_init(&ivilayer->dirty_link);
 
 	wl_signal_emit(&layout->layer_notification.created, ivilayer);
 
@@ -1366,6 +1488,8 @@ ivi_layout_layer_destroy(struct ivi_layout_layer *ivilayer)
 	wl_list_remove(&ivilayer->pending.link);
 	wl_list_remove(&ivilayer->order.link);
 	wl_list_remove(&ivilayer->link);
+	wl_list_remove(&ivilayer->id_link);
+	wl_list_remove(&ivilayer->dirty_link);
 
 	free(ivilayer);
 }
@@ -1381,6 +1505,7 @@ ivi_layout_layer_set_visibility(struct ivi_layout_layer *ivilayer,
 		return IVI_FAILED;
 	}
 
+	layer_mark_dirty(ivilayer);
 	prop = &ivilayer->pending.prop;
 	prop->visibility = newVisibility;
 
@@ -1405,6 +1530,7 @@ ivi_layout_layer_set_opacity(struct ivi_layout_layer *ivilayer,
 		return IVI_FAILED;
 	}
 
+	layer_mark_dirty(ivilayer);
 	prop = &ivilayer->pending.prop;
 	prop->opacity = opacity;
 
@@ -1428,6 +1554,7 @@ ivi_layout_layer_set_source_rectangle(struct ivi_layout_layer *ivilayer,
 		return IVI_FAILED;
 	}
 
+	layer_mark_dirty(ivilayer);
 	prop = &ivilayer->pending.prop;
 	prop->source_x = x;
 	prop->source_y = y;
@@ -1456,6 +1583,7 @@ ivi_layout_layer_set_destination_rectangle(struct ivi_layout_layer *ivilayer,
 		return IVI_FAILED;
 	}
 
+	layer_mark_dirty(ivilayer);
 	prop = &ivilayer->pending.prop;
 	prop->dest_x = x;
 	prop->dest_y = y;
@@ -1499,6 +1627,7 @@ ivi_layout_layer_set_render_order(struct ivi_layout_layer *ivilayer,
 	}
 
 	ivilayer->order.dirty = 1;
+	layer_mark_dirty(ivilayer);
 
 	return IVI_SUCCEEDED;
 }
@@ -1514,6 +1643,7 @@ ivi_layout_surface_set_visibility(struct ivi_layout_surface *ivisurf,
 		return IVI_FAILED;
 	}
 
+	surface_mark_dirty(ivisurf);
 	prop = &ivisurf->pending.prop;
 	prop->visibility = newVisibility;
 
@@ -1538,6 +1668,7 @@ ivi_layout_surface_set_opacity(struct ivi_layout_surface *ivisurf,
 		return IVI_FAILED;
 	}
 
+	surface_mark_dirty(ivisurf);
 	prop = &ivisurf->pending.prop;
 	prop->opacity = opacity;
 
@@ -1561,6 +1692,7 @@ ivi_layout_surface_set_destination_rectangle(struct ivi_layout_surface *ivisurf,
 		return IVI_FAILED;
 	}
 
+	surface_mark_dirty(ivisurf);
 	prop = &ivisurf->pending.prop;
 	prop->start_x = prop->dest_x;
 	prop->start_y = prop->dest_y;
@@ -1779,6 +1911,7 @@ ivi_layout_layer_add_surface(struct ivi_layout_layer *ivilayer,
 	wl_list_insert(&ivilayer->pending.view_list, &ivi_view->pending_link);
 
 	ivilayer->order.dirty = 1;
+	layer_mark_dirty(ivilayer);
 
 	return IVI_SUCCEEDED;
 }
@@ -1800,6 +1933,7 @@ ivi_layout_layer_remove_surface(struct ivi_layout_layer *ivilayer,
 		wl_list_init(&ivi_view->pending_link);
 
 		ivilayer->order.dirty = 1;
+		layer_mark_dirty(ivilayer);
 	}
 }
 
@@ -1815,6 +1949,7 @@ ivi_layout_surface_set_source_rectangle(struct ivi_layout_surface *ivisurf,
 		return IVI_FAILED;
 	}
 
+	surface_mark_dirty(ivisurf);
 	prop = &ivisurf->pending.prop;
 	prop->source_x = x;
 	prop->source_y = y;
@@ -1842,6 +1977,7 @@ ivi_layout_surface_set_force_refresh(struct ivi_layout_surface *ivisurf)
 		return IVI_FAILED;
 	}
 
+	surface_mark_dirty(ivisurf);
 	prop = &ivisurf->pending.prop;
 
 	prop->event_mask |= IVI_NOTIFICATION_SOURCE_RECT;
@@ -1865,6 +2001,7 @@ ivi_layout_commit_changes(void)
 
 	commit_changes(layout);
 	send_prop(layout);
+	settle_dirty_lists(layout);
 
     LOG_EXIT();
 	return IVI_SUCCEEDED;
@@ -1880,6 +2017,7 @@ ivi_layout_layer_set_transition(struct ivi_layout_layer *ivilayer,
 		return -1;
 	}
 
+	layer_mark_dirty(ivilayer);
 	ivilayer->pending.prop.transition_type = type;
 	ivilayer->pending.prop.transition_duration = duration;
 
@@ -1896,6 +2034,7 @@ ivi_layout_layer_set_fade_info(struct ivi_layout_layer* ivilayer,
 		return -1;
 	}
 
+	layer_mark_dirty(ivilayer);
 	ivilayer->pending.prop.is_fade_in = is_fade_in;
 	ivilayer->pending.prop.start_alpha = start_alpha;
 	ivilayer->pending.prop.end_alpha = end_alpha;
@@ -1914,6 +2053,7 @@ ivi_layout_surface_set_transition_duration(struct ivi_layout_surface *ivisurf,
 		return -1;
 	}
 
+	surface_mark_dirty(ivisurf);
 	prop = &ivisurf->pending.prop;
 	prop->transition_duration = duration*10;
 	return 0;
@@ -1942,13 +2082,14 @@ ivi_layout_surface_set_id(struct ivi_layout_surface *ivisurf,
 		return IVI_FAILED;
 	}
 
-	search_ivisurf = get_surface(&layout->surface_list, id_surface);
+	search_ivisurf = get_surface(layout, id_surface);
 	if (search_ivisurf) {
 		weston_log("id_surface(%d) is already created\n", id_surface);
 		return IVI_FAILED;
 	}
 
 	ivisurf->id_surface = id_surface;
+	surface_hash_id(layout, ivisurf);
 
 	wl_signal_emit(&layout->surface_notification.created, ivisurf);
 	wl_signal_emit(&layout->surface_notification.configure_changed,
@@ -1969,6 +2110,7 @@ ivi_layout_surface_set_transition(struct ivi_layout_surface *ivisurf,
 		return -1;
 	}
 
+	surface_mark_dirty(ivisurf);
 	prop = &ivisurf->pending.prop;
 	prop->transition_type = type;
 	prop->transition_duration = duration;
@@ -2031,6 +2173,9 @@ surface_create(struct weston_surface *wl_surface, uint32_t id_surface)
 	wl_list_init(&ivisurf->view_list);
 
 	wl_list_insert(&layout->surface_list, &ivisurf->link);
+	wl_list_init(&ivisurf->id_link);
+	surface_hash_id(layout, ivisurf);
+	wl_list_init(&ivisurf->dirty_link);
 
 	return ivisurf;
 }
@@ -2063,6 +2208,23 @@ ivi_layout_surface_configure(struct ivi_layout_surface *ivisurf,
 		       ivisurf);
 }
 
+void
+ivi_layout_surface_committed(struct ivi_layout_surface *ivisurf)
+{
+	struct ivi_layout_view *ivi_view;
+
+	/* Attaching a NULL buffer unmaps every view of the surface behind
+	 * our back. The next commit_changes has to put them back into the
+	 * scenegraph even if no render order changed. */
+	wl_list_for_each(ivi_view, &ivisurf->view_list, surf_link) {
+		if (ivi_view_is_mapped(ivi_view) &&
+		    !weston_view_is_mapped(ivi_view->view)) {
+			ivisurf->layout->view_list_dirty = true;
+			return;
+		}
+	}
+}
+
 struct ivi_layout_surface*
 ivi_layout_surface_create(struct weston_surface *wl_surface,
 			  uint32_t id_surface)
@@ -2070,7 +2232,7 @@ ivi_layout_surface_create(struct weston_surface *wl_surface,
 	struct ivi_layout *layout = get_instance();
 	struct ivi_layout_surface *ivisurf = NULL;
 
-	ivisurf = get_surface(&layout->surface_list, id_surface);
+	ivisurf = get_surface(layout, id_surface);
 	if (ivisurf) {
 		weston_log("id_surface(%d) is already created\n", id_surface);
 		return NULL;
@@ -2152,6 +2314,7 @@ ivi_layout_init_with_compositor(struct weston_compositor *ec)
 {
     LOG_PASS();
 	struct ivi_layout *layout = get_instance();
+	int i;
 
 	layout->compositor = ec;
 
@@ -2160,6 +2323,15 @@ ivi_layout_init_with_compositor(struct weston_compositor *ec)
 	wl_list_init(&layout->screen_list);
 	wl_list_init(&layout->view_list);
 
+	for (i = 0; i < IVI_LAYOUT_ID_TABLE_SIZE; i++) {
+		wl_list_init(&layout->surface_id_table[i]);
+		wl_list_init(&layout->layer_id_table[i]);
+	}
+
+	wl_list_init(&layout->dirty_surface_list);
+	wl_list_init(&layout->dirty_layer_list);
+	layout->view_list_dirty = true;
+
 	wl_signal_init(&layout->layer_notification.created);
 	wl_signal_init(&layout->layer_notification.removed);
 
@@ -2436,6 +2608,7 @@ ivi_layout_surface_change_top(struct ivi_layout_surface *ivisurf)
 		wl_list_remove(&layout_view->pending_link);
 		wl_list_insert(&layout_layer->pending.view_list, &layout_view->pending_link);
 		layout_layer->order.dirty = 1;
+		layer_mark_dirty(layout_layer);
 	}
 
 	return IVI_SUCCEEDED;
@@ -125,6 +125,8 @@ ivi_shell_surface_committed(struct weston_surface *surface,
 	if (!ivisurf)
 		return;
 
+	ivi_layout_surface_committed(ivisurf->layout_surface);
+
 	if (surface->width == 0 || surface->height == 0)
 		return;
 
@@ -531,6 +533,8 @@ desktop_surface_committed(struct weston_desktop_surface *surface,
 	if(!ivisurf)
 		return;
 
+	ivi_layout_surface_committed(ivisurf->layout_surface);
+
 	if (weston_surf->width == 0 || weston_surf->height == 0)
 		return;
 
@@ -33,6 +33,8 @@ struct weston_compositor *
 weston_desktop_get_compositor(struct weston_desktop *desktop);
 struct wl_display *
 weston_desktop_get_display(struct weston_desktop *desktop);
+bool
+weston_desktop_get_resize_pacing(struct weston_desktop *desktop);
 
 void
 weston_desktop_api_ping_timeout(struct weston_desktop *desktop,
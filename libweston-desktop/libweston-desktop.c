@@ -43,6 +43,7 @@ struct weston_desktop {
 	struct wl_global *xdg_wm_base;	 /* Stable protocol xdg_shell replaces xdg_shell_unstable_v6 */
 	struct wl_global *xdg_shell_v6;  /* Unstable xdg_shell_unstable_v6 protocol. */
 	struct wl_global *wl_shell;
+	bool resize_pacing;
 };
 
 void
@@ -113,6 +114,19 @@ weston_desktop_destroy(struct weston_desktop *desktop)
 	free(desktop);
 }
 
+/** Limit interactive resizes to one configure in flight per surface
+ *
+ * While a toplevel is in the resizing state, sizes set with
+ * weston_desktop_surface_set_size() are coalesced until the client has
+ * acked and committed the configure it was last sent, or until the next
+ * output frame if the client commits without acking it.
+ */
+WL_EXPORT void
+weston_desktop_set_resize_pacing(struct weston_desktop *desktop, bool enabled)
+{
+	desktop->resize_pacing = enabled;
+}
+
 
 struct weston_compositor *
 weston_desktop_get_compositor(struct weston_desktop *desktop)
@@ -126,6 +140,12 @@ weston_desktop_get_display(struct weston_desktop *desktop)
 	return desktop->compositor->wl_display;
 }
 
+bool
+weston_desktop_get_resize_pacing(struct weston_desktop *desktop)
+{
+	return desktop->resize_pacing;
+}
+
 void
 weston_desktop_api_ping_timeout(struct weston_desktop *desktop,
 				struct weston_desktop_client *client)
@@ -75,6 +75,14 @@ struct weston_desktop_xdg_surface {
 	struct weston_geometry next_geometry;
 
 	enum weston_desktop_xdg_surface_role role;
+
+	/* Interactive resize pacing, see weston_desktop_set_resize_pacing() */
+	struct {
+		uint32_t serial; /* configure in flight, 0 if none */
+		bool acked;
+		bool deferred;
+		struct wl_event_source *frame_timer;
+	} pacing;
 };
 
 struct weston_desktop_xdg_surface_configure {
@@ -894,6 +902,85 @@ static const struct zxdg_popup_v6_interface weston_desktop_xdg_popup_implementat
 	.grab                = weston_desktop_xdg_popup_protocol_grab,
 };
 
+static bool
+weston_desktop_xdg_surface_pacing_active(struct weston_desktop_xdg_surface *surface)
+{
+	struct weston_desktop_xdg_toplevel *toplevel;
+
+	if (surface->role != WESTON_DESKTOP_XDG_SURFACE_ROLE_TOPLEVEL)
+		return false;
+	if (!weston_desktop_get_resize_pacing(surface->desktop))
+		return false;
+
+	toplevel = (struct weston_desktop_xdg_toplevel *) surface;
+	return toplevel->pending.state.resizing;
+}
+
+static void
+weston_desktop_xdg_surface_pacing_release(struct weston_desktop_xdg_surface *surface)
+{
+	surface->pacing.serial = 0;
+	surface->pacing.acked = false;
+
+	if (surface->pacing.frame_timer != NULL) {
+		wl_event_source_remove(surface->pacing.frame_timer);
+		surface->pacing.frame_timer = NULL;
+	}
+
+	if (surface->pacing.deferred) {
+		surface->pacing.deferred = false;
+		weston_desktop_xdg_surface_schedule_configure(surface);
+	}
+}
+
+static int
+weston_desktop_xdg_surface_pacing_frame(void *user_data)
+{
+	struct weston_desktop_xdg_surface *surface = user_data;
+
+	weston_desktop_xdg_surface_pacing_release(surface);
+
+	return 0;
+}
+
+static void
+weston_desktop_xdg_surface_pacing_committed(struct weston_desktop_xdg_surface *surface)
+{
+	struct wl_display *display = weston_desktop_get_display(surface->desktop);
+	struct wl_event_loop *loop = wl_display_get_event_loop(display);
+	struct weston_output *output = surface->surface->output;
+	int msecs = 16;
+
+	if (surface->pacing.serial == 0)
+		return;
+
+	if (surface->pacing.acked) {
+		weston_desktop_xdg_surface_pacing_release(surface);
+		return;
+	}
+
+	/* The client is drawing without having acked the configure in
+	 * flight, hold the next one back for one output frame only. */
+	if (surface->pacing.frame_timer != NULL)
+		return;
+
+	if (output != NULL && output->current_mode != NULL &&
+	    output->current_mode->refresh > 0)
+		msecs = 1000000 / output->current_mode->refresh;
+	if (msecs < 1)
+		msecs = 1;
+
+	surface->pacing.frame_timer =
+		wl_event_loop_add_timer(loop,
+					weston_desktop_xdg_surface_pacing_frame,
+					surface);
+	if (surface->pacing.frame_timer == NULL) {
+		weston_desktop_xdg_surface_pacing_release(surface);
+		return;
+	}
+	wl_event_source_timer_update(surface->pacing.frame_timer, msecs);
+}
+
 static void
 weston_desktop_xdg_surface_send_configure(void *user_data)
 {
@@ -928,6 +1015,14 @@ weston_desktop_xdg_surface_send_configure(void *user_data)
 		break;
 	}
 
+	if (weston_desktop_xdg_surface_pacing_active(surface)) {
+		surface->pacing.serial = configure->serial;
+		surface->pacing.acked = false;
+	} else {
+		surface->pacing.deferred = false;
+		weston_desktop_xdg_surface_pacing_release(surface);
+	}
+
 	zxdg_surface_v6_send_configure(surface->resource, configure->serial);
 }
 
@@ -1001,8 +1096,18 @@ weston_desktop_xdg_surface_schedule_configure(struct weston_desktop_xdg_surface
 		wl_event_source_remove(surface->configure_idle);
 		surface->configure_idle = NULL;
 	} else {
-		if (pending_same)
+		if (pending_same) {
+			surface->pacing.deferred = false;
 			return;
+		}
+
+		/* Coalesce into the pending state until the configure in
+		 * flight is released */
+		if (surface->pacing.serial != 0 &&
+		    weston_desktop_xdg_surface_pacing_active(surface)) {
+			surface->pacing.deferred = true;
+			return;
+		}
 
 		surface->configure_idle =
 			wl_event_loop_add_idle(loop,
@@ -1174,6 +1279,9 @@ weston_desktop_xdg_surface_protocol_ack_configure(struct wl_client *wl_client,
 
 	surface->configured = true;
 
+	if (surface->pacing.serial != 0 && serial >= surface->pacing.serial)
+		surface->pacing.acked = true;
+
 	switch (surface->role) {
 	case WESTON_DESKTOP_XDG_SURFACE_ROLE_NONE:
 		assert(0 && "not reached");
@@ -1235,6 +1343,8 @@ weston_desktop_xdg_surface_committed(struct weston_desktop_surface *dsurface,
 		weston_desktop_xdg_popup_committed((struct weston_desktop_xdg_popup *) surface);
 		break;
 	}
+
+	weston_desktop_xdg_surface_pacing_committed(surface);
 }
 
 static void
@@ -1276,6 +1386,8 @@ weston_desktop_xdg_surface_destroy(struct weston_desktop_surface *dsurface,
 
 	if (surface->configure_idle != NULL)
 		wl_event_source_remove(surface->configure_idle);
+	if (surface->pacing.frame_timer != NULL)
+		wl_event_source_remove(surface->pacing.frame_timer);
 
 	wl_list_for_each_safe(configure, temp, &surface->configure_list, link)
 		free(configure);
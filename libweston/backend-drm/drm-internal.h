@@ -116,6 +116,11 @@
 
 #define MAX_CLONED_CONNECTORS 4
 
+/* Number of remembered atomic test-commit results, and the largest state
+ * signature (in 32-bit words) we are prepared to remember. */
+#define DRM_TEST_CACHE_SIZE 64
+#define DRM_TEST_CACHE_MAX_WORDS 192
+
 #ifndef DRM_MODE_PICTURE_ASPECT_64_27
 #define DRM_MODE_PICTURE_ASPECT_64_27		3
 #define  DRM_MODE_FLAG_PIC_AR_64_27 \
@@ -244,6 +249,31 @@ enum wdrm_crtc_property {
 	WDRM_CRTC__COUNT
 };
 
+/**
+ * A remembered TEST_ONLY result. The key is the full signature of the
+ * tested state, so that a hash collision can never hand out a bogus pass.
+ */
+struct drm_test_cache_entry {
+	uint64_t hash;
+	uint32_t len;
+	int result;
+	uint32_t key[DRM_TEST_CACHE_MAX_WORDS];
+};
+
+struct drm_test_cache {
+	struct drm_test_cache_entry entries[DRM_TEST_CACHE_SIZE];
+	unsigned int next;
+	unsigned int count;
+
+	struct {
+		uint64_t tests;
+		uint64_t hits;
+		uint64_t ioctls;
+		uint64_t failures;
+	} total, period;
+	struct timespec period_start;
+};
+
 struct drm_backend {
 	struct weston_backend base;
 	struct weston_compositor *compositor;
@@ -304,6 +334,8 @@ struct drm_backend {
 
 	struct weston_log_scope *debug;
 
+	struct drm_test_cache test_cache;
+
 	bool use_tde; // OHOS fix
 	pthread_t vsync_thread; // OHOS vsync module
 	bool vsync_thread_running; // OHOS vsync module
@@ -527,8 +559,8 @@ struct drm_output {
 
 	struct drm_fb *dumb[2];
 	pixman_image_t *image[2];
+	int image_age[2];	/**< frames since last rendered, 0 if never */
 	int current_image;
-	pixman_region32_t previous_damage;
 
 	struct vaapi_recorder *recorder;
 	struct wl_listener recorder_frame_listener;
@@ -661,6 +693,12 @@ init_kms_caps(struct drm_backend *b);
 
 int
 drm_pending_state_test(struct drm_pending_state *pending_state);
+void
+drm_test_cache_invalidate(struct drm_backend *b);
+void
+drm_test_cache_report(struct drm_backend *b);
+int
+drm_test_cache_init_api(struct weston_compositor *compositor);
 int
 drm_pending_state_apply(struct drm_pending_state *pending_state);
 int
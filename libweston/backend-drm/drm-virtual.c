@@ -166,6 +166,9 @@ drm_virtual_output_repaint(struct weston_output *output_base,
 	if (!scanout_state || !scanout_state->fb)
 		goto err;
 
+	/* Let the submit_frame_cb owner know what changed in this frame. */
+	wl_signal_emit(&output_base->frame_signal, damage);
+
 	if (drm_virtual_output_submit_frame(output, scanout_state->fb) < 0)
 		goto err;
 
@@ -340,17 +340,22 @@ drm_output_render_pixman(struct drm_output_state *state,
 {
 	struct drm_output *output = state->output;
 	struct weston_compositor *ec = output->base.compositor;
+	unsigned int i;
 
 	output->current_image ^= 1;
 
 	pixman_renderer_output_set_buffer(&output->base,
 					  output->image[output->current_image]);
-	pixman_renderer_output_set_hw_extra_damage(&output->base,
-						   &output->previous_damage);
+	pixman_renderer_output_set_buffer_age(&output->base,
+					      output->image_age[output->current_image]);
 
 	ec->renderer->repaint_output(&output->base, damage);
 
-	pixman_region32_copy(&output->previous_damage, damage);
+	for (i = 0; i < ARRAY_LENGTH(output->image_age); i++) {
+		if (output->image_age[i] > 0)
+			output->image_age[i]++;
+	}
+	output->image_age[output->current_image] = 1;
 
 	return drm_fb_ref(output->dumb[output->current_image]);
 }
@@ -1268,6 +1273,8 @@ drm_output_init_pixman(struct drm_output *output, struct drm_backend *b)
 						 output->dumb[i]->strides[0]);
 		if (!output->image[i])
 			goto err;
+
+		output->image_age[i] = 0;
 	}
 
 	if (pixman_renderer_output_create(&output->base, &options) < 0)
@@ -1276,9 +1283,6 @@ drm_output_init_pixman(struct drm_output *output, struct drm_backend *b)
 	weston_log("DRM: output %s %s shadow framebuffer.\n", output->base.name,
 		   b->use_pixman_shadow ? "uses" : "does not use");
 
-	pixman_region32_init_rect(&output->previous_damage,
-				  output->base.x, output->base.y, output->base.width, output->base.height);
-
 	return 0;
 
 err:
@@ -1310,7 +1314,6 @@ drm_output_fini_pixman(struct drm_output *output)
 	}
 
 	pixman_renderer_output_destroy(&output->base);
-	pixman_region32_fini(&output->previous_damage);
 
 	for (i = 0; i < ARRAY_LENGTH(output->dumb); i++) {
 		pixman_image_unref(output->image[i]);
@@ -2451,6 +2454,8 @@ drm_destroy(struct weston_compositor *ec)
 
 	b->shutting_down = true;
 
+	drm_test_cache_report(b);
+
 	destroy_sprites(b);
 
 // OHOS remove logger
@@ -3105,6 +3110,12 @@ drm_backend_create(struct weston_compositor *compositor,
 		goto err_udev_monitor;
 	}
 
+	ret = drm_test_cache_init_api(compositor);
+	if (ret < 0) {
+		weston_log("Failed to register test commit API.\n");
+		goto err_udev_monitor;
+	}
+
 	return b;
 
 err_udev_monitor:
@@ -29,6 +29,7 @@
 
 #include "config.h"
 
+#include <inttypes.h>
 #include <stdint.h>
 
 #include <xf86drm.h>
@@ -38,6 +39,7 @@
 #include <libweston/libweston.h>
 #include <libweston/backend-drm.h>
 #include "shared/helpers.h"
+#include "shared/timespec-util.h"
 #include "drm-internal.h"
 #include "pixel-formats.h"
 #include "presentation-time-server-protocol.h"
@@ -1206,6 +1208,8 @@ drm_pending_state_apply_atomic(struct drm_pending_state *pending_state,
 	if (ret != 0) {
 		weston_log("atomic: couldn't commit new state: %s\n",
 			   strerror(errno));
+		/* a remembered pass may no longer hold */
+		drm_test_cache_invalidate(b);
 		goto out;
 	}
 
@@ -1223,6 +1227,279 @@ out:
 	return ret;
 }
 
+/**
+ * Builds the signature of everything a TEST_ONLY commit of this pending
+ * state depends on: the commit flags, the CRTC and, for each plane, the
+ * framebuffer layout and the source/destination geometry. Framebuffer IDs
+ * can be recycled by the kernel, so the properties the kernel checks are
+ * recorded alongside them.
+ *
+ * Returns false if the state does not fit in a cache entry.
+ */
+static bool
+drm_test_cache_signature(struct drm_pending_state *pending_state,
+			 struct drm_test_cache_entry *entry)
+{
+	struct drm_output_state *output_state;
+	struct drm_plane_state *ps;
+	uint32_t *key = entry->key;
+	uint32_t len = 0;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	uint32_t flags = DRM_MODE_ATOMIC_TEST_ONLY;
+	unsigned int i;
+
+#define PUSH(v) do {							\
+		if (len == DRM_TEST_CACHE_MAX_WORDS)			\
+			return false;					\
+		key[len++] = (uint32_t) (v);				\
+	} while (0)
+
+	/* Same rule as drm_output_apply_state_atomic(); an invalid state,
+	 * which adds ALLOW_MODESET as well, is never cached. */
+	wl_list_for_each(output_state, &pending_state->output_list, link) {
+		if (output_state->output->virtual)
+			continue;
+
+		if (output_state->dpms != output_state->output->state_cur->dpms)
+			flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
+	}
+	PUSH(flags);
+
+	wl_list_for_each(output_state, &pending_state->output_list, link) {
+		if (output_state->output->virtual)
+			continue;
+
+		PUSH(output_state->output->crtc_id);
+		PUSH(output_state->dpms);
+		PUSH(output_state->output->state_cur->dpms);
+		PUSH(output_state->protection);
+
+		wl_list_for_each(ps, &output_state->plane_list, link) {
+			struct drm_fb *fb = ps->fb;
+
+			PUSH(ps->plane->plane_id);
+			if (fb) {
+				PUSH(fb->fb_id);
+				PUSH(fb->format->format);
+				PUSH(fb->modifier >> 32);
+				PUSH(fb->modifier);
+				PUSH(fb->width);
+				PUSH(fb->height);
+				PUSH(fb->strides[0]);
+			} else {
+				PUSH(0);
+			}
+			PUSH(ps->output ? ps->output->crtc_id : 0);
+			PUSH(ps->src_x);
+			PUSH(ps->src_y);
+			PUSH(ps->src_w);
+			PUSH(ps->src_h);
+			PUSH(ps->dest_x);
+			PUSH(ps->dest_y);
+			PUSH(ps->dest_w);
+			PUSH(ps->dest_h);
+			PUSH(ps->zpos >> 32);
+			PUSH(ps->zpos);
+			PUSH(ps->in_fence_fd >= 0);
+		}
+
+		/* terminate the output so plane lists can't run together */
+		PUSH(0xffffffff);
+	}
+
+#undef PUSH
+
+	/* FNV-1a, only used to skip entries quickly */
+	for (i = 0; i < len; i++) {
+		hash ^= key[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	entry->len = len;
+	entry->hash = hash;
+
+	return true;
+}
+
+static struct drm_test_cache_entry *
+drm_test_cache_lookup(struct drm_test_cache *cache,
+		      const struct drm_test_cache_entry *probe)
+{
+	struct drm_test_cache_entry *entry;
+	unsigned int i;
+
+	for (i = 0; i < cache->count; i++) {
+		entry = &cache->entries[i];
+
+		if (entry->hash != probe->hash || entry->len != probe->len)
+			continue;
+
+		if (memcmp(entry->key, probe->key,
+			   probe->len * sizeof(probe->key[0])) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+static void
+drm_test_cache_insert(struct drm_test_cache *cache,
+		      const struct drm_test_cache_entry *probe, int result)
+{
+	struct drm_test_cache_entry *entry = &cache->entries[cache->next];
+
+	entry->hash = probe->hash;
+	entry->len = probe->len;
+	entry->result = result;
+	memcpy(entry->key, probe->key, probe->len * sizeof(probe->key[0]));
+
+	cache->next = (cache->next + 1) % DRM_TEST_CACHE_SIZE;
+	if (cache->count < DRM_TEST_CACHE_SIZE)
+		cache->count++;
+}
+
+/**
+ * Forget every remembered test result; called whenever the kernel state the
+ * results were obtained against may have changed underneath us.
+ */
+void
+drm_test_cache_invalidate(struct drm_backend *b)
+{
+	b->test_cache.count = 0;
+	b->test_cache.next = 0;
+}
+
+/**
+ * Logs the test-commit counters accumulated since the backend started.
+ */
+void
+drm_test_cache_report(struct drm_backend *b)
+{
+	struct drm_test_cache *cache = &b->test_cache;
+
+	if (cache->total.tests == 0)
+		return;
+
+	weston_log("DRM: %" PRIu64 " atomic test commits, %" PRIu64
+		   " answered from cache (%" PRIu64 "%%), %" PRIu64
+		   " test ioctls, %" PRIu64 " rejected\n",
+		   cache->total.tests, cache->total.hits,
+		   cache->total.hits * 100 / cache->total.tests,
+		   cache->total.ioctls, cache->total.failures);
+}
+
+static void
+drm_test_cache_get_stats(struct weston_compositor *compositor,
+			 struct weston_drm_test_commit_stats *stats)
+{
+	struct drm_test_cache *cache = &to_drm_backend(compositor)->test_cache;
+
+	stats->tests = cache->total.tests;
+	stats->hits = cache->total.hits;
+	stats->ioctls = cache->total.ioctls;
+	stats->failures = cache->total.failures;
+}
+
+static const struct weston_drm_test_commit_api test_commit_api = {
+	drm_test_cache_get_stats,
+};
+
+int
+drm_test_cache_init_api(struct weston_compositor *compositor)
+{
+	return weston_plugin_api_register(compositor,
+					  WESTON_DRM_TEST_COMMIT_API_NAME,
+					  &test_commit_api,
+					  sizeof(test_commit_api));
+}
+
+static void
+drm_test_cache_account(struct drm_backend *b, bool hit, int result)
+{
+	struct drm_test_cache *cache = &b->test_cache;
+	struct timespec now;
+	int64_t elapsed_ms;
+
+	cache->total.tests++;
+	cache->period.tests++;
+	if (hit) {
+		cache->total.hits++;
+		cache->period.hits++;
+	} else {
+		cache->total.ioctls++;
+		cache->period.ioctls++;
+	}
+	if (result != 0) {
+		cache->total.failures++;
+		cache->period.failures++;
+	}
+
+	weston_compositor_read_presentation_clock(b->compositor, &now);
+	if (timespec_is_zero(&cache->period_start)) {
+		cache->period_start = now;
+		return;
+	}
+
+	elapsed_ms = timespec_sub_to_msec(&now, &cache->period_start);
+	if (elapsed_ms < 1000)
+		return;
+
+	drm_debug(b, "[atomic] test commits: %" PRIu64 " in %" PRId64 " ms, "
+		     "%" PRIu64 " cached, %" PRIu64 " ioctls (%" PRIu64 "/s), "
+		     "%" PRIu64 " rejected\n",
+		  cache->period.tests, elapsed_ms, cache->period.hits,
+		  cache->period.ioctls,
+		  cache->period.ioctls * 1000 / elapsed_ms,
+		  cache->period.failures);
+
+	memset(&cache->period, 0, sizeof(cache->period));
+	cache->period_start = now;
+}
+
+/**
+ * Answers a TEST_ONLY commit from the result cache when the same state has
+ * been tested before, which is the common case for a steady scene, e.g. a
+ * video on an overlay under a static UI: plane assignment then goes through
+ * the same sequence of tests every frame.
+ *
+ * While the state is invalid the test would also carry a modeset, so the
+ * cache is dropped and bypassed until a real commit has gone through.
+ */
+static int
+drm_test_cache_test(struct drm_pending_state *pending_state)
+{
+	struct drm_backend *b = pending_state->backend;
+	struct drm_test_cache *cache = &b->test_cache;
+	struct drm_test_cache_entry probe, *entry;
+	bool cacheable;
+	int ret;
+
+	cacheable = !b->state_invalid &&
+		    drm_test_cache_signature(pending_state, &probe);
+	if (b->state_invalid)
+		drm_test_cache_invalidate(b);
+
+	if (cacheable) {
+		entry = drm_test_cache_lookup(cache, &probe);
+		if (entry) {
+			drm_debug(b, "[atomic] test commit answered from "
+				     "cache: %s\n",
+				  entry->result == 0 ? "pass" : "fail");
+			drm_test_cache_account(b, true, entry->result);
+			return entry->result;
+		}
+	}
+
+	ret = drm_pending_state_apply_atomic(pending_state,
+					     DRM_STATE_TEST_ONLY);
+	drm_test_cache_account(b, false, ret);
+
+	if (cacheable)
+		drm_test_cache_insert(cache, &probe, ret);
+
+	return ret;
+}
+
 /**
  * Tests a pending state, to see if the kernel will accept the update as
  * constructed.
@@ -1247,8 +1524,7 @@ drm_pending_state_test(struct drm_pending_state *pending_state)
 	struct drm_backend *b = pending_state->backend;
 
 	if (b->atomic_modeset)
-		return drm_pending_state_apply_atomic(pending_state,
-						      DRM_STATE_TEST_ONLY);
+		return drm_test_cache_test(pending_state);
 
 	/* We have no way to test state before application on the legacy
 	 * modesetting API, so just claim it succeeded. */
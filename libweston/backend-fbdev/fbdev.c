@@ -34,7 +34,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -44,6 +46,10 @@
 
 #include <libudev.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "shared/helpers.h"
 #include <libweston/libweston.h>
 #include <libweston/backend-fbdev.h>
@@ -76,8 +82,16 @@ struct fbdev_screeninfo {
 
 	pixman_format_code_t pixel_format; /* frame buffer pixel format */
 	unsigned int refresh_rate; /* Hertz */
+
+	unsigned int y_resolution_virtual; /* pixels, including panning area */
+	bool fake; /* a regular file standing in for the device */
 };
 
+/* Geometry of the fake frame buffer backed by a regular file. */
+#define FBDEV_FAKE_WIDTH 640
+#define FBDEV_FAKE_HEIGHT 480
+#define FBDEV_FAKE_PAGES 2
+
 struct fbdev_head {
 	struct weston_head base;
 
@@ -96,9 +110,18 @@ struct fbdev_output {
 	/* framebuffer mmap details */
 	size_t buffer_length;
 	void *fb;
-
-	/* pixman details. */
-	pixman_image_t *hw_surface;
+	int fb_fd; /* kept open for panning, -1 otherwise */
+
+	/* With more than one page, frames are copied to the page that is
+	 * not displayed and panned to. That page then lacks the damage of
+	 * the frame before, which is kept in prev_damage. */
+	unsigned int num_pages;
+	unsigned int current_page;
+	pixman_region32_t prev_damage;
+
+	/* pixman details. The renderer draws into cached memory, and only
+	 * the damage is copied to the frame buffer. */
+	pixman_image_t *shadow_surface;
 };
 
 static const char default_seat[] = "seat0";
@@ -142,6 +165,137 @@ fbdev_output_start_repaint_loop(struct weston_output *output)
 	return 0;
 }
 
+/* Copies one row into frame buffer memory, which is usually uncached and
+ * write-combined: non-temporal stores avoid pulling its lines into the
+ * cache only to evict them again. */
+static void
+fbdev_copy_row(uint8_t *dst, const uint8_t *src, size_t len)
+{
+#if defined(__SSE2__) || defined(__aarch64__)
+	while (len > 0 && ((uintptr_t)dst & 15)) {
+		*dst++ = *src++;
+		len--;
+	}
+#endif
+
+#if defined(__SSE2__)
+	for (; len >= 16; len -= 16, dst += 16, src += 16)
+		_mm_stream_si128((__m128i *)dst,
+				 _mm_loadu_si128((const __m128i *)src));
+#elif defined(__aarch64__)
+	for (; len >= 32; len -= 32, dst += 32, src += 32)
+		__asm__ volatile("ldp q0, q1, [%1]\n\t"
+				 "stnp q0, q1, [%0]"
+				 : : "r" (dst), "r" (src)
+				 : "v0", "v1", "memory");
+#endif
+
+	memcpy(dst, src, len);
+}
+
+static void
+fbdev_copy_region(struct fbdev_output *output, unsigned int page,
+		  pixman_region32_t *region)
+{
+	struct fbdev_head *head = fbdev_output_get_head(output);
+	size_t line_length = head->fb_info.line_length;
+	int bpp = PIXMAN_FORMAT_BPP(head->fb_info.pixel_format) / 8;
+	const uint8_t *src_base = (const uint8_t *)
+		pixman_image_get_data(output->shadow_surface);
+	int src_stride = pixman_image_get_stride(output->shadow_surface);
+	uint8_t *dst_base = (uint8_t *)output->fb +
+		(size_t)page * head->fb_info.y_resolution * line_length;
+	pixman_box32_t *rects;
+	int n, i, y;
+
+	rects = pixman_region32_rectangles(region, &n);
+	for (i = 0; i < n; i++) {
+		for (y = rects[i].y1; y < rects[i].y2; y++) {
+			fbdev_copy_row(dst_base + y * line_length +
+				       rects[i].x1 * bpp,
+				       src_base + y * src_stride +
+				       rects[i].x1 * bpp,
+				       (rects[i].x2 - rects[i].x1) * bpp);
+		}
+	}
+
+#ifdef __SSE2__
+	_mm_sfence();
+#endif
+}
+
+static int
+fbdev_output_pan(struct fbdev_output *output, unsigned int page)
+{
+	struct fbdev_head *head = fbdev_output_get_head(output);
+	struct fb_var_screeninfo varinfo;
+
+	if (head->fb_info.fake)
+		return 0;
+
+	if (ioctl(output->fb_fd, FBIOGET_VSCREENINFO, &varinfo) < 0)
+		return -1;
+
+	varinfo.xoffset = 0;
+	varinfo.yoffset = page * head->fb_info.y_resolution;
+	varinfo.activate = FB_ACTIVATE_VBL;
+
+	return ioctl(output->fb_fd, FBIOPAN_DISPLAY, &varinfo);
+}
+
+static void
+fbdev_output_present(struct fbdev_output *output, pixman_region32_t *damage)
+{
+	struct weston_output *base = &output->base;
+	pixman_region32_t region, frame_damage;
+	unsigned int page;
+
+	/* Same as the renderer: global to frame buffer coordinates. */
+	pixman_region32_init(&frame_damage);
+	if (base->zoom.active) {
+		weston_matrix_transform_region(&frame_damage, &base->matrix,
+					       damage);
+	} else {
+		pixman_region32_copy(&frame_damage, damage);
+		pixman_region32_translate(&frame_damage, -base->x, -base->y);
+		weston_transformed_region(base->width, base->height,
+					  base->transform, base->current_scale,
+					  &frame_damage, &frame_damage);
+	}
+	pixman_region32_intersect_rect(&frame_damage, &frame_damage, 0, 0,
+				       output->mode.width, output->mode.height);
+
+	if (output->num_pages == 1) {
+		fbdev_copy_region(output, output->current_page, &frame_damage);
+		pixman_region32_fini(&frame_damage);
+		return;
+	}
+
+	page = (output->current_page + 1) % output->num_pages;
+
+	pixman_region32_init(&region);
+	pixman_region32_union(&region, &frame_damage, &output->prev_damage);
+	fbdev_copy_region(output, page, &region);
+	pixman_region32_fini(&region);
+
+	if (fbdev_output_pan(output, page) < 0) {
+		weston_log("Panning the frame buffer failed: %s; "
+			   "falling back to a single buffer.\n",
+			   strerror(errno));
+		output->num_pages = 1;
+		pixman_region32_init_rect(&region, 0, 0,
+					  output->mode.width,
+					  output->mode.height);
+		fbdev_copy_region(output, output->current_page, &region);
+		pixman_region32_fini(&region);
+	} else {
+		output->current_page = page;
+		pixman_region32_copy(&output->prev_damage, &frame_damage);
+	}
+
+	pixman_region32_fini(&frame_damage);
+}
+
 static int
 fbdev_output_repaint(struct weston_output *base, pixman_region32_t *damage,
 		     void *repaint_data)
@@ -149,10 +303,14 @@ fbdev_output_repaint(struct weston_output *base, pixman_region32_t *damage,
 	struct fbdev_output *output = to_fbdev_output(base);
 	struct weston_compositor *ec = output->base.compositor;
 
-	/* Repaint the damaged region onto the back buffer. */
-	pixman_renderer_output_set_buffer(base, output->hw_surface);
+	/* Repaint the damaged region onto the shadow buffer. */
+	pixman_renderer_output_set_buffer(base, output->shadow_surface);
 	ec->renderer->repaint_output(base, damage);
 
+	/* Only copy it out while we have the frame buffer mapped. */
+	if (output->fb)
+		fbdev_output_present(output, damage);
+
 	/* Update the damage region. */
 	pixman_region32_subtract(&ec->primary_plane.damage,
 	                         &ec->primary_plane.damage, damage);
@@ -289,11 +447,40 @@ calculate_refresh_rate(struct fb_var_screeninfo *vinfo)
 	return 60 * 1000; /* default to 60 Hz */
 }
 
+/* A regular file is used as a frame buffer of a fixed size, so the
+ * backend can be exercised without a device. It is grown as needed. */
+static int
+fbdev_query_fake_screen_info(int fd, off_t size, struct fbdev_screeninfo *info)
+{
+	memset(info, 0, sizeof *info);
+
+	info->x_resolution = FBDEV_FAKE_WIDTH;
+	info->y_resolution = FBDEV_FAKE_HEIGHT;
+	info->y_resolution_virtual = FBDEV_FAKE_HEIGHT * FBDEV_FAKE_PAGES;
+	info->bits_per_pixel = 32;
+	info->line_length = FBDEV_FAKE_WIDTH * 4;
+	info->buffer_length = info->line_length * info->y_resolution_virtual;
+	strcpy(info->id, "fake");
+	info->pixel_format = PIXMAN_x8r8g8b8;
+	info->refresh_rate = 60 * 1000;
+	info->fake = true;
+
+	if (size < (off_t)info->buffer_length &&
+	    ftruncate(fd, info->buffer_length) < 0)
+		return -1;
+
+	return 1;
+}
+
 static int
 fbdev_query_screen_info(int fd, struct fbdev_screeninfo *info)
 {
 	struct fb_var_screeninfo varinfo;
 	struct fb_fix_screeninfo fixinfo;
+	struct stat st;
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+		return fbdev_query_fake_screen_info(fd, st.st_size, info);
 
 	/* Probe the device for screen information. */
 	if (ioctl(fd, FBIOGET_FSCREENINFO, &fixinfo) < 0 ||
@@ -304,6 +491,7 @@ fbdev_query_screen_info(int fd, struct fbdev_screeninfo *info)
 	/* Store the pertinent data. */
 	info->x_resolution = varinfo.xres;
 	info->y_resolution = varinfo.yres;
+	info->y_resolution_virtual = varinfo.yres_virtual;
 	info->width_mm = varinfo.width;
 	info->height_mm = varinfo.height;
 	info->bits_per_pixel = varinfo.bits_per_pixel;
@@ -315,6 +503,7 @@ fbdev_query_screen_info(int fd, struct fbdev_screeninfo *info)
 
 	info->pixel_format = calculate_pixman_format(&varinfo, &fixinfo);
 	info->refresh_rate = calculate_refresh_rate(&varinfo);
+	info->fake = false;
 
 	if (info->pixel_format == 0) {
 		weston_log("Frame buffer uses an unsupported format.\n");
@@ -413,7 +602,7 @@ fbdev_frame_buffer_open(const char *fb_dev,
 
 	/* Attempt to wake up the framebuffer device, needed for secondary
 	 * framebuffer devices */
-	if (fbdev_wakeup_screen(fd, screen_info) < 0) {
+	if (!screen_info->fake && fbdev_wakeup_screen(fd, screen_info) < 0) {
 		weston_log("Failed to activate framebuffer display. "
 		           "Attempting to open output anyway.\n");
 	}
@@ -422,12 +611,13 @@ fbdev_frame_buffer_open(const char *fb_dev,
 	return fd;
 }
 
-/* Closes the FD on success or failure. */
+/* Takes ownership of the FD, which is only kept open for panning. */
 static int
 fbdev_frame_buffer_map(struct fbdev_output *output, int fd)
 {
 	struct fbdev_head *head;
-	int retval = -1;
+	size_t page_length;
+	unsigned int pages;
 
 	head = fbdev_output_get_head(output);
 
@@ -442,58 +632,80 @@ fbdev_frame_buffer_map(struct fbdev_output *output, int fd)
 		weston_log("Failed to mmap frame buffer: %s\n",
 		           strerror(errno));
 		output->fb = NULL;
-		goto out_close;
-	}
-
-	/* Create a pixman image to wrap the memory mapped frame buffer. */
-	output->hw_surface =
-		pixman_image_create_bits(head->fb_info.pixel_format,
-		                         head->fb_info.x_resolution,
-		                         head->fb_info.y_resolution,
-		                         output->fb,
-		                         head->fb_info.line_length);
-	if (output->hw_surface == NULL) {
-		weston_log("Failed to create surface for frame buffer.\n");
-		goto out_unmap;
+		close(fd);
+		return -1;
 	}
 
-	/* Success! */
-	retval = 0;
+	/* Use a second page when the virtual resolution leaves room for it
+	 * and the driver does pan. */
+	page_length = head->fb_info.line_length * head->fb_info.y_resolution;
+	pages = MIN(head->fb_info.y_resolution_virtual /
+		    head->fb_info.y_resolution,
+		    output->buffer_length / page_length);
 
-out_unmap:
-	if (retval != 0 && output->fb != NULL) {
-		munmap(output->fb, output->buffer_length);
-		output->fb = NULL;
-	}
+	output->fb_fd = fd;
+	output->num_pages = 1;
+	output->current_page = 0;
+	if (pages >= 2 && fbdev_output_pan(output, 0) == 0)
+		output->num_pages = 2;
 
-out_close:
-	if (fd >= 0)
+	if (output->num_pages == 1) {
 		close(fd);
+		output->fb_fd = -1;
+	}
+
+	/* Neither page holds anything useful yet. */
+	pixman_region32_fini(&output->prev_damage);
+	pixman_region32_init_rect(&output->prev_damage, 0, 0,
+				  head->fb_info.x_resolution,
+				  head->fb_info.y_resolution);
 
-	return retval;
+	weston_log("fbdev frame buffer mapped, %s buffered\n",
+		   output->num_pages > 1 ? "double" : "single");
+
+	return 0;
 }
 
 static void
 fbdev_frame_buffer_unmap(struct fbdev_output *output)
 {
-	if (!output->fb) {
-		assert(!output->hw_surface);
+	if (!output->fb)
 		return;
-	}
 
 	weston_log("Unmapping fbdev frame buffer.\n");
 
-	if (output->hw_surface)
-		pixman_image_unref(output->hw_surface);
-	output->hw_surface = NULL;
-
 	if (munmap(output->fb, output->buffer_length) < 0)
 		weston_log("Failed to munmap frame buffer: %s\n",
 		           strerror(errno));
 
 	output->fb = NULL;
+
+	if (output->fb_fd >= 0)
+		close(output->fb_fd);
+	output->fb_fd = -1;
 }
 
+static int
+fbdev_output_create_shadow(struct fbdev_output *output)
+{
+	struct fbdev_head *head = fbdev_output_get_head(output);
+	pixman_format_code_t format = head->fb_info.pixel_format;
+	int width = head->fb_info.x_resolution;
+	int height = head->fb_info.y_resolution;
+	int stride;
+
+	/* pixman wants 32-bit aligned rows */
+	stride = ((width * PIXMAN_FORMAT_BPP(format) + 31) / 32) * 4;
+
+	output->shadow_surface = pixman_image_create_bits(format, width, height,
+							  NULL, stride);
+	if (!output->shadow_surface) {
+		weston_log("Failed to create shadow surface.\n");
+		return -1;
+	}
+
+	return 0;
+}
 
 static int
 fbdev_output_attach_head(struct weston_output *output_base,
@@ -529,7 +741,7 @@ fbdev_output_enable(struct weston_output *base)
 	int fb_fd;
 	struct wl_event_loop *loop;
 	const struct pixman_renderer_output_options options = {
-		.use_shadow = true,
+		.use_shadow = false,
 	};
 
 	head = fbdev_output_get_head(output);
@@ -546,11 +758,14 @@ fbdev_output_enable(struct weston_output *base)
 		return -1;
 	}
 
+	if (fbdev_output_create_shadow(output) < 0)
+		goto out_unmap;
+
 	output->base.start_repaint_loop = fbdev_output_start_repaint_loop;
 	output->base.repaint = fbdev_output_repaint;
 
 	if (pixman_renderer_output_create(&output->base, &options) < 0)
-		goto out_hw_surface;
+		goto out_shadow;
 
 	loop = wl_display_get_event_loop(backend->compositor->wl_display);
 	output->finish_frame_timer =
@@ -563,7 +778,10 @@ fbdev_output_enable(struct weston_output *base)
 
 	return 0;
 
-out_hw_surface:
+out_shadow:
+	pixman_image_unref(output->shadow_surface);
+	output->shadow_surface = NULL;
+out_unmap:
 	fbdev_frame_buffer_unmap(output);
 
 	return -1;
@@ -581,6 +799,8 @@ fbdev_output_disable(struct weston_output *base)
 	output->finish_frame_timer = NULL;
 
 	pixman_renderer_output_destroy(&output->base);
+	pixman_image_unref(output->shadow_surface);
+	output->shadow_surface = NULL;
 	fbdev_frame_buffer_unmap(output);
 
 	return 0;
@@ -649,6 +869,8 @@ fbdev_output_create(struct weston_compositor *compositor,
 		return NULL;
 
 	output->backend = to_fbdev_backend(compositor);
+	output->fb_fd = -1;
+	pixman_region32_init(&output->prev_damage);
 
 	weston_output_init(&output->base, compositor, name);
 
@@ -674,6 +896,7 @@ fbdev_output_destroy(struct weston_output *base)
 	/* Remove the output. */
 	weston_output_release(&output->base);
 
+	pixman_region32_fini(&output->prev_damage);
 	free(output);
 }
 
@@ -719,7 +942,8 @@ fbdev_output_reenable(struct fbdev_backend *backend,
 	 * disabled. */
 	if (compare_screen_info(&head->fb_info, &new_screen_info) != 0) {
 		/* Perform a mode-set to restore the old mode. */
-		if (fbdev_set_screen_info(fb_fd, &head->fb_info) < 0) {
+		if (!head->fb_info.fake &&
+		    fbdev_set_screen_info(fb_fd, &head->fb_info) < 0) {
 			weston_log("Failed to restore mode settings. "
 			           "Attempting to re-open output anyway.\n");
 		}
@@ -37,6 +37,7 @@
 #include <libweston/libweston.h>
 #include <libweston/backend-headless.h>
 #include "shared/helpers.h"
+#include "shared/timespec-util.h"
 #include "linux-explicit-synchronization.h"
 #include "pixman-renderer.h"
 #include "renderer-gl/gl-renderer.h"
@@ -58,6 +59,9 @@ struct headless_backend {
 	struct weston_seat fake_seat;
 	enum headless_renderer_type renderer_type;
 
+	/* refresh == 0 when there is no simulated display clock */
+	struct weston_headless_vsync_config vsync;
+
 	struct gl_renderer_interface *glri;
 };
 
@@ -72,6 +76,18 @@ struct headless_output {
 	struct wl_event_source *finish_frame_timer;
 	uint32_t *image_buf;
 	pixman_image_t *image;
+
+	/* simulated display clock, vblank n is at epoch + n * period */
+	struct {
+		struct timespec epoch;
+		int64_t period_nsec;
+		int64_t jitter_nsec;
+		uint32_t rng;
+
+		/* the frame in flight */
+		uint64_t seq;
+		struct timespec presented;
+	} clock;
 };
 
 static const uint32_t headless_formats[] = {
@@ -97,13 +113,114 @@ to_headless_backend(struct weston_compositor *base)
 	return container_of(base->backend, struct headless_backend, base);
 }
 
+/* xorshift32: cheap, and the same seed always gives the same run */
+static uint32_t
+headless_clock_random(struct headless_output *output)
+{
+	uint32_t x = output->clock.rng;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	output->clock.rng = x;
+
+	return x;
+}
+
+/* A uniform sample in [-range, range]. */
+static int64_t
+headless_clock_uniform(struct headless_output *output, int64_t range)
+{
+	return (int64_t)(headless_clock_random(output) % (2 * range + 1)) -
+	       range;
+}
+
+static int64_t
+headless_clock_jitter(struct headless_output *output)
+{
+	struct headless_backend *b = to_headless_backend(output->base.compositor);
+	int64_t jitter = output->clock.jitter_nsec;
+	int64_t sum = 0;
+	int i;
+
+	if (jitter == 0)
+		return 0;
+
+	if (b->vsync.jitter_distribution == WESTON_HEADLESS_JITTER_UNIFORM)
+		return headless_clock_uniform(output, jitter);
+
+	/* Irwin-Hall: the sum of four uniforms is close enough to normal
+	 * and stays within the bounds by construction. */
+	for (i = 0; i < 4; i++)
+		sum += headless_clock_uniform(output, jitter / 4);
+
+	return sum;
+}
+
+static void
+headless_clock_vblank_time(struct headless_output *output, uint64_t seq,
+			   struct timespec *ts)
+{
+	timespec_add_nsec(ts, &output->clock.epoch,
+			  (int64_t)seq * output->clock.period_nsec);
+}
+
+static uint64_t
+headless_clock_last_vblank(struct headless_output *output,
+			   const struct timespec *now)
+{
+	return timespec_sub_to_nsec(now, &output->clock.epoch) /
+	       output->clock.period_nsec;
+}
+
+/* Picks the vblank the frame just repainted lands on. */
+static void
+headless_clock_queue_frame(struct headless_output *output)
+{
+	struct headless_backend *b = to_headless_backend(output->base.compositor);
+	struct timespec now;
+	uint64_t seq;
+	int64_t delay_nsec;
+
+	weston_compositor_read_presentation_clock(b->compositor, &now);
+
+	seq = headless_clock_last_vblank(output, &now) + 1;
+	if (seq <= output->base.msc)
+		seq = output->base.msc + 1;
+	if (b->vsync.miss_percent > 0 &&
+	    (int)(headless_clock_random(output) % 100) < b->vsync.miss_percent)
+		seq++;
+
+	output->clock.seq = seq;
+	headless_clock_vblank_time(output, seq, &output->clock.presented);
+	timespec_add_nsec(&output->clock.presented, &output->clock.presented,
+			  b->vsync.scanout_latency_usec * 1000LL +
+			  headless_clock_jitter(output));
+
+	/* the timer has millisecond resolution, never fire early */
+	delay_nsec = timespec_sub_to_nsec(&output->clock.presented, &now);
+	wl_event_source_timer_update(output->finish_frame_timer,
+				     MAX(1, (delay_nsec + 999999) / 1000000));
+}
+
 static int
-headless_output_start_repaint_loop(struct weston_output *output)
+headless_output_start_repaint_loop(struct weston_output *output_base)
 {
+	struct headless_output *output = to_headless_output(output_base);
+	struct headless_backend *b = to_headless_backend(output_base->compositor);
 	struct timespec ts;
+	uint64_t seq;
+
+	weston_compositor_read_presentation_clock(output_base->compositor, &ts);
+
+	if (b->vsync.refresh > 0) {
+		/* like querying the last vblank of a real display */
+		seq = headless_clock_last_vblank(output, &ts);
+		output_base->msc = MAX(output_base->msc, seq);
+		headless_clock_vblank_time(output, seq, &ts);
+	}
 
-	weston_compositor_read_presentation_clock(output->compositor, &ts);
-	weston_output_finish_frame(output, &ts, WP_PRESENTATION_FEEDBACK_INVALID);
+	weston_output_finish_frame(output_base, &ts, WP_PRESENTATION_FEEDBACK_INVALID);
 
 	return 0;
 }
@@ -112,8 +229,17 @@ static int
 finish_frame_handler(void *data)
 {
 	struct headless_output *output = data;
+	struct headless_backend *b = to_headless_backend(output->base.compositor);
 	struct timespec ts;
 
+	if (b->vsync.refresh > 0) {
+		output->base.msc = output->clock.seq;
+		weston_output_finish_frame(&output->base,
+					   &output->clock.presented,
+					   WP_PRESENTATION_FEEDBACK_KIND_VSYNC);
+		return 1;
+	}
+
 	weston_compositor_read_presentation_clock(output->base.compositor, &ts);
 	weston_output_finish_frame(&output->base, &ts, 0);
 
@@ -127,13 +253,18 @@ headless_output_repaint(struct weston_output *output_base,
 {
 	struct headless_output *output = to_headless_output(output_base);
 	struct weston_compositor *ec = output->base.compositor;
+	struct headless_backend *b = to_headless_backend(ec);
 
 	ec->renderer->repaint_output(&output->base, damage);
+	wl_signal_emit(&output->base.frame_signal, damage);
 
 	pixman_region32_subtract(&ec->primary_plane.damage,
 				 &ec->primary_plane.damage, damage);
 
-	wl_event_source_timer_update(output->finish_frame_timer, 16);
+	if (b->vsync.refresh > 0)
+		headless_clock_queue_frame(output);
+	else
+		wl_event_source_timer_update(output->finish_frame_timer, 16);
 
 	return 0;
 }
@@ -255,6 +386,18 @@ headless_output_enable(struct weston_output *base)
 	output->finish_frame_timer =
 		wl_event_loop_add_timer(loop, finish_frame_handler, output);
 
+	if (b->vsync.refresh > 0) {
+		weston_compositor_read_presentation_clock(b->compositor,
+							  &output->clock.epoch);
+		output->clock.period_nsec = millihz_to_nsec(b->vsync.refresh);
+		/* keep vblanks in order whatever the jitter */
+		output->clock.jitter_nsec =
+			MIN(b->vsync.jitter_usec * 1000LL,
+			    output->clock.period_nsec / 4);
+		output->clock.rng = b->vsync.seed ? b->vsync.seed : 1;
+		output->base.msc = 0;
+	}
+
 	switch (b->renderer_type) {
 	case HEADLESS_GL:
 		ret = headless_output_enable_gl(output);
@@ -279,6 +422,7 @@ headless_output_set_size(struct weston_output *base,
 			 int width, int height)
 {
 	struct headless_output *output = to_headless_output(base);
+	struct headless_backend *b = to_headless_backend(base->compositor);
 	struct weston_head *head;
 	int output_width, output_height;
 
@@ -303,7 +447,7 @@ headless_output_set_size(struct weston_output *base,
 		WL_OUTPUT_MODE_CURRENT | WL_OUTPUT_MODE_PREFERRED;
 	output->mode.width = output_width;
 	output->mode.height = output_height;
-	output->mode.refresh = 60000;
+	output->mode.refresh = b->vsync.refresh > 0 ? b->vsync.refresh : 60000;
 	wl_list_insert(&output->base.mode_list, &output->mode.link);
 
 	output->base.current_mode = &output->mode;
@@ -437,6 +581,21 @@ headless_backend_create(struct weston_compositor *compositor,
 		goto err_free;
 	}
 
+	if (config->vsync.refresh < 0 ||
+	    config->vsync.scanout_latency_usec < 0 ||
+	    config->vsync.jitter_usec < 0 ||
+	    config->vsync.miss_percent < 0 ||
+	    config->vsync.miss_percent > 100) {
+		weston_log("Error: invalid simulated display clock settings.\n");
+		goto err_free;
+	}
+	b->vsync = config->vsync;
+	if (b->vsync.refresh > 0)
+		weston_log("headless: simulated display clock at %d mHz, "
+			   "latency %d us, jitter %d us, %d%% missed vblanks\n",
+			   b->vsync.refresh, b->vsync.scanout_latency_usec,
+			   b->vsync.jitter_usec, b->vsync.miss_percent);
+
 	if (config->use_gl)
 		b->renderer_type = HEADLESS_GL;
 	else if (config->use_pixman)
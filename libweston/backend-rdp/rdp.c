@@ -30,6 +30,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <linux/input.h>
 
 #if HAVE_FREERDP_VERSION_H
@@ -106,6 +110,14 @@
 #define DEFAULT_AXIS_STEP_DISTANCE 10
 #define RDP_MODE_FREQ 60 * 1000
 
+/* frames a peer may have unacknowledged before its updates get coalesced */
+#define RDP_MAX_FRAMES_IN_FLIGHT 2
+/* an unacknowledged frame older than this is considered lost */
+#define RDP_FRAME_ACK_TIMEOUT_MS 1000
+/* longest the repaint loop waits for any peer to catch up */
+#define RDP_MAX_FRAME_WAIT_MS 250
+#define RDP_FRAME_HISTORY 16
+
 #if FREERDP_VERSION_MAJOR >= 2 && defined(PIXEL_FORMAT_BGRA32) && !defined(PIXEL_FORMAT_B8G8R8A8)
 	/* The RDP API is truly wonderful: the pixel format definition changed
 	 * from BGRA32 to B8G8R8A8, but some versions ship with a definition of
@@ -151,10 +163,62 @@ struct rdp_head {
 	struct weston_head base;
 };
 
+enum rdp_codec {
+	RDP_CODEC_RFX = 0,
+	RDP_CODEC_NSC,
+	RDP_CODEC_COUNT,
+	RDP_CODEC_RAW = RDP_CODEC_COUNT,
+};
+
+/* One encoded update, shared by every peer using the same codec. */
+struct rdp_encoded_frame {
+	int refcount;
+	enum rdp_codec codec;
+	pixman_box32_t extents;
+	wStream *stream;
+};
+
+/*
+ * Encodes the output damage once per codec on a worker thread. The
+ * compositor fills 'job' and signals 'cond'; the worker encodes and
+ * writes to 'done_fd[1]', and the main loop then fans the frames out to
+ * the peers. The shadow surface is not repainted while a job is in
+ * flight, since the next frame is only finished once it completes.
+ */
+struct rdp_encoder {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int destroying;
+
+	int done_fd[2];
+	struct wl_event_source *done_source;
+
+	/* set by the compositor, cleared once the result is collected */
+	bool busy;
+
+	/* protected by mutex while busy */
+	struct {
+		bool valid;
+		uint32_t codec_mask;
+		pixman_region32_t damage;
+		pixman_image_t *image;
+		struct rdp_encoded_frame *frames[RDP_CODEC_COUNT];
+	} job;
+
+	/* only touched by whoever owns the job */
+	RFX_CONTEXT *rfx_context;
+	NSC_CONTEXT *nsc_context;
+	RFX_RECT *rfx_rects;
+};
+
 struct rdp_output {
 	struct weston_output base;
 	struct wl_event_source *finish_frame_timer;
 	pixman_image_t *shadow_surface;
+	struct rdp_encoder encoder;
+	bool finish_frame_pending;
+	struct timespec repaint_time;
 
 	struct wl_list peers;
 };
@@ -169,6 +233,28 @@ struct rdp_peer_context {
 	RFX_RECT *rfx_rects;
 	NSC_CONTEXT *nsc_context;
 
+	/*
+	 * Frames are bracketed by surface frame markers. Clients that
+	 * advertise frame acknowledgement report the last frame they
+	 * processed, and a peer with too many frames in flight gets its
+	 * damage accumulated instead of more frames, until it catches up.
+	 */
+	struct {
+		uint32_t frame_id;
+		uint32_t acked_id;
+		struct timespec sent_time[RDP_FRAME_HISTORY];
+		pixman_region32_t damage;
+		bool stall_logged;
+
+		struct timespec start_time;
+		uint64_t frames;
+		uint64_t coalesced;
+		uint64_t bytes;
+		uint64_t ack_count;
+		int64_t ack_total_nsec;
+		int64_t ack_max_nsec;
+	} pacing;
+
 	struct rdp_peers_item item;
 };
 typedef struct rdp_peer_context RdpPeerContext;
@@ -192,48 +278,29 @@ to_rdp_backend(struct weston_compositor *base)
 }
 
 static void
-rdp_peer_refresh_rfx(pixman_region32_t *damage, pixman_image_t *image, freerdp_peer *peer)
+rdp_encode_rfx(RFX_CONTEXT *rfx_context, RFX_RECT **rfx_rects, wStream *stream,
+	       pixman_region32_t *damage, pixman_image_t *image)
 {
 	int width, height, nrects, i;
 	pixman_box32_t *region, *rects;
 	uint32_t *ptr;
 	RFX_RECT *rfxRect;
-	rdpUpdate *update = peer->update;
-	SURFACE_BITS_COMMAND cmd;
-	RdpPeerContext *context = (RdpPeerContext *)peer->context;
 
-	Stream_Clear(context->encode_stream);
-	Stream_SetPosition(context->encode_stream, 0);
+	Stream_Clear(stream);
+	Stream_SetPosition(stream, 0);
 
 	width = (damage->extents.x2 - damage->extents.x1);
 	height = (damage->extents.y2 - damage->extents.y1);
 
-#ifdef HAVE_SKIP_COMPRESSION
-	cmd.skipCompression = TRUE;
-#else
-	memset(&cmd, 0, sizeof(*cmd));
-#endif
-#ifdef HAVE_SURFCMD_CMDTYPE
-	cmd.cmdType = CMDTYPE_STREAM_SURFACE_BITS;
-#endif
-	cmd.destLeft = damage->extents.x1;
-	cmd.destTop = damage->extents.y1;
-	cmd.destRight = damage->extents.x2;
-	cmd.destBottom = damage->extents.y2;
-	SURFACE_BPP(cmd) = 32;
-	SURFACE_CODECID(cmd) = peer->settings->RemoteFxCodecId;
-	SURFACE_WIDTH(cmd) = width;
-	SURFACE_HEIGHT(cmd) = height;
-
 	ptr = pixman_image_get_data(image) + damage->extents.x1 +
 				damage->extents.y1 * (pixman_image_get_stride(image) / sizeof(uint32_t));
 
 	rects = pixman_region32_rectangles(damage, &nrects);
-	context->rfx_rects = realloc(context->rfx_rects, nrects * sizeof *rfxRect);
+	*rfx_rects = realloc(*rfx_rects, nrects * sizeof *rfxRect);
 
 	for (i = 0; i < nrects; i++) {
 		region = &rects[i];
-		rfxRect = &context->rfx_rects[i];
+		rfxRect = &(*rfx_rects)[i];
 
 		rfxRect->x = (region->x1 - damage->extents.x1);
 		rfxRect->y = (region->y1 - damage->extents.y1);
@@ -241,61 +308,87 @@ rdp_peer_refresh_rfx(pixman_region32_t *damage, pixman_image_t *image, freerdp_p
 		rfxRect->height = (region->y2 - region->y1);
 	}
 
-	rfx_compose_message(context->rfx_context, context->encode_stream, context->rfx_rects, nrects,
+	rfx_compose_message(rfx_context, stream, *rfx_rects, nrects,
 			(BYTE *)ptr, width, height,
 			pixman_image_get_stride(image)
 	);
-
-	SURFACE_BITMAP_DATA_LEN(cmd) = Stream_GetPosition(context->encode_stream);
-	SURFACE_BITMAP_DATA(cmd) = Stream_Buffer(context->encode_stream);
-
-	update->SurfaceBits(update->context, &cmd);
 }
 
-
 static void
-rdp_peer_refresh_nsc(pixman_region32_t *damage, pixman_image_t *image, freerdp_peer *peer)
+rdp_encode_nsc(NSC_CONTEXT *nsc_context, wStream *stream,
+	       pixman_region32_t *damage, pixman_image_t *image)
 {
 	int width, height;
 	uint32_t *ptr;
-	rdpUpdate *update = peer->update;
-	SURFACE_BITS_COMMAND cmd;
-	RdpPeerContext *context = (RdpPeerContext *)peer->context;
 
-	Stream_Clear(context->encode_stream);
-	Stream_SetPosition(context->encode_stream, 0);
+	Stream_Clear(stream);
+	Stream_SetPosition(stream, 0);
 
 	width = (damage->extents.x2 - damage->extents.x1);
 	height = (damage->extents.y2 - damage->extents.y1);
 
+	ptr = pixman_image_get_data(image) + damage->extents.x1 +
+				damage->extents.y1 * (pixman_image_get_stride(image) / sizeof(uint32_t));
+
+	nsc_compose_message(nsc_context, stream, (BYTE *)ptr,
+			width, height,
+			pixman_image_get_stride(image));
+}
+
+static void
+rdp_peer_send_surface_bits(freerdp_peer *peer, enum rdp_codec codec,
+			   const pixman_box32_t *extents, wStream *stream)
+{
+	rdpUpdate *update = peer->update;
+	SURFACE_BITS_COMMAND cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
 #ifdef HAVE_SKIP_COMPRESSION
 	cmd.skipCompression = TRUE;
-#else
-	memset(cmd, 0, sizeof(*cmd));
 #endif
 #ifdef HAVE_SURFCMD_CMDTYPE
-	cmd.cmdType = CMDTYPE_SET_SURFACE_BITS;
+	cmd.cmdType = codec == RDP_CODEC_RFX ? CMDTYPE_STREAM_SURFACE_BITS :
+					       CMDTYPE_SET_SURFACE_BITS;
 #endif
-	cmd.destLeft = damage->extents.x1;
-	cmd.destTop = damage->extents.y1;
-	cmd.destRight = damage->extents.x2;
-	cmd.destBottom = damage->extents.y2;
+	cmd.destLeft = extents->x1;
+	cmd.destTop = extents->y1;
+	cmd.destRight = extents->x2;
+	cmd.destBottom = extents->y2;
 	SURFACE_BPP(cmd) = 32;
-	SURFACE_CODECID(cmd) = peer->settings->NSCodecId;
-	SURFACE_WIDTH(cmd) = width;
-	SURFACE_HEIGHT(cmd) = height;
+	SURFACE_CODECID(cmd) = codec == RDP_CODEC_RFX ?
+			       peer->settings->RemoteFxCodecId :
+			       peer->settings->NSCodecId;
+	SURFACE_WIDTH(cmd) = extents->x2 - extents->x1;
+	SURFACE_HEIGHT(cmd) = extents->y2 - extents->y1;
 
-	ptr = pixman_image_get_data(image) + damage->extents.x1 +
-				damage->extents.y1 * (pixman_image_get_stride(image) / sizeof(uint32_t));
+	SURFACE_BITMAP_DATA_LEN(cmd) = Stream_GetPosition(stream);
+	SURFACE_BITMAP_DATA(cmd) = Stream_Buffer(stream);
 
-	nsc_compose_message(context->nsc_context, context->encode_stream, (BYTE *)ptr,
-			width, height,
-			pixman_image_get_stride(image));
+	update->SurfaceBits(update->context, &cmd);
+	((RdpPeerContext *)peer->context)->pacing.bytes +=
+		SURFACE_BITMAP_DATA_LEN(cmd);
+}
 
-	SURFACE_BITMAP_DATA_LEN(cmd) = Stream_GetPosition(context->encode_stream);
-	SURFACE_BITMAP_DATA(cmd) = Stream_Buffer(context->encode_stream);
+static void
+rdp_peer_refresh_rfx(pixman_region32_t *damage, pixman_image_t *image, freerdp_peer *peer)
+{
+	RdpPeerContext *context = (RdpPeerContext *)peer->context;
 
-	update->SurfaceBits(update->context, &cmd);
+	rdp_encode_rfx(context->rfx_context, &context->rfx_rects,
+		       context->encode_stream, damage, image);
+	rdp_peer_send_surface_bits(peer, RDP_CODEC_RFX, &damage->extents,
+				   context->encode_stream);
+}
+
+static void
+rdp_peer_refresh_nsc(pixman_region32_t *damage, pixman_image_t *image, freerdp_peer *peer)
+{
+	RdpPeerContext *context = (RdpPeerContext *)peer->context;
+
+	rdp_encode_nsc(context->nsc_context, context->encode_stream,
+		       damage, image);
+	rdp_peer_send_surface_bits(peer, RDP_CODEC_NSC, &damage->extents,
+				   context->encode_stream);
 }
 
 static void
@@ -316,8 +409,8 @@ static void
 rdp_peer_refresh_raw(pixman_region32_t *region, pixman_image_t *image, freerdp_peer *peer)
 {
 	rdpUpdate *update = peer->update;
+	RdpPeerContext *context = (RdpPeerContext *)peer->context;
 	SURFACE_BITS_COMMAND cmd;
-	SURFACE_FRAME_MARKER marker;
 	pixman_box32_t *rect, subrect;
 	int nrects, i;
 	int heightIncrement, remainingHeight, top;
@@ -326,10 +419,6 @@ rdp_peer_refresh_raw(pixman_region32_t *region, pixman_image_t *image, freerdp_p
 	if (!nrects)
 		return;
 
-	marker.frameId++;
-	marker.frameAction = SURFACECMD_FRAMEACTION_BEGIN;
-	update->SurfaceFrameMarker(peer->context, &marker);
-
 	memset(&cmd, 0, sizeof(cmd));
 #ifdef HAVE_SURFCMD_CMDTYPE
 	cmd.cmdType = CMDTYPE_SET_SURFACE_BITS;
@@ -363,6 +452,7 @@ rdp_peer_refresh_raw(pixman_region32_t *region, pixman_image_t *image, freerdp_p
 
 			   /*weston_log("*  sending (%d,%d, %d,%d)\n", subrect.x1, subrect.y1, subrect.x2, subrect.y2); */
 			   update->SurfaceBits(peer->context, &cmd);
+			   context->pacing.bytes += SURFACE_BITMAP_DATA_LEN(cmd);
 
 			   remainingHeight -= SURFACE_HEIGHT(cmd);
 			   top += SURFACE_HEIGHT(cmd);
@@ -370,24 +460,534 @@ rdp_peer_refresh_raw(pixman_region32_t *region, pixman_image_t *image, freerdp_p
 	}
 
 	free(SURFACE_BITMAP_DATA(cmd));
+}
+
+static enum rdp_codec
+rdp_peer_codec(freerdp_peer *peer)
+{
+	rdpSettings *settings = peer->settings;
 
+	if (settings->RemoteFxCodec)
+		return RDP_CODEC_RFX;
+	else if (settings->NSCodec)
+		return RDP_CODEC_NSC;
+	else
+		return RDP_CODEC_RAW;
+}
+
+static void
+rdp_peer_frame_begin(freerdp_peer *peer)
+{
+	RdpPeerContext *context = (RdpPeerContext *)peer->context;
+	struct weston_compositor *ec = context->rdpBackend->compositor;
+	SURFACE_FRAME_MARKER marker;
+	uint32_t id = ++context->pacing.frame_id;
+
+	weston_compositor_read_presentation_clock(ec,
+			&context->pacing.sent_time[id % RDP_FRAME_HISTORY]);
+	context->pacing.frames++;
+
+	marker.frameId = id;
+	marker.frameAction = SURFACECMD_FRAMEACTION_BEGIN;
+	peer->update->SurfaceFrameMarker(peer->context, &marker);
+}
+
+static void
+rdp_peer_frame_end(freerdp_peer *peer)
+{
+	RdpPeerContext *context = (RdpPeerContext *)peer->context;
+	SURFACE_FRAME_MARKER marker;
+
+	marker.frameId = context->pacing.frame_id;
 	marker.frameAction = SURFACECMD_FRAMEACTION_END;
-	update->SurfaceFrameMarker(peer->context, &marker);
+	peer->update->SurfaceFrameMarker(peer->context, &marker);
 }
 
+/* Whether the peer has as many frames in flight as it may have. */
+static bool
+rdp_peer_backed_up(freerdp_peer *peer)
+{
+	RdpPeerContext *context = (RdpPeerContext *)peer->context;
+	struct weston_compositor *ec = context->rdpBackend->compositor;
+	rdpSettings *settings = peer->settings;
+	uint32_t limit = settings->FrameAcknowledge;
+	uint32_t in_flight;
+	struct timespec now;
+	const struct timespec *oldest;
+
+	/* without acknowledgements there is nothing to pace on; a client
+	 * that never sent the capability set won't send any */
+	if (limit == 0 ||
+	    !settings->ReceivedCapabilities[CAPSET_TYPE_FRAME_ACKNOWLEDGE])
+		return false;
+
+	limit = MIN(limit, RDP_MAX_FRAMES_IN_FLIGHT);
+	in_flight = context->pacing.frame_id - context->pacing.acked_id;
+	if (in_flight < limit)
+		return false;
+
+	/* don't starve a client that stopped acknowledging altogether */
+	oldest = &context->pacing.sent_time[(context->pacing.acked_id + 1) %
+					    RDP_FRAME_HISTORY];
+	weston_compositor_read_presentation_clock(ec, &now);
+	if (in_flight <= RDP_FRAME_HISTORY &&
+	    timespec_sub_to_msec(&now, oldest) < RDP_FRAME_ACK_TIMEOUT_MS)
+		return true;
+
+	if (!context->pacing.stall_logged) {
+		weston_log("rdp: peer %p stopped acknowledging frames\n", peer);
+		context->pacing.stall_logged = true;
+	}
+	context->pacing.acked_id = context->pacing.frame_id;
+	return false;
+}
+
+/* Encodes for this peer alone, with its own codec contexts. */
 static void
 rdp_peer_refresh_region(pixman_region32_t *region, freerdp_peer *peer)
 {
 	RdpPeerContext *context = (RdpPeerContext *)peer->context;
 	struct rdp_output *output = context->rdpBackend->output;
-	rdpSettings *settings = peer->settings;
 
-	if (settings->RemoteFxCodec)
+	if (!pixman_region32_not_empty(region))
+		return;
+
+	rdp_peer_frame_begin(peer);
+
+	switch (rdp_peer_codec(peer)) {
+	case RDP_CODEC_RFX:
 		rdp_peer_refresh_rfx(region, output->shadow_surface, peer);
-	else if (settings->NSCodec)
+		break;
+	case RDP_CODEC_NSC:
 		rdp_peer_refresh_nsc(region, output->shadow_surface, peer);
-	else
+		break;
+	default:
 		rdp_peer_refresh_raw(region, output->shadow_surface, peer);
+		break;
+	}
+
+	rdp_peer_frame_end(peer);
+}
+
+/* Sends whatever piled up while the peer was backed up. */
+static void
+rdp_peer_flush_coalesced(freerdp_peer *peer)
+{
+	RdpPeerContext *context = (RdpPeerContext *)peer->context;
+
+	if (!pixman_region32_not_empty(&context->pacing.damage))
+		return;
+
+	rdp_peer_refresh_region(&context->pacing.damage, peer);
+	pixman_region32_clear(&context->pacing.damage);
+}
+
+static void
+rdp_peer_coalesce(freerdp_peer *peer, pixman_region32_t *damage)
+{
+	RdpPeerContext *context = (RdpPeerContext *)peer->context;
+
+	pixman_region32_union(&context->pacing.damage,
+			      &context->pacing.damage, damage);
+	context->pacing.coalesced++;
+}
+
+static void
+rdp_peer_pacing_report(freerdp_peer *peer)
+{
+	RdpPeerContext *context = (RdpPeerContext *)peer->context;
+	struct timespec now;
+	int64_t elapsed_ms;
+
+	if (context->pacing.frames == 0)
+		return;
+
+	weston_compositor_read_presentation_clock(context->rdpBackend->compositor,
+						  &now);
+	elapsed_ms = timespec_sub_to_msec(&now, &context->pacing.start_time);
+	if (elapsed_ms <= 0)
+		return;
+
+	weston_log("rdp: peer %p sent %" PRIu64 " frames in %" PRId64 " ms "
+		   "(%.1f fps, %.1f KiB/s), coalesced %" PRIu64 " updates\n",
+		   peer, context->pacing.frames, elapsed_ms,
+		   context->pacing.frames * 1000.0 / elapsed_ms,
+		   context->pacing.bytes * 1000.0 / 1024.0 / elapsed_ms,
+		   context->pacing.coalesced);
+
+	if (context->pacing.ack_count) {
+		weston_log("rdp: peer %p acknowledged %" PRIu64 " frames, "
+			   "latency avg %.1f ms, max %.1f ms\n",
+			   peer, context->pacing.ack_count,
+			   context->pacing.ack_total_nsec / 1e6 /
+			   context->pacing.ack_count,
+			   context->pacing.ack_max_nsec / 1e6);
+	}
+}
+
+static bool
+rdp_peer_wants_frames(struct rdp_peers_item *item)
+{
+	return (item->flags & RDP_PEER_ACTIVATED) &&
+	       (item->flags & RDP_PEER_OUTPUT_ENABLED);
+}
+
+static struct rdp_encoded_frame *
+rdp_encoded_frame_create(enum rdp_codec codec)
+{
+	struct rdp_encoded_frame *frame;
+
+	frame = zalloc(sizeof *frame);
+	if (!frame)
+		return NULL;
+
+	frame->stream = Stream_New(NULL, 65536);
+	if (!frame->stream) {
+		free(frame);
+		return NULL;
+	}
+
+	frame->refcount = 1;
+	frame->codec = codec;
+
+	return frame;
+}
+
+static struct rdp_encoded_frame *
+rdp_encoded_frame_ref(struct rdp_encoded_frame *frame)
+{
+	frame->refcount++;
+	return frame;
+}
+
+static void
+rdp_encoded_frame_unref(struct rdp_encoded_frame *frame)
+{
+	if (--frame->refcount > 0)
+		return;
+
+	Stream_Free(frame->stream, TRUE);
+	free(frame);
+}
+
+static void
+rdp_encoder_run_job(struct rdp_encoder *encoder)
+{
+	pixman_region32_t *damage = &encoder->job.damage;
+	struct rdp_encoded_frame *frame;
+	int codec;
+
+	for (codec = 0; codec < RDP_CODEC_COUNT; codec++) {
+		if (!(encoder->job.codec_mask & (1 << codec)))
+			continue;
+
+		frame = rdp_encoded_frame_create(codec);
+		if (!frame)
+			continue;
+
+		frame->extents = damage->extents;
+		if (codec == RDP_CODEC_RFX)
+			rdp_encode_rfx(encoder->rfx_context,
+				       &encoder->rfx_rects, frame->stream,
+				       damage, encoder->job.image);
+		else
+			rdp_encode_nsc(encoder->nsc_context, frame->stream,
+				       damage, encoder->job.image);
+
+		encoder->job.frames[codec] = frame;
+	}
+}
+
+static void *
+rdp_encoder_thread(void *data)
+{
+	struct rdp_encoder *encoder = data;
+	char byte = 0;
+
+	pthread_mutex_lock(&encoder->mutex);
+
+	while (!encoder->destroying) {
+		if (!encoder->job.valid) {
+			pthread_cond_wait(&encoder->cond, &encoder->mutex);
+			continue;
+		}
+
+		rdp_encoder_run_job(encoder);
+		encoder->job.valid = false;
+		pthread_cond_broadcast(&encoder->cond);
+
+		if (write(encoder->done_fd[1], &byte, 1) < 0)
+			weston_log("rdp: failed to signal encoded frame\n");
+	}
+
+	pthread_mutex_unlock(&encoder->mutex);
+
+	return NULL;
+}
+
+/* Waits for the job in flight and takes its frames. */
+static void
+rdp_encoder_collect(struct rdp_encoder *encoder,
+		    struct rdp_encoded_frame *frames[RDP_CODEC_COUNT])
+{
+	int codec;
+
+	pthread_mutex_lock(&encoder->mutex);
+	while (encoder->job.valid)
+		pthread_cond_wait(&encoder->cond, &encoder->mutex);
+
+	for (codec = 0; codec < RDP_CODEC_COUNT; codec++) {
+		frames[codec] = encoder->job.frames[codec];
+		encoder->job.frames[codec] = NULL;
+	}
+	encoder->busy = false;
+	pthread_mutex_unlock(&encoder->mutex);
+}
+
+static void
+rdp_output_fan_out(struct rdp_output *output,
+		   struct rdp_encoded_frame *frames[RDP_CODEC_COUNT])
+{
+	struct rdp_peers_item *outputPeer;
+	struct rdp_encoded_frame *frame;
+	pixman_region32_t damage;
+	enum rdp_codec codec;
+
+	wl_list_for_each(outputPeer, &output->peers, link) {
+		if (!rdp_peer_wants_frames(outputPeer))
+			continue;
+
+		codec = rdp_peer_codec(outputPeer->peer);
+		if (codec == RDP_CODEC_RAW || !frames[codec])
+			continue;
+
+		frame = rdp_encoded_frame_ref(frames[codec]);
+		if (rdp_peer_backed_up(outputPeer->peer)) {
+			pixman_region32_init_rect(&damage,
+				frame->extents.x1, frame->extents.y1,
+				frame->extents.x2 - frame->extents.x1,
+				frame->extents.y2 - frame->extents.y1);
+			rdp_peer_coalesce(outputPeer->peer, &damage);
+			pixman_region32_fini(&damage);
+		} else {
+			rdp_peer_frame_begin(outputPeer->peer);
+			rdp_peer_send_surface_bits(outputPeer->peer, codec,
+						   &frame->extents,
+						   frame->stream);
+			rdp_peer_frame_end(outputPeer->peer);
+		}
+		rdp_encoded_frame_unref(frame);
+	}
+}
+
+/*
+ * The repaint loop runs at the pace of the fastest peer: a frame is
+ * finished once its encode is done and some peer is ready for more,
+ * or has waited RDP_MAX_FRAME_WAIT_MS for one. Without peers it
+ * simply runs at the mode refresh rate.
+ */
+static bool
+rdp_output_has_ready_peer(struct rdp_output *output)
+{
+	struct rdp_peers_item *outputPeer;
+	bool any = false;
+
+	wl_list_for_each(outputPeer, &output->peers, link) {
+		if (!rdp_peer_wants_frames(outputPeer))
+			continue;
+
+		if (!rdp_peer_backed_up(outputPeer->peer))
+			return true;
+		any = true;
+	}
+
+	return !any;
+}
+
+static void
+rdp_output_finish_frame(struct rdp_output *output)
+{
+	struct timespec ts;
+	int64_t waited_ms;
+
+	if (!output->finish_frame_pending)
+		return;
+
+	/* the next repaint must not touch the shadow surface under the
+	 * encoder, so finish the frame once the encoded one went out */
+	if (output->encoder.busy)
+		return;
+
+	weston_compositor_read_presentation_clock(output->base.compositor, &ts);
+	waited_ms = timespec_sub_to_msec(&ts, &output->repaint_time);
+
+	if (!rdp_output_has_ready_peer(output) &&
+	    waited_ms < RDP_MAX_FRAME_WAIT_MS) {
+		wl_event_source_timer_update(output->finish_frame_timer,
+					     RDP_MAX_FRAME_WAIT_MS - waited_ms);
+		return;
+	}
+
+	output->finish_frame_pending = false;
+	wl_event_source_timer_update(output->finish_frame_timer, 0);
+	weston_output_finish_frame(&output->base, &ts, 0);
+}
+
+static int
+rdp_encoder_done(int fd, uint32_t mask, void *data)
+{
+	struct rdp_output *output = data;
+	struct rdp_encoder *encoder = &output->encoder;
+	struct rdp_encoded_frame *frames[RDP_CODEC_COUNT];
+	char buf[16];
+	int codec;
+
+	while (read(fd, buf, sizeof buf) > 0)
+		;
+
+	if (!encoder->busy)
+		return 0;
+
+	rdp_encoder_collect(encoder, frames);
+	rdp_output_fan_out(output, frames);
+
+	for (codec = 0; codec < RDP_CODEC_COUNT; codec++) {
+		if (frames[codec])
+			rdp_encoded_frame_unref(frames[codec]);
+	}
+
+	rdp_output_finish_frame(output);
+
+	return 0;
+}
+
+/* Drops the job in flight, if any, e.g. before the shadow surface goes. */
+static void
+rdp_encoder_flush(struct rdp_encoder *encoder)
+{
+	struct rdp_encoded_frame *frames[RDP_CODEC_COUNT];
+	int codec;
+
+	if (!encoder->busy)
+		return;
+
+	rdp_encoder_collect(encoder, frames);
+	for (codec = 0; codec < RDP_CODEC_COUNT; codec++) {
+		if (frames[codec])
+			rdp_encoded_frame_unref(frames[codec]);
+	}
+}
+
+static void
+rdp_encoder_submit(struct rdp_encoder *encoder, pixman_region32_t *damage,
+		   pixman_image_t *image, uint32_t codec_mask)
+{
+	assert(!encoder->busy);
+
+	pthread_mutex_lock(&encoder->mutex);
+	pixman_region32_copy(&encoder->job.damage, damage);
+	encoder->job.image = image;
+	encoder->job.codec_mask = codec_mask;
+	encoder->job.valid = true;
+	encoder->busy = true;
+	pthread_cond_broadcast(&encoder->cond);
+	pthread_mutex_unlock(&encoder->mutex);
+}
+
+static void
+rdp_encoder_reset(struct rdp_encoder *encoder, int width, int height)
+{
+	RFX_RESET(encoder->rfx_context, width, height);
+	NSC_RESET(encoder->nsc_context, width, height);
+}
+
+static int
+rdp_encoder_init(struct rdp_encoder *encoder, struct rdp_output *output,
+		 struct wl_event_loop *loop)
+{
+	int width = output->base.current_mode->width;
+	int height = output->base.current_mode->height;
+
+#if FREERDP_VERSION_MAJOR == 1 && FREERDP_VERSION_MINOR == 1
+	encoder->rfx_context = rfx_context_new();
+#else
+	encoder->rfx_context = rfx_context_new(TRUE);
+#endif
+	if (!encoder->rfx_context)
+		return -1;
+
+	encoder->rfx_context->mode = RLGR3;
+	encoder->rfx_context->width = width;
+	encoder->rfx_context->height = height;
+	rfx_context_set_pixel_format(encoder->rfx_context, DEFAULT_PIXEL_FORMAT);
+
+	encoder->nsc_context = nsc_context_new();
+	if (!encoder->nsc_context)
+		goto err_rfx;
+
+#ifdef HAVE_NSC_CONTEXT_SET_PARAMETERS
+	nsc_context_set_parameters(encoder->nsc_context, NSC_COLOR_FORMAT, DEFAULT_PIXEL_FORMAT);
+#else
+	nsc_context_set_pixel_format(encoder->nsc_context, DEFAULT_PIXEL_FORMAT);
+#endif
+	NSC_RESET(encoder->nsc_context, width, height);
+
+	if (pipe2(encoder->done_fd, O_CLOEXEC | O_NONBLOCK) == -1)
+		goto err_nsc;
+
+	encoder->done_source = wl_event_loop_add_fd(loop, encoder->done_fd[0],
+						    WL_EVENT_READABLE,
+						    rdp_encoder_done, output);
+	if (!encoder->done_source)
+		goto err_pipe;
+
+	pixman_region32_init(&encoder->job.damage);
+	pthread_mutex_init(&encoder->mutex, NULL);
+	pthread_cond_init(&encoder->cond, NULL);
+	if (pthread_create(&encoder->thread, NULL,
+			   rdp_encoder_thread, encoder) != 0) {
+		pthread_cond_destroy(&encoder->cond);
+		pthread_mutex_destroy(&encoder->mutex);
+		pixman_region32_fini(&encoder->job.damage);
+		wl_event_source_remove(encoder->done_source);
+		goto err_pipe;
+	}
+
+	return 0;
+
+err_pipe:
+	close(encoder->done_fd[0]);
+	close(encoder->done_fd[1]);
+err_nsc:
+	nsc_context_free(encoder->nsc_context);
+err_rfx:
+	rfx_context_free(encoder->rfx_context);
+	return -1;
+}
+
+static void
+rdp_encoder_fini(struct rdp_encoder *encoder)
+{
+	rdp_encoder_flush(encoder);
+
+	pthread_mutex_lock(&encoder->mutex);
+	encoder->destroying = 1;
+	pthread_cond_broadcast(&encoder->cond);
+	pthread_mutex_unlock(&encoder->mutex);
+
+	pthread_join(encoder->thread, NULL);
+	pthread_cond_destroy(&encoder->cond);
+	pthread_mutex_destroy(&encoder->mutex);
+
+	wl_event_source_remove(encoder->done_source);
+	close(encoder->done_fd[0]);
+	close(encoder->done_fd[1]);
+
+	pixman_region32_fini(&encoder->job.damage);
+	nsc_context_free(encoder->nsc_context);
+	rfx_context_free(encoder->rfx_context);
+	free(encoder->rfx_rects);
+	memset(encoder, 0, sizeof *encoder);
 }
 
 static int
@@ -408,23 +1008,39 @@ rdp_output_repaint(struct weston_output *output_base, pixman_region32_t *damage,
 	struct rdp_output *output = container_of(output_base, struct rdp_output, base);
 	struct weston_compositor *ec = output->base.compositor;
 	struct rdp_peers_item *outputPeer;
+	enum rdp_codec codec;
+	uint32_t codec_mask = 0;
 
 	pixman_renderer_output_set_buffer(output_base, output->shadow_surface);
 	ec->renderer->repaint_output(&output->base, damage);
 
+	/* Raw peers get their copy right away. RemoteFX and NSCodec are
+	 * encoded once for all the peers using them, off the main thread.
+	 * Peers that are behind only accumulate the damage. */
 	if (pixman_region32_not_empty(damage)) {
 		wl_list_for_each(outputPeer, &output->peers, link) {
-			if ((outputPeer->flags & RDP_PEER_ACTIVATED) &&
-					(outputPeer->flags & RDP_PEER_OUTPUT_ENABLED))
-			{
+			if (!rdp_peer_wants_frames(outputPeer))
+				continue;
+
+			codec = rdp_peer_codec(outputPeer->peer);
+			if (rdp_peer_backed_up(outputPeer->peer))
+				rdp_peer_coalesce(outputPeer->peer, damage);
+			else if (codec == RDP_CODEC_RAW)
 				rdp_peer_refresh_region(damage, outputPeer->peer);
-			}
+			else
+				codec_mask |= 1 << codec;
 		}
 	}
 
+	if (codec_mask)
+		rdp_encoder_submit(&output->encoder, damage,
+				   output->shadow_surface, codec_mask);
+
 	pixman_region32_subtract(&ec->primary_plane.damage,
 				 &ec->primary_plane.damage, damage);
 
+	weston_compositor_read_presentation_clock(ec, &output->repaint_time);
+	output->finish_frame_pending = false;
 	wl_event_source_timer_update(output->finish_frame_timer, 16);
 	return 0;
 }
@@ -433,10 +1049,9 @@ static int
 finish_frame_handler(void *data)
 {
 	struct rdp_output *output = data;
-	struct timespec ts;
 
-	weston_compositor_read_presentation_clock(output->base.compositor, &ts);
-	weston_output_finish_frame(&output->base, &ts, 0);
+	output->finish_frame_pending = true;
+	rdp_output_finish_frame(output);
 
 	return 1;
 }
@@ -492,6 +1107,13 @@ rdp_switch_mode(struct weston_output *output, struct weston_mode *target_mode)
 	output->current_mode = local_mode;
 	output->current_mode->flags |= WL_OUTPUT_MODE_CURRENT;
 
+	/* a frame encoded at the old size is of no use to anyone now */
+	rdp_encoder_flush(&rdpOutput->encoder);
+	rdp_encoder_reset(&rdpOutput->encoder, target_mode->width,
+			  target_mode->height);
+	/* a frame held back for the flushed job gets no encoder_done */
+	rdp_output_finish_frame(rdpOutput);
+
 	pixman_renderer_output_destroy(output);
 	pixman_renderer_output_create(output, &options);
 
@@ -569,8 +1191,10 @@ rdp_output_enable(struct weston_output *base)
 	struct rdp_output *output = to_rdp_output(base);
 	struct rdp_backend *b = to_rdp_backend(base->compositor);
 	struct wl_event_loop *loop;
+	/* shadow_surface is the only buffer and keeps its contents, so the
+	 * renderer can paint the damage straight into it. */
 	const struct pixman_renderer_output_options options = {
-		.use_shadow = true,
+		.use_shadow = false,
 	};
 
 	output->shadow_surface = pixman_image_create_bits(PIXMAN_x8r8g8b8,
@@ -589,6 +1213,14 @@ rdp_output_enable(struct weston_output *base)
 	}
 
 	loop = wl_display_get_event_loop(b->compositor->wl_display);
+
+	if (rdp_encoder_init(&output->encoder, output, loop) < 0) {
+		weston_log("Failed to create the RDP frame encoder.\n");
+		pixman_renderer_output_destroy(&output->base);
+		pixman_image_unref(output->shadow_surface);
+		return -1;
+	}
+
 	output->finish_frame_timer = wl_event_loop_add_timer(loop, finish_frame_handler, output);
 
 	b->output = output;
@@ -605,6 +1237,9 @@ rdp_output_disable(struct weston_output *base)
 	if (!output->base.enabled)
 		return 0;
 
+	rdp_encoder_fini(&output->encoder);
+	output->finish_frame_pending = false;
+
 	pixman_image_unref(output->shadow_surface);
 	pixman_renderer_output_destroy(&output->base);
 
@@ -775,6 +1410,8 @@ rdp_peer_context_new(freerdp_peer* client, RdpPeerContext* context)
 	if (!context->encode_stream)
 		goto out_error_stream;
 
+	pixman_region32_init(&context->pacing.damage);
+
 	FREERDP_CB_RETURN(TRUE);
 
 out_error_nsc:
@@ -804,6 +1441,9 @@ rdp_peer_context_free(freerdp_peer* client, RdpPeerContext* context)
 		 * but it would crash on reconnect */
 	}
 
+	rdp_peer_pacing_report(client);
+	pixman_region32_fini(&context->pacing.damage);
+
 	Stream_Free(context->encode_stream, TRUE);
 	nsc_context_free(context->nsc_context);
 	rfx_context_free(context->rfx_context);
@@ -1037,6 +1677,10 @@ xf_peer_activate(freerdp_peer* client)
 	RFX_RESET(peerCtx->rfx_context, weston_output->width, weston_output->height);
 	NSC_RESET(peerCtx->nsc_context, weston_output->width, weston_output->height);
 
+	/* a reactivated client starts over with its frame acknowledgements */
+	peerCtx->pacing.acked_id = peerCtx->pacing.frame_id;
+	pixman_region32_clear(&peerCtx->pacing.damage);
+
 	if (peersItem->flags & RDP_PEER_ACTIVATED)
 		return TRUE;
 
@@ -1082,6 +1726,8 @@ xf_peer_activate(freerdp_peer* client)
 	weston_seat_init_pointer(peersItem->seat);
 
 	peersItem->flags |= RDP_PEER_ACTIVATED;
+	weston_compositor_read_presentation_clock(b->compositor,
+						  &peerCtx->pacing.start_time);
 
 	/* disable pointer on the client side */
 	pointer = client->update->pointer;
@@ -1275,6 +1921,43 @@ xf_suppress_output(rdpContext *context, BYTE allow, const RECTANGLE_16 *area)
 	FREERDP_CB_RETURN(TRUE);
 }
 
+static BOOL
+xf_surface_frame_acknowledge(rdpContext *context, UINT32 frameId)
+{
+	RdpPeerContext *peerCtx = (RdpPeerContext *)context;
+	struct rdp_backend *b = peerCtx->rdpBackend;
+	struct timespec now;
+	int64_t latency;
+
+	/* stale or bogus ids don't move anything */
+	if ((int32_t)(frameId - peerCtx->pacing.acked_id) <= 0 ||
+	    (int32_t)(peerCtx->pacing.frame_id - frameId) < 0)
+		return TRUE;
+
+	if (peerCtx->pacing.frame_id - frameId < RDP_FRAME_HISTORY) {
+		weston_compositor_read_presentation_clock(b->compositor, &now);
+		latency = timespec_sub_to_nsec(&now,
+			&peerCtx->pacing.sent_time[frameId % RDP_FRAME_HISTORY]);
+		peerCtx->pacing.ack_count++;
+		peerCtx->pacing.ack_total_nsec += latency;
+		peerCtx->pacing.ack_max_nsec = MAX(peerCtx->pacing.ack_max_nsec,
+						   latency);
+	}
+	peerCtx->pacing.acked_id = frameId;
+
+	if (!b->output)
+		return TRUE;
+
+	if ((peerCtx->item.flags & RDP_PEER_OUTPUT_ENABLED) &&
+	    !rdp_peer_backed_up(context->peer))
+		rdp_peer_flush_coalesced(context->peer);
+
+	/* this may be the peer the repaint loop is waiting for */
+	rdp_output_finish_frame(b->output);
+
+	return TRUE;
+}
+
 static int
 rdp_peer_init(freerdp_peer *client, struct rdp_backend *b)
 {
@@ -1325,6 +2008,7 @@ rdp_peer_init(freerdp_peer *client, struct rdp_backend *b)
 	client->Activate = xf_peer_activate;
 
 	client->update->SuppressOutput = (pSuppressOutput)xf_suppress_output;
+	client->update->SurfaceFrameAcknowledge = xf_surface_frame_acknowledge;
 
 	input = client->input;
 	input->SynchronizeEvent = xf_input_synchronize_event;
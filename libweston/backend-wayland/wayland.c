@@ -64,6 +64,9 @@
 
 #define WINDOW_TITLE "Weston Compositor"
 
+/* Number of buffers carved out of one SHM pool for pixman outputs */
+#define WAYLAND_SHM_RING_SIZE 3
+
 static const uint32_t wayland_formats[] = {
 	DRM_FORMAT_ARGB8888,
 };
@@ -134,6 +137,7 @@ struct wayland_output {
 	struct {
 		struct wl_list buffers;
 		struct wl_list free_buffers;
+		struct wayland_shm_pool *pool;
 	} shm;
 
 	struct weston_mode mode;
@@ -172,11 +176,29 @@ struct wayland_head {
 	struct wayland_parent_output *parent_output;
 };
 
+/**
+ * One anonymous file mapped once and shared with the parent compositor, cut
+ * into fixed-size slots. Outputs keep their pool across resizes as long as
+ * the new size fits in a slot, so only the wl_buffers get recreated.
+ */
+struct wayland_shm_pool {
+	struct wl_shm_pool *pool;
+	void *data;
+	size_t size;
+	size_t slot_size;
+	int slot_count;
+	uint32_t slots_used;
+	int refcount;
+};
+
 struct wayland_shm_buffer {
 	struct wayland_output *output;
 	struct wl_list link;
 	struct wl_list free_link;
 
+	struct wayland_shm_pool *pool;
+	int slot;
+
 	struct wl_buffer *buffer;
 	void *data;
 	size_t size;
@@ -243,6 +265,73 @@ to_wayland_backend(struct weston_compositor *base)
 	return container_of(base->backend, struct wayland_backend, base);
 }
 
+static struct wayland_shm_pool *
+wayland_shm_pool_create(struct wayland_backend *b, size_t slot_size,
+			int slot_count)
+{
+	struct wayland_shm_pool *pool;
+	size_t size = slot_size * slot_count;
+	int fd;
+
+	pool = zalloc(sizeof *pool);
+	if (!pool)
+		return NULL;
+
+	fd = os_create_anonymous_file(size);
+	if (fd < 0) {
+		weston_log("could not create an anonymous file buffer: %s\n",
+			   strerror(errno));
+		free(pool);
+		return NULL;
+	}
+
+	pool->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			  fd, 0);
+	if (pool->data == MAP_FAILED) {
+		weston_log("could not mmap %zu memory for data: %s\n", size,
+			   strerror(errno));
+		close(fd);
+		free(pool);
+		return NULL;
+	}
+
+	pool->pool = wl_shm_create_pool(b->parent.shm, fd, size);
+	close(fd);
+
+	pool->size = size;
+	pool->slot_size = slot_size;
+	pool->slot_count = slot_count;
+	pool->refcount = 1;
+
+	return pool;
+}
+
+static void
+wayland_shm_pool_unref(struct wayland_shm_pool *pool)
+{
+	if (--pool->refcount > 0)
+		return;
+
+	wl_shm_pool_destroy(pool->pool);
+	munmap(pool->data, pool->size);
+	free(pool);
+}
+
+static int
+wayland_shm_pool_take_slot(struct wayland_shm_pool *pool)
+{
+	int i;
+
+	for (i = 0; i < pool->slot_count; i++) {
+		if (!(pool->slots_used & (1u << i))) {
+			pool->slots_used |= 1u << i;
+			return i;
+		}
+	}
+
+	return -1;
+}
+
 static void
 wayland_shm_buffer_destroy(struct wayland_shm_buffer *buffer)
 {
@@ -250,7 +339,8 @@ wayland_shm_buffer_destroy(struct wayland_shm_buffer *buffer)
 	pixman_image_unref(buffer->pm_image);
 
 	wl_buffer_destroy(buffer->buffer);
-	munmap(buffer->data, buffer->size);
+	buffer->pool->slots_used &= ~(1u << buffer->slot);
+	wayland_shm_pool_unref(buffer->pool);
 
 	pixman_region32_fini(&buffer->damage);
 
@@ -275,18 +365,42 @@ static const struct wl_buffer_listener buffer_listener = {
 	buffer_release
 };
 
+/* Slot size big enough for the current size and every mode of the output,
+ * so that switching modes does not need a new pool. */
+static size_t
+wayland_output_shm_slot_size(struct wayland_output *output,
+			     int width, int height)
+{
+	struct weston_mode *mode;
+	size_t size, max;
+
+	max = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width) *
+	      (size_t) height;
+
+	if (output->frame)
+		return max;
+
+	wl_list_for_each(mode, &output->base.mode_list, link) {
+		size = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32,
+						     mode->width) *
+		       (size_t) mode->height;
+		max = MAX(max, size);
+	}
+
+	return max;
+}
+
 static struct wayland_shm_buffer *
 wayland_output_get_shm_buffer(struct wayland_output *output)
 {
 	struct wayland_backend *b =
 		to_wayland_backend(output->base.compositor);
-	struct wl_shm *shm = b->parent.shm;
+	struct wayland_shm_pool *pool = NULL;
 	struct wayland_shm_buffer *sb;
 
-	struct wl_shm_pool *pool;
 	int width, height, stride;
 	int32_t fx, fy;
-	int fd;
+	int slot = -1;
 	unsigned char *data;
 
 	if (!wl_list_empty(&output->shm.free_buffers)) {
@@ -308,31 +422,55 @@ wayland_output_get_shm_buffer(struct wayland_output *output)
 
 	stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
 
-	fd = os_create_anonymous_file(height * stride);
-	if (fd < 0) {
-		weston_log("could not create an anonymous file buffer: %s\n",
-			   strerror(errno));
-		return NULL;
+	/* Pixman outputs render straight into these buffers every frame,
+	 * so they take them from the output's ring. Anything else only
+	 * ever needs a one-off buffer. */
+	if (b->use_pixman) {
+		pool = output->shm.pool;
+		if (pool && pool->slot_size < (size_t) height * stride) {
+			wayland_shm_pool_unref(pool);
+			pool = output->shm.pool = NULL;
+		}
+
+		if (!pool) {
+			size_t slot_size =
+				wayland_output_shm_slot_size(output, width,
+							     height);
+
+			pool = wayland_shm_pool_create(b, slot_size,
+						       WAYLAND_SHM_RING_SIZE);
+			output->shm.pool = pool;
+		}
+
+		if (pool)
+			slot = wayland_shm_pool_take_slot(pool);
+
+		if (slot >= 0)
+			pool->refcount++;
 	}
 
-	data = mmap(NULL, height * stride, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-	if (data == MAP_FAILED) {
-		weston_log("could not mmap %d memory for data: %s\n", height * stride,
-			   strerror(errno));
-		close(fd);
-		return NULL;
+	/* The parent compositor is holding on to the whole ring */
+	if (slot < 0) {
+		pool = wayland_shm_pool_create(b, (size_t) height * stride, 1);
+		if (!pool)
+			return NULL;
+		slot = wayland_shm_pool_take_slot(pool);
 	}
 
 	sb = zalloc(sizeof *sb);
 	if (sb == NULL) {
 		weston_log("could not zalloc %zu memory for sb: %s\n", sizeof *sb,
 			   strerror(errno));
-		close(fd);
-		munmap(data, height * stride);
+		pool->slots_used &= ~(1u << slot);
+		wayland_shm_pool_unref(pool);
 		return NULL;
 	}
 
+	data = (unsigned char *) pool->data + slot * pool->slot_size;
+
 	sb->output = output;
+	sb->pool = pool;
+	sb->slot = slot;
 	wl_list_init(&sb->free_link);
 	wl_list_insert(&output->shm.buffers, &sb->link);
 
@@ -345,15 +483,12 @@ wayland_output_get_shm_buffer(struct wayland_output *output)
 	sb->height = height;
 	sb->size = height * stride;
 
-	pool = wl_shm_create_pool(shm, fd, sb->size);
-
-	sb->buffer = wl_shm_pool_create_buffer(pool, 0,
+	sb->buffer = wl_shm_pool_create_buffer(pool->pool,
+					       slot * pool->slot_size,
 					       width, height,
 					       stride,
 					       WL_SHM_FORMAT_ARGB8888);
 	wl_buffer_add_listener(sb->buffer, &buffer_listener, sb);
-	wl_shm_pool_destroy(pool);
-	close(fd);
 
 	memset(data, 0, sb->size);
 
@@ -583,6 +718,7 @@ wayland_shm_buffer_attach(struct wayland_shm_buffer *sb)
 	pixman_region32_t damage;
 	pixman_box32_t *rects;
 	int32_t ix, iy, iwidth, iheight, fwidth, fheight;
+	bool use_damage_buffer;
 	int i, n;
 
 	pixman_region32_init(&damage);
@@ -617,12 +753,26 @@ wayland_shm_buffer_attach(struct wayland_shm_buffer *sb)
 		}
 	}
 
+	/* The damage is in buffer coordinates by now; only fall back to
+	 * surface damage on parents too old for damage_buffer. */
+	use_damage_buffer =
+		wl_surface_get_version(sb->output->parent.surface) >=
+			WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION;
+
 	rects = pixman_region32_rectangles(&damage, &n);
 	wl_surface_attach(sb->output->parent.surface, sb->buffer, 0, 0);
-	for (i = 0; i < n; ++i)
-		wl_surface_damage(sb->output->parent.surface, rects[i].x1,
-				  rects[i].y1, rects[i].x2 - rects[i].x1,
-				  rects[i].y2 - rects[i].y1);
+	for (i = 0; i < n; ++i) {
+		if (use_damage_buffer)
+			wl_surface_damage_buffer(sb->output->parent.surface,
+						 rects[i].x1, rects[i].y1,
+						 rects[i].x2 - rects[i].x1,
+						 rects[i].y2 - rects[i].y1);
+		else
+			wl_surface_damage(sb->output->parent.surface,
+					  rects[i].x1, rects[i].y1,
+					  rects[i].x2 - rects[i].x1,
+					  rects[i].y2 - rects[i].y1);
+	}
 
 	if (sb->output->frame)
 		pixman_region32_fini(&damage);
@@ -647,7 +797,12 @@ wayland_output_repaint_pixman(struct weston_output *output_base,
 	wl_list_for_each(sb, &output->shm.buffers, link)
 		pixman_region32_union(&sb->damage, &sb->damage, damage);
 
+	/* Each buffer still holds what was rendered into it last time, and
+	 * its damage has collected everything that changed since, so the
+	 * renderer only has to paint that region straight into it. */
 	sb = wayland_output_get_shm_buffer(output);
+	if (!sb)
+		return -1;
 
 	wayland_output_update_shm_border(sb);
 	pixman_renderer_output_set_buffer(output_base, sb->pm_image);
@@ -706,6 +861,16 @@ wayland_output_destroy_shm_buffers(struct wayland_output *output)
 		buffer->output = NULL;
 }
 
+static void
+wayland_output_destroy_shm_pool(struct wayland_output *output)
+{
+	/* Buffers still held by the parent keep their own reference */
+	if (output->shm.pool) {
+		wayland_shm_pool_unref(output->shm.pool);
+		output->shm.pool = NULL;
+	}
+}
+
 static int
 wayland_output_disable(struct weston_output *base)
 {
@@ -725,6 +890,7 @@ wayland_output_disable(struct weston_output *base)
 	}
 
 	wayland_output_destroy_shm_buffers(output);
+	wayland_output_destroy_shm_pool(output);
 
 	wayland_backend_destroy_output_surface(output);
 
@@ -800,7 +966,7 @@ static int
 wayland_output_init_pixman_renderer(struct wayland_output *output)
 {
 	const struct pixman_renderer_output_options options = {
-		.use_shadow = true,
+		.use_shadow = false,
 	};
 	return pixman_renderer_output_create(&output->base, &options);
 }
@@ -1252,6 +1418,7 @@ wayland_output_enable(struct weston_output *base)
 
 	wl_list_init(&output->shm.buffers);
 	wl_list_init(&output->shm.free_buffers);
+	output->shm.pool = NULL;
 
 	if (b->use_pixman) {
 		if (wayland_output_init_pixman_renderer(output) < 0)
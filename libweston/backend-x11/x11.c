@@ -73,6 +73,9 @@
 #define WINDOW_MAX_WIDTH 8192
 #define WINDOW_MAX_HEIGHT 8192
 
+/* SHM segments the pixman path alternates between */
+#define X11_SHM_BUFFER_COUNT 2
+
 static const uint32_t x11_formats[] = {
 	DRM_FORMAT_XRGB8888,
 };
@@ -90,6 +93,7 @@ struct x11_backend {
 	struct xkb_keymap	*xkb_keymap;
 	unsigned int		 has_xkb;
 	uint8_t			 xkb_event_base;
+	uint8_t			 shm_event_base;
 	int			 fullscreen;
 	int			 no_input;
 	int			 use_pixman;
@@ -125,6 +129,14 @@ struct x11_head {
 	struct weston_head	base;
 };
 
+struct x11_shm_buffer {
+	xcb_shm_seg_t		segment;
+	pixman_image_t	       *hw_surface;
+	void		       *buf;
+	int			age;	/* frames since last rendered, 0 if never */
+	bool			busy;	/* put not completed by the server yet */
+};
+
 struct x11_output {
 	struct weston_output	base;
 
@@ -134,10 +146,9 @@ struct x11_output {
 	struct wl_event_source *finish_frame_timer;
 
 	xcb_gc_t		gc;
-	xcb_shm_seg_t		segment;
-	pixman_image_t	       *hw_surface;
-	int			shm_id;
-	void		       *buf;
+	struct x11_shm_buffer	shm[X11_SHM_BUFFER_COUNT];
+	int			shm_current;
+	bool			frame_pending;
 	uint8_t			depth;
 	int32_t                 scale;
 	bool			resize_pending;
@@ -432,18 +443,48 @@ x11_output_repaint_gl(struct weston_output *output_base,
 	return 0;
 }
 
+static struct x11_shm_buffer *
+x11_output_get_shm_buffer(struct x11_output *output)
+{
+	int i, idx;
+
+	for (i = 1; i <= X11_SHM_BUFFER_COUNT; i++) {
+		idx = (output->shm_current + i) % X11_SHM_BUFFER_COUNT;
+		if (!output->shm[idx].busy) {
+			output->shm_current = idx;
+			return &output->shm[idx];
+		}
+	}
+
+	return NULL;
+}
+
+static bool
+x11_output_has_free_shm_buffer(struct x11_output *output)
+{
+	int i;
+
+	for (i = 0; i < X11_SHM_BUFFER_COUNT; i++) {
+		if (output->shm[i].hw_surface && !output->shm[i].busy)
+			return true;
+	}
+
+	return false;
+}
+
+/* Sends only the damaged rectangles of the segment to the window. The
+ * requests are unchecked; the last one asks for a ShmCompletion event,
+ * which tells us the server is done reading the whole segment. */
 static void
-set_clip_for_output(struct weston_output *output_base, pixman_region32_t *region)
+x11_output_put_damage(struct x11_output *output, struct x11_shm_buffer *sb,
+		      pixman_region32_t *region)
 {
-	struct x11_output *output = to_x11_output(output_base);
-	struct weston_compositor *ec = output->base.compositor;
-	struct x11_backend *b = to_x11_backend(ec);
+	struct weston_output *output_base = &output->base;
+	struct x11_backend *b = to_x11_backend(output_base->compositor);
 	pixman_region32_t transformed_region;
 	pixman_box32_t *rects;
-	xcb_rectangle_t *output_rects;
-	xcb_void_cookie_t cookie;
+	uint16_t width, height;
 	int nrects, i;
-	xcb_generic_error_t *err;
 
 	pixman_region32_init(&transformed_region);
 	pixman_region32_copy(&transformed_region, region);
@@ -454,36 +495,29 @@ set_clip_for_output(struct weston_output *output_base, pixman_region32_t *region
 				  output_base->current_scale,
 				  &transformed_region, &transformed_region);
 
-	rects = pixman_region32_rectangles(&transformed_region, &nrects);
-	output_rects = calloc(nrects, sizeof(xcb_rectangle_t));
-
-	if (output_rects == NULL) {
-		pixman_region32_fini(&transformed_region);
-		return;
-	}
+	width = pixman_image_get_width(sb->hw_surface);
+	height = pixman_image_get_height(sb->hw_surface);
 
+	rects = pixman_region32_rectangles(&transformed_region, &nrects);
 	for (i = 0; i < nrects; i++) {
-		output_rects[i].x = rects[i].x1;
-		output_rects[i].y = rects[i].y1;
-		output_rects[i].width = rects[i].x2 - rects[i].x1;
-		output_rects[i].height = rects[i].y2 - rects[i].y1;
+		xcb_shm_put_image(b->conn, output->window, output->gc,
+				  width, height,
+				  rects[i].x1, rects[i].y1,
+				  rects[i].x2 - rects[i].x1,
+				  rects[i].y2 - rects[i].y1,
+				  rects[i].x1, rects[i].y1,
+				  output->depth, XCB_IMAGE_FORMAT_Z_PIXMAP,
+				  i == nrects - 1, sb->segment, 0);
 	}
 
 	pixman_region32_fini(&transformed_region);
 
-	cookie = xcb_set_clip_rectangles_checked(b->conn, XCB_CLIP_ORDERING_UNSORTED,
-					output->gc,
-					0, 0, nrects,
-					output_rects);
-	err = xcb_request_check(b->conn, cookie);
-	if (err != NULL) {
-		weston_log("Failed to set clip rects, err: %d\n", err->error_code);
-		free(err);
+	if (nrects > 0) {
+		sb->busy = true;
+		xcb_flush(b->conn);
 	}
-	free(output_rects);
 }
 
-
 static int
 x11_output_repaint_shm(struct weston_output *output_base,
 		       pixman_region32_t *damage,
@@ -491,29 +525,31 @@ x11_output_repaint_shm(struct weston_output *output_base,
 {
 	struct x11_output *output = to_x11_output(output_base);
 	struct weston_compositor *ec = output->base.compositor;
-	struct x11_backend *b = to_x11_backend(ec);
-	xcb_void_cookie_t cookie;
-	xcb_generic_error_t *err;
+	struct x11_shm_buffer *sb;
+	int i;
+
+	/* finish_frame_handler() holds the frame back until a segment is
+	 * free, so there always is one here. */
+	sb = x11_output_get_shm_buffer(output);
+	if (!sb)
+		return -1;
 
-	pixman_renderer_output_set_buffer(output_base, output->hw_surface);
+	pixman_renderer_output_set_buffer(output_base, sb->hw_surface);
+	pixman_renderer_output_set_buffer_age(output_base, sb->age);
 	ec->renderer->repaint_output(output_base, damage);
 
+	for (i = 0; i < X11_SHM_BUFFER_COUNT; i++) {
+		if (output->shm[i].age > 0)
+			output->shm[i].age++;
+	}
+	sb->age = 1;
+
 	pixman_region32_subtract(&ec->primary_plane.damage,
 				 &ec->primary_plane.damage, damage);
-	set_clip_for_output(output_base, damage);
-	cookie = xcb_shm_put_image_checked(b->conn, output->window, output->gc,
-					pixman_image_get_width(output->hw_surface),
-					pixman_image_get_height(output->hw_surface),
-					0, 0,
-					pixman_image_get_width(output->hw_surface),
-					pixman_image_get_height(output->hw_surface),
-					0, 0, output->depth, XCB_IMAGE_FORMAT_Z_PIXMAP,
-					0, output->segment, 0);
-	err = xcb_request_check(b->conn, cookie);
-	if (err != NULL) {
-		weston_log("Failed to put shm image, err: %d\n", err->error_code);
-		free(err);
-	}
+
+	/* The window still shows the previous frame, so only what changed
+	 * since then has to go over the wire. */
+	x11_output_put_damage(output, sb, damage);
 
 	wl_event_source_timer_update(output->finish_frame_timer, 10);
 	return 0;
@@ -523,30 +559,79 @@ static int
 finish_frame_handler(void *data)
 {
 	struct x11_output *output = data;
+	struct x11_backend *b = to_x11_backend(output->base.compositor);
 	struct timespec ts;
 
+	/* The server is still reading every segment; let the completion
+	 * event finish the frame instead of rendering over one of them. */
+	if (b->use_pixman && !x11_output_has_free_shm_buffer(output)) {
+		output->frame_pending = true;
+		return 1;
+	}
+
 	weston_compositor_read_presentation_clock(output->base.compositor, &ts);
 	weston_output_finish_frame(&output->base, &ts, 0);
 
 	return 1;
 }
 
+static void
+x11_backend_deliver_shm_completion(struct x11_backend *b,
+				   xcb_shm_completion_event_t *completion)
+{
+	struct x11_output *output;
+	struct timespec ts;
+	int i;
+
+	wl_list_for_each(output, &b->compositor->output_list, base.link) {
+		if (output->window != completion->drawable)
+			continue;
+
+		for (i = 0; i < X11_SHM_BUFFER_COUNT; i++) {
+			if (output->shm[i].hw_surface &&
+			    output->shm[i].segment == completion->shmseg)
+				output->shm[i].busy = false;
+		}
+
+		if (output->frame_pending) {
+			output->frame_pending = false;
+			weston_compositor_read_presentation_clock(b->compositor,
+								  &ts);
+			weston_output_finish_frame(&output->base, &ts, 0);
+		}
+		return;
+	}
+}
+
 static void
 x11_output_deinit_shm(struct x11_backend *b, struct x11_output *output)
 {
+	struct x11_shm_buffer *sb;
 	xcb_void_cookie_t cookie;
 	xcb_generic_error_t *err;
+	int i;
+
 	xcb_free_gc(b->conn, output->gc);
 
-	pixman_image_unref(output->hw_surface);
-	output->hw_surface = NULL;
-	cookie = xcb_shm_detach_checked(b->conn, output->segment);
-	err = xcb_request_check(b->conn, cookie);
-	if (err) {
-		weston_log("xcb_shm_detach failed, error %d\n", err->error_code);
-		free(err);
+	for (i = 0; i < X11_SHM_BUFFER_COUNT; i++) {
+		sb = &output->shm[i];
+		if (!sb->hw_surface)
+			continue;
+
+		pixman_image_unref(sb->hw_surface);
+		sb->hw_surface = NULL;
+		cookie = xcb_shm_detach_checked(b->conn, sb->segment);
+		err = xcb_request_check(b->conn, cookie);
+		if (err) {
+			weston_log("xcb_shm_detach failed, error %d\n", err->error_code);
+			free(err);
+		}
+		shmdt(sb->buf);
+		sb->buf = NULL;
+		sb->busy = false;
 	}
-	shmdt(output->buf);
+
+	output->frame_pending = false;
 }
 
 static void
@@ -699,6 +784,52 @@ get_depth_of_visual(xcb_screen_t *screen,
 	return 0;
 }
 
+static int
+x11_output_init_shm_buffer(struct x11_backend *b, struct x11_shm_buffer *sb,
+			   int width, int height, int bitsperpixel,
+			   pixman_format_code_t pixman_format)
+{
+	xcb_void_cookie_t cookie;
+	xcb_generic_error_t *err;
+	int shm_id;
+
+	/* Create SHM segment and attach it */
+	shm_id = shmget(IPC_PRIVATE, width * height * (bitsperpixel / 8), IPC_CREAT | S_IRWXU);
+	if (shm_id == -1) {
+		weston_log("x11shm: failed to allocate SHM segment\n");
+		return -1;
+	}
+	sb->buf = shmat(shm_id, NULL, 0 /* read/write */);
+	if (-1 == (long)sb->buf) {
+		weston_log("x11shm: failed to attach SHM segment\n");
+		sb->buf = NULL;
+		shmctl(shm_id, IPC_RMID, NULL);
+		return -1;
+	}
+	sb->segment = xcb_generate_id(b->conn);
+	cookie = xcb_shm_attach_checked(b->conn, sb->segment, shm_id, 1);
+	err = xcb_request_check(b->conn, cookie);
+	if (err) {
+		weston_log("x11shm: xcb_shm_attach error %d, op code %d, resource id %d\n",
+			   err->error_code, err->major_code, err->minor_code);
+		free(err);
+		shmdt(sb->buf);
+		sb->buf = NULL;
+		shmctl(shm_id, IPC_RMID, NULL);
+		return -1;
+	}
+
+	shmctl(shm_id, IPC_RMID, NULL);
+
+	/* Now create pixman image */
+	sb->hw_surface = pixman_image_create_bits(pixman_format, width, height, sb->buf,
+		width * (bitsperpixel / 8));
+	sb->age = 0;
+	sb->busy = false;
+
+	return 0;
+}
+
 static int
 x11_output_init_shm(struct x11_backend *b, struct x11_output *output,
 	int width, int height)
@@ -706,11 +837,10 @@ x11_output_init_shm(struct x11_backend *b, struct x11_output *output,
 	xcb_visualtype_t *visual_type;
 	xcb_screen_t *screen;
 	xcb_format_iterator_t fmt;
-	xcb_void_cookie_t cookie;
-	xcb_generic_error_t *err;
 	const xcb_query_extension_reply_t *ext;
 	int bitsperpixel = 0;
 	pixman_format_code_t pixman_format;
+	int i;
 
 	/* Check if SHM is available */
 	ext = xcb_get_extension_data(b->conn, &xcb_shm_id);
@@ -766,36 +896,22 @@ x11_output_init_shm(struct x11_backend *b, struct x11_output *output,
 	}
 
 
-	/* Create SHM segment and attach it */
-	output->shm_id = shmget(IPC_PRIVATE, width * height * (bitsperpixel / 8), IPC_CREAT | S_IRWXU);
-	if (output->shm_id == -1) {
-		weston_log("x11shm: failed to allocate SHM segment\n");
-		return -1;
-	}
-	output->buf = shmat(output->shm_id, NULL, 0 /* read/write */);
-	if (-1 == (long)output->buf) {
-		weston_log("x11shm: failed to attach SHM segment\n");
-		return -1;
-	}
-	output->segment = xcb_generate_id(b->conn);
-	cookie = xcb_shm_attach_checked(b->conn, output->segment, output->shm_id, 1);
-	err = xcb_request_check(b->conn, cookie);
-	if (err) {
-		weston_log("x11shm: xcb_shm_attach error %d, op code %d, resource id %d\n",
-			   err->error_code, err->major_code, err->minor_code);
-		free(err);
-		return -1;
-	}
-
-	shmctl(output->shm_id, IPC_RMID, NULL);
-
-	/* Now create pixman image */
-	output->hw_surface = pixman_image_create_bits(pixman_format, width, height, output->buf,
-		width * (bitsperpixel / 8));
+	b->shm_event_base = ext->first_event;
 
 	output->gc = xcb_generate_id(b->conn);
 	xcb_create_gc(b->conn, output->gc, output->window, 0, NULL);
 
+	output->shm_current = 0;
+	output->frame_pending = false;
+
+	for (i = 0; i < X11_SHM_BUFFER_COUNT; i++) {
+		if (x11_output_init_shm_buffer(b, &output->shm[i], width, height,
+					       bitsperpixel, pixman_format) < 0) {
+			x11_output_deinit_shm(b, output);
+			return -1;
+		}
+	}
+
 	return 0;
 }
 
@@ -805,6 +921,8 @@ x11_output_switch_mode(struct weston_output *base, struct weston_mode *mode)
 	struct x11_backend *b;
 	struct x11_output *output;
 	static uint32_t values[2];
+	struct timespec ts;
+	bool frame_pending;
 	int ret;
 
         b = to_x11_backend(base->compositor);
@@ -837,8 +955,12 @@ x11_output_switch_mode(struct weston_output *base, struct weston_mode *mode)
 
 	if (b->use_pixman) {
 		const struct pixman_renderer_output_options options = {
-			.use_shadow = true,
+			.use_shadow = false,
 		};
+		/* The completion for the old segments will not match
+		 * anything any more, so a held frame is finished here. */
+		frame_pending = output->frame_pending;
+
 		pixman_renderer_output_destroy(&output->base);
 		x11_output_deinit_shm(b, output);
 
@@ -854,6 +976,12 @@ x11_output_switch_mode(struct weston_output *base, struct weston_mode *mode)
 			x11_output_deinit_shm(b, output);
 			return -1;
 		}
+
+		if (frame_pending) {
+			weston_compositor_read_presentation_clock(b->compositor,
+								  &ts);
+			weston_output_finish_frame(&output->base, &ts, 0);
+		}
 	} else {
 		Window xid = (Window) output->window;
 		const struct gl_renderer_output_options options = {
@@ -1017,7 +1145,7 @@ x11_output_enable(struct weston_output *base)
 
 	if (b->use_pixman) {
 		const struct pixman_renderer_output_options options = {
-			.use_shadow = true,
+			.use_shadow = false,
 		};
 		if (x11_output_init_shm(b, output,
 					output->base.current_mode->width,
@@ -1655,6 +1783,10 @@ x11_backend_handle_event(int fd, uint32_t mask, void *data)
 			break;
 
 		default:
+			if (b->shm_event_base &&
+			    response_type == b->shm_event_base + XCB_SHM_COMPLETION)
+				x11_backend_deliver_shm_completion(b,
+					(xcb_shm_completion_event_t *) event);
 			break;
 		}
 
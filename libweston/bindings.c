@@ -39,11 +39,55 @@ struct weston_binding {
 	uint32_t button;
 	uint32_t axis;
 	uint32_t modifier;
+	uint32_t serial;
 	void *handler;
 	void *data;
 	struct wl_list link;
+	struct wl_list table_link;
 };
 
+static struct wl_list *
+binding_table_bucket(struct wl_list *table, uint32_t code, uint32_t modifier)
+{
+	uint32_t hash;
+
+	/* Fibonacci hashing; modifiers only use the low four bits so
+	 * shift them out of the way of the key/button/axis code. */
+	hash = (code ^ (modifier << 24)) * 2654435761u;
+
+	return &table[hash >> 26 & (WESTON_BINDING_TABLE_SIZE - 1)];
+}
+
+void
+weston_compositor_init_bindings(struct weston_compositor *compositor)
+{
+	int i;
+
+	wl_list_init(&compositor->key_binding_list);
+	wl_list_init(&compositor->modifier_binding_list);
+	wl_list_init(&compositor->button_binding_list);
+	wl_list_init(&compositor->touch_binding_list);
+	wl_list_init(&compositor->axis_binding_list);
+	wl_list_init(&compositor->debug_binding_list);
+
+	for (i = 0; i < WESTON_BINDING_TABLE_SIZE; i++) {
+		wl_list_init(&compositor->key_binding_table[i]);
+		wl_list_init(&compositor->button_binding_table[i]);
+		wl_list_init(&compositor->touch_binding_table[i]);
+		wl_list_init(&compositor->axis_binding_table[i]);
+	}
+
+	compositor->modifier_binding_serial = 0;
+}
+
+/* Any key, button or axis press invalidates all primed modifier
+ * bindings at once. */
+static void
+invalidate_modifier_bindings(struct weston_compositor *compositor)
+{
+	compositor->modifier_binding_serial++;
+}
+
 static struct weston_binding *
 weston_compositor_add_binding(struct weston_compositor *compositor,
 			      uint32_t key, uint32_t button, uint32_t axis,
@@ -59,8 +103,10 @@ weston_compositor_add_binding(struct weston_compositor *compositor,
 	binding->button = button;
 	binding->axis = axis;
 	binding->modifier = modifier;
+	binding->serial = compositor->modifier_binding_serial;
 	binding->handler = handler;
 	binding->data = data;
+	wl_list_init(&binding->table_link);
 
 	return binding;
 }
@@ -79,6 +125,9 @@ weston_compositor_add_key_binding(struct weston_compositor *compositor,
 		return NULL;
 
 	wl_list_insert(compositor->key_binding_list.prev, &binding->link);
+	wl_list_insert(binding_table_bucket(compositor->key_binding_table,
+					    key, modifier)->prev,
+		       &binding->table_link);
 
 	return binding;
 }
@@ -115,6 +164,9 @@ weston_compositor_add_button_binding(struct weston_compositor *compositor,
 		return NULL;
 
 	wl_list_insert(compositor->button_binding_list.prev, &binding->link);
+	wl_list_insert(binding_table_bucket(compositor->button_binding_table,
+					    button, modifier)->prev,
+		       &binding->table_link);
 
 	return binding;
 }
@@ -133,6 +185,9 @@ weston_compositor_add_touch_binding(struct weston_compositor *compositor,
 		return NULL;
 
 	wl_list_insert(compositor->touch_binding_list.prev, &binding->link);
+	wl_list_insert(binding_table_bucket(compositor->touch_binding_table,
+					    0, modifier)->prev,
+		       &binding->table_link);
 
 	return binding;
 }
@@ -151,6 +206,9 @@ weston_compositor_add_axis_binding(struct weston_compositor *compositor,
 		return NULL;
 
 	wl_list_insert(compositor->axis_binding_list.prev, &binding->link);
+	wl_list_insert(binding_table_bucket(compositor->axis_binding_table,
+					    axis, modifier)->prev,
+		       &binding->table_link);
 
 	return binding;
 }
@@ -176,6 +234,7 @@ WL_EXPORT void
 weston_binding_destroy(struct weston_binding *binding)
 {
 	wl_list_remove(&binding->link);
+	wl_list_remove(&binding->table_link);
 	free(binding);
 }
 
@@ -294,16 +353,18 @@ weston_compositor_run_key_binding(struct weston_compositor *compositor,
 	struct weston_binding *b, *tmp;
 	struct weston_surface *focus;
 	struct weston_seat *seat = keyboard->seat;
+	uint32_t modifier = seat->modifier_state;
+	struct wl_list *bucket;
 
 	if (state == WL_KEYBOARD_KEY_STATE_RELEASED)
 		return;
 
-	/* Invalidate all active modifier bindings. */
-	wl_list_for_each(b, &compositor->modifier_binding_list, link)
-		b->key = key;
+	invalidate_modifier_bindings(compositor);
 
-	wl_list_for_each_safe(b, tmp, &compositor->key_binding_list, link) {
-		if (b->key == key && b->modifier == seat->modifier_state) {
+	bucket = binding_table_bucket(compositor->key_binding_table,
+				      key, modifier);
+	wl_list_for_each_safe(b, tmp, bucket, table_link) {
+		if (b->key == key && b->modifier == modifier) {
 			weston_key_binding_handler_t handler = b->handler;
 			focus = keyboard->focus;
 			handler(keyboard, time, key, b->data);
@@ -340,11 +401,11 @@ weston_compositor_run_modifier_binding(struct weston_compositor *compositor,
 
 		/* Prime the modifier binding. */
 		if (state == WL_KEYBOARD_KEY_STATE_PRESSED) {
-			b->key = 0;
+			b->serial = compositor->modifier_binding_serial;
 			continue;
 		}
 		/* Ignore the binding if a key was pressed in between. */
-		else if (b->key != 0) {
+		else if (b->serial != compositor->modifier_binding_serial) {
 			return;
 		}
 
@@ -360,17 +421,18 @@ weston_compositor_run_button_binding(struct weston_compositor *compositor,
 				     enum wl_pointer_button_state state)
 {
 	struct weston_binding *b, *tmp;
+	uint32_t modifier = pointer->seat->modifier_state;
+	struct wl_list *bucket;
 
 	if (state == WL_POINTER_BUTTON_STATE_RELEASED)
 		return;
 
-	/* Invalidate all active modifier bindings. */
-	wl_list_for_each(b, &compositor->modifier_binding_list, link)
-		b->key = button;
+	invalidate_modifier_bindings(compositor);
 
-	wl_list_for_each_safe(b, tmp, &compositor->button_binding_list, link) {
-		if (b->button == button &&
-		    b->modifier == pointer->seat->modifier_state) {
+	bucket = binding_table_bucket(compositor->button_binding_table,
+				      button, modifier);
+	wl_list_for_each_safe(b, tmp, bucket, table_link) {
+		if (b->button == button && b->modifier == modifier) {
 			weston_button_binding_handler_t handler = b->handler;
 			handler(pointer, time, button, b->data);
 		}
@@ -384,12 +446,16 @@ weston_compositor_run_touch_binding(struct weston_compositor *compositor,
 				    int touch_type)
 {
 	struct weston_binding *b, *tmp;
+	uint32_t modifier = touch->seat->modifier_state;
+	struct wl_list *bucket;
 
 	if (touch->num_tp != 1 || touch_type != WL_TOUCH_DOWN)
 		return;
 
-	wl_list_for_each_safe(b, tmp, &compositor->touch_binding_list, link) {
-		if (b->modifier == touch->seat->modifier_state) {
+	bucket = binding_table_bucket(compositor->touch_binding_table,
+				      0, modifier);
+	wl_list_for_each_safe(b, tmp, bucket, table_link) {
+		if (b->modifier == modifier) {
 			weston_touch_binding_handler_t handler = b->handler;
 			handler(touch, time, b->data);
 		}
@@ -403,14 +469,15 @@ weston_compositor_run_axis_binding(struct weston_compositor *compositor,
 				   struct weston_pointer_axis_event *event)
 {
 	struct weston_binding *b, *tmp;
+	uint32_t modifier = pointer->seat->modifier_state;
+	struct wl_list *bucket;
 
-	/* Invalidate all active modifier bindings. */
-	wl_list_for_each(b, &compositor->modifier_binding_list, link)
-		b->key = event->axis;
+	invalidate_modifier_bindings(compositor);
 
-	wl_list_for_each_safe(b, tmp, &compositor->axis_binding_list, link) {
-		if (b->axis == event->axis &&
-		    b->modifier == pointer->seat->modifier_state) {
+	bucket = binding_table_bucket(compositor->axis_binding_table,
+				      event->axis, modifier);
+	wl_list_for_each_safe(b, tmp, bucket, table_link) {
+		if (b->axis == event->axis && b->modifier == modifier) {
 			weston_axis_binding_handler_t handler = b->handler;
 			handler(pointer, time, event, b->data);
 			return 1;
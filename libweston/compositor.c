@@ -1609,6 +1609,7 @@ weston_view_geometry_dirty(struct weston_view *view)
 		return;
 
 	view->transform.dirty = 1;
+	view->transform.serial++;
 
 	wl_list_for_each(child, &view->geometry.child_list,
 			 geometry.parent_link)
@@ -7534,12 +7535,7 @@ weston_compositor_create(struct wl_display *display,
 	wl_list_init(&ec->pending_output_list);
 	wl_list_init(&ec->output_list);
 	wl_list_init(&ec->head_list);
-	wl_list_init(&ec->key_binding_list);
-	wl_list_init(&ec->modifier_binding_list);
-	wl_list_init(&ec->button_binding_list);
-	wl_list_init(&ec->touch_binding_list);
-	wl_list_init(&ec->axis_binding_list);
-	wl_list_init(&ec->debug_binding_list);
+	weston_compositor_init_bindings(ec);
 
 	wl_list_init(&ec->plugin_api_list);
 
@@ -801,6 +801,58 @@ weston_touch_has_focus_resource(struct weston_touch *touch)
 	return true;
 }
 
+/* Convert global coordinates to surface coordinates of the touch focus.
+ *
+ * All touch points of a sequence go to the same view, so instead of
+ * running the full 4x4 inverse for every motion event of every finger,
+ * keep the 2D affine part of the inverse around until the view's
+ * geometry changes or the focus goes away.
+ */
+static void
+weston_touch_from_global_fixed(struct weston_touch *touch,
+			       wl_fixed_t x, wl_fixed_t y,
+			       wl_fixed_t *sx, wl_fixed_t *sy)
+{
+	struct weston_view *view = touch->focus;
+	const struct weston_matrix *inverse = &view->transform.inverse;
+	float fx, fy;
+
+	if (!view->transform.enabled || view->transform.dirty) {
+		weston_view_from_global_fixed(view, x, y, sx, sy);
+		return;
+	}
+
+	if (touch->focus_transform.view != view ||
+	    touch->focus_transform.serial != view->transform.serial) {
+		touch->focus_transform.view = view;
+		touch->focus_transform.serial = view->transform.serial;
+		touch->focus_transform.affine =
+			!(inverse->type & WESTON_MATRIX_TRANSFORM_OTHER) &&
+			inverse->d[3] == 0.0f && inverse->d[7] == 0.0f &&
+			inverse->d[15] == 1.0f;
+		touch->focus_transform.xx = inverse->d[0];
+		touch->focus_transform.xy = inverse->d[4];
+		touch->focus_transform.x0 = inverse->d[12];
+		touch->focus_transform.yx = inverse->d[1];
+		touch->focus_transform.yy = inverse->d[5];
+		touch->focus_transform.y0 = inverse->d[13];
+	}
+
+	if (!touch->focus_transform.affine) {
+		weston_view_from_global_fixed(view, x, y, sx, sy);
+		return;
+	}
+
+	fx = wl_fixed_to_double(x);
+	fy = wl_fixed_to_double(y);
+	*sx = wl_fixed_from_double(touch->focus_transform.xx * fx +
+				   touch->focus_transform.xy * fy +
+				   touch->focus_transform.x0);
+	*sy = wl_fixed_from_double(touch->focus_transform.yx * fx +
+				   touch->focus_transform.yy * fy +
+				   touch->focus_transform.y0);
+}
+
 /** Send wl_touch.down events to focused resources.
  *
  * \param touch The touch where the down events originates from.
@@ -827,7 +879,7 @@ weston_touch_send_down(struct weston_touch *touch, const struct timespec *time,
 	if (!weston_touch_has_focus_resource(touch))
 		return;
 
-	weston_view_from_global_fixed(touch->focus, x, y, &sx, &sy);
+	weston_touch_from_global_fixed(touch, x, y, &sx, &sy);
 
 	resource_list = &touch->focus_resource_list;
 	serial = wl_display_next_serial(display);
@@ -916,7 +968,7 @@ weston_touch_send_motion(struct weston_touch *touch,
 	if (!weston_touch_has_focus_resource(touch))
 		return;
 
-	weston_view_from_global_fixed(touch->focus, x, y, &sx, &sy);
+	weston_touch_from_global_fixed(touch, x, y, &sx, &sy);
 
 	resource_list = &touch->focus_resource_list;
 	msecs = timespec_to_msec(time);
@@ -2084,6 +2136,47 @@ update_modifier_state(struct weston_seat *seat, uint32_t serial, uint32_t key,
 	notify_modifiers(seat, serial);
 }
 
+static void
+weston_keyboard_send_keymap_list(struct weston_keyboard *kbd,
+				 struct wl_list *list)
+{
+	struct weston_xkb_info *xkb_info = kbd->xkb_info;
+	struct wl_resource *resource;
+	size_t size;
+	bool shared;
+	int fd = -1;
+
+	/* Version 7+ clients may only map the keymap privately, so they can
+	 * all be handed the same file once it is sealed. Older clients, and
+	 * everyone when sealing failed, each need their own copy. */
+	shared = os_ro_anonymous_file_is_sealed(xkb_info->keymap_rofile);
+	size = os_ro_anonymous_file_size(xkb_info->keymap_rofile);
+	wl_resource_for_each(resource, list) {
+		if (!shared || wl_resource_get_version(resource) < 7) {
+			weston_keyboard_send_keymap(kbd, resource);
+			continue;
+		}
+
+		if (fd == -1) {
+			fd = os_ro_anonymous_file_get_fd(xkb_info->keymap_rofile,
+							 RO_ANONYMOUS_FILE_MAPMODE_PRIVATE);
+			if (fd == -1) {
+				weston_log("creating a keymap file failed: %s\n",
+					   strerror(errno));
+				return;
+			}
+		}
+
+		wl_keyboard_send_keymap(resource,
+					WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1,
+					fd,
+					size);
+	}
+
+	if (fd != -1)
+		os_ro_anonymous_file_put_fd(fd);
+}
+
 WL_EXPORT void
 weston_keyboard_send_keymap(struct weston_keyboard *kbd, struct wl_resource *resource)
 {
@@ -2125,7 +2218,8 @@ send_modifiers(struct wl_resource *resource, uint32_t serial, struct weston_keyb
 }
 
 static struct weston_xkb_info *
-weston_xkb_info_create(struct xkb_keymap *keymap);
+weston_xkb_info_create(struct weston_compositor *ec,
+		       struct xkb_keymap *keymap);
 
 static void
 update_keymap(struct weston_seat *seat)
@@ -2137,7 +2231,8 @@ update_keymap(struct weston_seat *seat)
 	xkb_mod_mask_t latched_mods;
 	xkb_mod_mask_t locked_mods;
 
-	xkb_info = weston_xkb_info_create(keyboard->pending_keymap);
+	xkb_info = weston_xkb_info_create(seat->compositor,
+					  keyboard->pending_keymap);
 
 	xkb_keymap_unref(keyboard->pending_keymap);
 	keyboard->pending_keymap = NULL;
@@ -2147,6 +2242,13 @@ update_keymap(struct weston_seat *seat)
 		return;
 	}
 
+	/* The new keymap compiles to the one clients already have, so
+	 * there is nothing to resend. */
+	if (xkb_info == keyboard->xkb_info) {
+		weston_xkb_info_destroy(xkb_info);
+		return;
+	}
+
 	state = xkb_state_new(xkb_info->keymap);
 	if (!state) {
 		weston_log("failed to initialise XKB state\n");
@@ -2170,10 +2272,9 @@ update_keymap(struct weston_seat *seat)
 	xkb_state_unref(keyboard->xkb_state.state);
 	keyboard->xkb_state.state = state;
 
-	wl_resource_for_each(resource, &keyboard->resource_list)
-		weston_keyboard_send_keymap(keyboard, resource);
-	wl_resource_for_each(resource, &keyboard->focus_resource_list)
-		weston_keyboard_send_keymap(keyboard, resource);
+	weston_keyboard_send_keymap_list(keyboard, &keyboard->resource_list);
+	weston_keyboard_send_keymap_list(keyboard,
+					 &keyboard->focus_resource_list);
 
 	notify_modifiers(seat, wl_display_next_serial(seat->compositor->wl_display));
 
@@ -2334,6 +2435,8 @@ weston_touch_set_focus(struct weston_touch *touch, struct weston_view *view)
 
 	focus_resource_list = &touch->focus_resource_list;
 
+	touch->focus_transform.view = NULL;
+
 	if (view && touch->focus &&
 	    touch->focus->surface == view->surface) {
 		touch->focus = view;
@@ -3125,7 +3228,9 @@ weston_xkb_info_destroy(struct weston_xkb_info *xkb_info)
 
 	xkb_keymap_unref(xkb_info->keymap);
 
+	wl_list_remove(&xkb_info->link);
 	os_ro_anonymous_file_destroy(xkb_info->keymap_rofile);
+	free(xkb_info->keymap_string);
 	free(xkb_info);
 }
 
@@ -3143,16 +3248,53 @@ weston_compositor_xkb_destroy(struct weston_compositor *ec)
 	xkb_context_unref(ec->xkb_context);
 }
 
+/* Returns the live xkb_info whose keymap serializes to keymap_string,
+ * with a new reference, so that seats and keymap updates producing the
+ * same keymap share one keymap file. */
 static struct weston_xkb_info *
-weston_xkb_info_create(struct xkb_keymap *keymap)
+weston_xkb_info_lookup(struct weston_compositor *ec, const char *keymap_string)
+{
+	struct weston_xkb_info *xkb_info;
+
+	wl_list_for_each(xkb_info, &ec->xkb_info_list, link) {
+		if (strcmp(xkb_info->keymap_string, keymap_string) == 0) {
+			xkb_info->ref_count++;
+			return xkb_info;
+		}
+	}
+
+	return NULL;
+}
+
+static struct weston_xkb_info *
+weston_xkb_info_create(struct weston_compositor *ec,
+		       struct xkb_keymap *keymap)
 {
 	char *keymap_string;
 	size_t keymap_size;
-	struct weston_xkb_info *xkb_info = zalloc(sizeof *xkb_info);
-	if (xkb_info == NULL)
+	struct weston_xkb_info *xkb_info;
+
+	keymap_string = xkb_keymap_get_as_string(keymap,
+						 XKB_KEYMAP_FORMAT_TEXT_V1);
+	if (keymap_string == NULL) {
+		weston_log("failed to get string version of keymap\n");
+		return NULL;
+	}
+
+	xkb_info = weston_xkb_info_lookup(ec, keymap_string);
+	if (xkb_info) {
+		free(keymap_string);
+		return xkb_info;
+	}
+
+	xkb_info = zalloc(sizeof *xkb_info);
+	if (xkb_info == NULL) {
+		free(keymap_string);
 		return NULL;
+	}
 
 	xkb_info->keymap = xkb_keymap_ref(keymap);
+	xkb_info->keymap_string = keymap_string;
 	xkb_info->ref_count = 1;
 
 	xkb_info->shift_mod = xkb_keymap_mod_get_index(xkb_info->keymap,
@@ -3179,27 +3321,22 @@ weston_xkb_info_create(struct xkb_keymap *keymap)
 	xkb_info->scroll_led = xkb_keymap_led_get_index(xkb_info->keymap,
 							XKB_LED_NAME_SCROLL);
 
-	keymap_string = xkb_keymap_get_as_string(xkb_info->keymap,
-							   XKB_KEYMAP_FORMAT_TEXT_V1);
-	if (keymap_string == NULL) {
-		weston_log("failed to get string version of keymap\n");
-		goto err_keymap;
-	}
 	keymap_size = strlen(keymap_string) + 1;
 
 	xkb_info->keymap_rofile = os_ro_anonymous_file_create(keymap_size,
 							      keymap_string);
-	free(keymap_string);
-
 	if (!xkb_info->keymap_rofile) {
 		weston_log("failed to create anonymous file for keymap\n");
 		goto err_keymap;
 	}
 
+	wl_list_insert(&ec->xkb_info_list, &xkb_info->link);
+
 	return xkb_info;
 
 err_keymap:
 	xkb_keymap_unref(xkb_info->keymap);
+	free(xkb_info->keymap_string);
 	free(xkb_info);
 	return NULL;
 }
@@ -3225,7 +3362,7 @@ weston_compositor_build_global_keymap(struct weston_compositor *ec)
 		return -1;
 	}
 
-	ec->xkb_info = weston_xkb_info_create(keymap);
+	ec->xkb_info = weston_xkb_info_create(ec, keymap);
 	xkb_keymap_unref(keymap);
 	if (ec->xkb_info == NULL)
 		return -1;
@@ -3267,7 +3404,8 @@ weston_seat_init_keyboard(struct weston_seat *seat, struct xkb_keymap *keymap)
 	}
 
 	if (keymap != NULL) {
-		keyboard->xkb_info = weston_xkb_info_create(keymap);
+		keyboard->xkb_info = weston_xkb_info_create(seat->compositor,
+							    keymap);
 		if (keyboard->xkb_info == NULL)
 			goto err;
 	} else {
@@ -5045,6 +5183,8 @@ bind_input_timestamps_manager(struct wl_client *client, void *data,
 int
 weston_input_init(struct weston_compositor *compositor)
 {
+	wl_list_init(&compositor->xkb_info_list);
+
 	if (!wl_global_create(compositor->wl_display,
 			      &zwp_relative_pointer_manager_v1_interface, 1,
 			      compositor, bind_relative_pointer_manager))
@@ -59,6 +59,9 @@ weston_buffer_release_reference(struct weston_buffer_release_reference *ref,
 				struct weston_buffer_release *buf_release);
 
 /* weston_bindings */
+void
+weston_compositor_init_bindings(struct weston_compositor *compositor);
+
 void
 weston_binding_list_destroy_all(struct wl_list *list);
 
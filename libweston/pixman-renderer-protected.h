@@ -28,11 +28,17 @@
 #ifndef LIBWESTON_PIXMAN_RENDERER_PROTECTED_H
 #define LIBWESTON_PIXMAN_RENDERER_PROTECTED_H
 
+#define PIXMAN_BUFFER_DAMAGE_COUNT 3
+
 struct pixman_output_state {
 	void *shadow_buffer;
 	pixman_image_t *shadow_image;
 	pixman_image_t *hw_buffer;
 	pixman_region32_t *hw_extra_damage;
+	/* damage of the last frames, newest at buffer_damage_index */
+	pixman_region32_t buffer_damage[PIXMAN_BUFFER_DAMAGE_COUNT];
+	int buffer_damage_index;
+	int buffer_age;		/* -1 if the backend did not set one */
     struct tde_output_state_t *tde;
 };
 
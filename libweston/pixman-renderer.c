@@ -28,6 +28,7 @@
 #include "config.h"
 
 #include <errno.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -171,6 +172,22 @@ view_transformation_is_translation(struct weston_view *view)
 	return false;
 }
 
+/* Whole pixel offsets map source pixels 1:1, no need to filter */
+static bool
+view_transformation_is_integer_translation(struct weston_view *view)
+{
+	const struct weston_matrix *matrix = &view->transform.matrix;
+
+	if (!view_transformation_is_translation(view))
+		return false;
+
+	if (!view->transform.enabled)
+		return true;
+
+	return matrix->d[12] == floorf(matrix->d[12]) &&
+	       matrix->d[13] == floorf(matrix->d[13]);
+}
+
 static void
 region_intersect_only_translation(pixman_region32_t *result_global,
 				  pixman_region32_t *global,
@@ -334,7 +351,8 @@ repaint_region(struct weston_view *ev, struct weston_output *output,
 
 	pixman_renderer_compute_transform(&transform, ev, output);
 
-	if (ev->transform.enabled || output->current_scale != vp->buffer.scale)
+	if (!view_transformation_is_integer_translation(ev) ||
+	    output->current_scale != vp->buffer.scale)
 		filter = PIXMAN_FILTER_BILINEAR;
 	else
 		filter = PIXMAN_FILTER_NEAREST;
@@ -548,6 +566,44 @@ copy_to_hw_buffer(struct weston_output *output, pixman_region32_t *region)
 	pixman_image_set_clip_region32 (po->hw_buffer, NULL);
 }
 
+/* Everything that changed since the current hardware buffer was last
+ * rendered to: this frame's damage plus that of the age - 1 frames before
+ * it. Buffers that are new or older than the history get repainted
+ * entirely. */
+static void
+output_get_buffer_damage(struct weston_output *output,
+			 pixman_region32_t *output_damage,
+			 pixman_region32_t *buffer_damage)
+{
+	struct pixman_output_state *po = get_output_state(output);
+	int i;
+
+	if (po->buffer_age == 0 ||
+	    po->buffer_age - 1 > PIXMAN_BUFFER_DAMAGE_COUNT) {
+		pixman_region32_copy(buffer_damage, &output->region);
+		return;
+	}
+
+	pixman_region32_copy(buffer_damage, output_damage);
+	for (i = 0; i < po->buffer_age - 1; i++)
+		pixman_region32_union(buffer_damage, buffer_damage,
+				      &po->buffer_damage[(po->buffer_damage_index + i) %
+							 PIXMAN_BUFFER_DAMAGE_COUNT]);
+}
+
+static void
+output_rotate_damage(struct weston_output *output,
+		     pixman_region32_t *output_damage)
+{
+	struct pixman_output_state *po = get_output_state(output);
+
+	po->buffer_damage_index += PIXMAN_BUFFER_DAMAGE_COUNT - 1;
+	po->buffer_damage_index %= PIXMAN_BUFFER_DAMAGE_COUNT;
+
+	pixman_region32_copy(&po->buffer_damage[po->buffer_damage_index],
+			     output_damage);
+}
+
 static void
 pixman_renderer_repaint_output(struct weston_output *output,
 			       pixman_region32_t *output_damage)
@@ -559,17 +615,23 @@ pixman_renderer_repaint_output(struct weston_output *output,
 
 	if (!po->hw_buffer) {
 		po->hw_extra_damage = NULL;
+		po->buffer_age = -1;
 		return;
 	}
 
 	pixman_region32_init(&hw_damage);
+	if (po->buffer_age >= 0)
+		output_get_buffer_damage(output, output_damage, &hw_damage);
+	else
+		pixman_region32_copy(&hw_damage, output_damage);
+
 	if (po->hw_extra_damage) {
 		pixman_region32_union(&hw_damage,
-				      po->hw_extra_damage, output_damage);
+				      &hw_damage, po->hw_extra_damage);
 		po->hw_extra_damage = NULL;
-	} else {
-		pixman_region32_copy(&hw_damage, output_damage);
 	}
+	po->buffer_age = -1;
+	output_rotate_damage(output, output_damage);
 
 	if (po->shadow_image) {
 		repaint_surfaces(output, output_damage);
@@ -935,12 +997,32 @@ pixman_renderer_output_set_hw_extra_damage(struct weston_output *output,
 	po->hw_extra_damage = extra_damage;
 }
 
+/**
+ * Tell the renderer how old the contents of the next hardware buffer are
+ *
+ * \param output The output whose buffer is about to be repainted
+ * \param age 0 if the contents are undefined, otherwise how many frames
+ * ago the buffer was last rendered to, 1 being the previous frame
+ *
+ * Backends cycling through several buffers call this before every
+ * repaint_output, which then repaints whatever changed on the output since
+ * the buffer was last used. The age only applies to the next repaint.
+ */
+WL_EXPORT void
+pixman_renderer_output_set_buffer_age(struct weston_output *output,
+				      int age)
+{
+	struct pixman_output_state *po = get_output_state(output);
+
+	po->buffer_age = age;
+}
+
 WL_EXPORT int
 pixman_renderer_output_create(struct weston_output *output,
 			      const struct pixman_renderer_output_options *options)
 {
 	struct pixman_output_state *po;
-	int w, h;
+	int w, h, i;
 
 	po = zalloc(sizeof *po);
 	if (po == NULL)
@@ -949,6 +1031,10 @@ pixman_renderer_output_create(struct weston_output *output,
     // OHOS TDE
     tde_output_state_alloc_hook(po);
 
+	po->buffer_age = -1;
+	for (i = 0; i < PIXMAN_BUFFER_DAMAGE_COUNT; i++)
+		pixman_region32_init(&po->buffer_damage[i]);
+
 	if (options->use_shadow) {
 		/* set shadow image transformation */
 		w = output->current_mode->width;
@@ -983,6 +1069,7 @@ WL_EXPORT void
 pixman_renderer_output_destroy(struct weston_output *output)
 {
 	struct pixman_output_state *po = get_output_state(output);
+	int i;
 
 	if (po->shadow_image)
 		pixman_image_unref(po->shadow_image);
@@ -996,6 +1083,9 @@ pixman_renderer_output_destroy(struct weston_output *output)
 	po->shadow_image = NULL;
 	po->hw_buffer = NULL;
 
+	for (i = 0; i < PIXMAN_BUFFER_DAMAGE_COUNT; i++)
+		pixman_region32_fini(&po->buffer_damage[i]);
+
     tde_output_state_free_hook(po);
 	free(po);
 }
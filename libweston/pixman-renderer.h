@@ -52,6 +52,10 @@ void
 pixman_renderer_output_set_hw_extra_damage(struct weston_output *output,
 					   pixman_region32_t *extra_damage);
 
+void
+pixman_renderer_output_set_buffer_age(struct weston_output *output,
+				      int age);
+
 void
 pixman_renderer_output_destroy(struct weston_output *output);
 
@@ -36,6 +36,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <float.h>
+#include <math.h>
 #include <assert.h>
 #include <linux/input.h>
 #include <drm_fourcc.h>
@@ -417,6 +418,27 @@ dmabuf_image_destroy(struct dmabuf_image *image)
 #define max(a, b) (((a) > (b)) ? (a) : (b))
 #define min(a, b) (((a) > (b)) ? (b) : (a))
 
+static bool
+view_transform_is_translation(struct weston_view *ev)
+{
+	return !ev->transform.enabled ||
+	       ev->transform.matrix.type <= WESTON_MATRIX_TRANSFORM_TRANSLATE;
+}
+
+/* Whole pixel offsets map texels 1:1, no need to filter */
+static bool
+view_transform_is_integer_translation(struct weston_view *ev)
+{
+	const struct weston_matrix *matrix = &ev->transform.matrix;
+
+	if (!ev->transform.enabled)
+		return true;
+
+	return view_transform_is_translation(ev) &&
+	       matrix->d[12] == floorf(matrix->d[12]) &&
+	       matrix->d[13] == floorf(matrix->d[13]);
+}
+
 /*
  * Compute the boundary vertices of the intersection of the global coordinate
  * aligned rectangle 'rect', and an arbitrary quadrilateral produced from
@@ -472,7 +494,7 @@ calculate_edges(struct weston_view *ev, pixman_box32_t *rect,
 	 * there will be only four edges.  We just need to clip the surface
 	 * vertices to the clip rect bounds:
 	 */
-	if (!ev->transform.enabled)
+	if (view_transform_is_translation(ev))
 		return clip_simple(&ctx, &surf, ex, ey);
 
 	/* Transformed case: use a general polygon clipping algorithm to
@@ -939,7 +961,7 @@ draw_view(struct weston_view *ev, struct weston_output *output,
 	use_shader(gr, gs->shader);
 	shader_uniforms(gs->shader, ev, output);
 
-	if (ev->transform.enabled || output->zoom.active ||
+	if (!view_transform_is_integer_translation(ev) || output->zoom.active ||
 	    output->current_scale != ev->surface->buffer_viewport.buffer.scale)
 		filter = GL_LINEAR;
 	else
@@ -29,12 +29,19 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
 #include <linux/input.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
 #include <sys/uio.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include <libweston/libweston.h>
 #include "shared/helpers.h"
 #include "shared/timespec-util.h"
@@ -51,32 +58,41 @@ struct screenshooter_frame_listener {
 	void *data;
 };
 
+/* Swaps the R and B channels of a row of 32-bit pixels, keeping A and G. */
 static void
-copy_bgra_yflip(uint8_t *dst, uint8_t *src, int height, int stride)
+copy_row_swap_RB(void *vdst, const void *vsrc, int bytes)
 {
-	uint8_t *end;
+	uint32_t *dst = vdst;
+	const uint32_t *src = vsrc;
+	uint32_t *end = dst + bytes / 4;
 
-	end = dst + height * stride;
-	while (dst < end) {
-		memcpy(dst, src, stride);
-		dst += stride;
-		src -= stride;
-	}
-}
+#if defined(__SSE2__)
+	const __m128i ag = _mm_set1_epi32(0xff00ff00);
+	const __m128i lo = _mm_set1_epi32(0x000000ff);
+	const __m128i hi = _mm_set1_epi32(0x00ff0000);
 
-static void
-copy_bgra(uint8_t *dst, uint8_t *src, int height, int stride)
-{
-	/* TODO: optimize this out */
-	memcpy(dst, src, height * stride);
-}
+	while (end - dst >= 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *) src);
+		__m128i t = _mm_and_si128(v, ag);
 
-static void
-copy_row_swap_RB(void *vdst, void *vsrc, int bytes)
-{
-	uint32_t *dst = vdst;
-	uint32_t *src = vsrc;
-	uint32_t *end = dst + bytes / 4;
+		t = _mm_or_si128(t, _mm_and_si128(_mm_srli_epi32(v, 16), lo));
+		t = _mm_or_si128(t, _mm_and_si128(_mm_slli_epi32(v, 16), hi));
+		_mm_storeu_si128((__m128i *) dst, t);
+		dst += 4;
+		src += 4;
+	}
+#elif defined(__ARM_NEON)
+	while (end - dst >= 16) {
+		uint8x16x4_t v = vld4q_u8((const uint8_t *) src);
+		uint8x16_t t = v.val[0];
+
+		v.val[0] = v.val[2];
+		v.val[2] = t;
+		vst4q_u8((uint8_t *) dst, v);
+		dst += 16;
+		src += 16;
+	}
+#endif
 
 	while (dst < end) {
 		uint32_t v = *src++;
@@ -88,29 +104,25 @@ copy_row_swap_RB(void *vdst, void *vsrc, int bytes)
 	}
 }
 
+/* One pass over the rows: flips vertically and swaps R/B as needed. */
 static void
-copy_rgba_yflip(uint8_t *dst, uint8_t *src, int height, int stride)
+copy_rows(uint8_t *dst, int dst_stride, const uint8_t *src, int src_stride,
+	  int row_bytes, int height, bool yflip, bool swap_rb)
 {
-	uint8_t *end;
+	int i;
 
-	end = dst + height * stride;
-	while (dst < end) {
-		copy_row_swap_RB(dst, src, stride);
-		dst += stride;
-		src -= stride;
+	if (yflip) {
+		src += (height - 1) * src_stride;
+		src_stride = -src_stride;
 	}
-}
-
-static void
-copy_rgba(uint8_t *dst, uint8_t *src, int height, int stride)
-{
-	uint8_t *end;
 
-	end = dst + height * stride;
-	while (dst < end) {
-		copy_row_swap_RB(dst, src, stride);
-		dst += stride;
-		src += stride;
+	for (i = 0; i < height; i++) {
+		if (swap_rb)
+			copy_row_swap_RB(dst, src, row_bytes);
+		else
+			memcpy(dst, src, row_bytes);
+		dst += dst_stride;
+		src += src_stride;
 	}
 }
 
@@ -122,51 +134,62 @@ screenshooter_frame_notify(struct wl_listener *listener, void *data)
 			     struct screenshooter_frame_listener, listener);
 	struct weston_output *output = l->output;
 	struct weston_compositor *compositor = output->compositor;
-	int32_t stride;
-	uint8_t *pixels, *d, *s;
+	pixman_format_code_t format = compositor->read_format;
+	int32_t width = output->current_mode->width;
+	int32_t height = output->current_mode->height;
+	int32_t stride, row_bytes;
+	bool yflip, swap_rb;
+	uint8_t *pixels, *d;
 
 	weston_output_disable_planes_decr(output);
 	wl_list_remove(&listener->link);
-	stride = l->buffer->width * (PIXMAN_FORMAT_BPP(compositor->read_format) / 8);
-	pixels = malloc(stride * l->buffer->height);
 
-	if (pixels == NULL) {
-		l->done(l->data, WESTON_SCREENSHOOTER_NO_MEMORY);
+	switch (format) {
+	case PIXMAN_a8r8g8b8:
+	case PIXMAN_x8r8g8b8:
+		swap_rb = false;
+		break;
+	case PIXMAN_x8b8g8r8:
+	case PIXMAN_a8b8g8r8:
+		swap_rb = true;
+		break;
+	default:
+		l->done(l->data, WESTON_SCREENSHOOTER_BAD_BUFFER);
 		free(l);
 		return;
 	}
 
-	compositor->renderer->read_pixels(output,
-			     compositor->read_format, pixels,
-			     0, 0, output->current_mode->width,
-			     output->current_mode->height);
-
+	yflip = compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP;
+	row_bytes = width * (PIXMAN_FORMAT_BPP(format) / 8);
 	stride = wl_shm_buffer_get_stride(l->buffer->shm_buffer);
-
 	d = wl_shm_buffer_get_data(l->buffer->shm_buffer);
-	s = pixels + stride * (l->buffer->height - 1);
 
-	wl_shm_buffer_begin_access(l->buffer->shm_buffer);
+	/* The renderer already produces the client's layout: read straight
+	 * into the client buffer. */
+	if (!yflip && !swap_rb && stride == row_bytes) {
+		wl_shm_buffer_begin_access(l->buffer->shm_buffer);
+		compositor->renderer->read_pixels(output, format, d,
+						  0, 0, width, height);
+		wl_shm_buffer_end_access(l->buffer->shm_buffer);
 
-	switch (compositor->read_format) {
-	case PIXMAN_a8r8g8b8:
-	case PIXMAN_x8r8g8b8:
-		if (compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP)
-			copy_bgra_yflip(d, s, output->current_mode->height, stride);
-		else
-			copy_bgra(d, pixels, output->current_mode->height, stride);
-		break;
-	case PIXMAN_x8b8g8r8:
-	case PIXMAN_a8b8g8r8:
-		if (compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP)
-			copy_rgba_yflip(d, s, output->current_mode->height, stride);
-		else
-			copy_rgba(d, pixels, output->current_mode->height, stride);
-		break;
-	default:
-		break;
+		l->done(l->data, WESTON_SCREENSHOOTER_SUCCESS);
+		free(l);
+		return;
+	}
+
+	pixels = malloc(row_bytes * height);
+	if (pixels == NULL) {
+		l->done(l->data, WESTON_SCREENSHOOTER_NO_MEMORY);
+		free(l);
+		return;
 	}
 
+	compositor->renderer->read_pixels(output, format, pixels,
+					  0, 0, width, height);
+
+	wl_shm_buffer_begin_access(l->buffer->shm_buffer);
+	copy_rows(d, stride, pixels, row_bytes, row_bytes, height,
+		  yflip, swap_rb);
 	wl_shm_buffer_end_access(l->buffer->shm_buffer);
 
 	l->done(l->data, WESTON_SCREENSHOOTER_SUCCESS);
@@ -208,20 +231,298 @@ weston_screenshooter_shoot(struct weston_output *output,
 	l->data = data;
 	l->listener.notify = screenshooter_frame_notify;
 	wl_signal_add(&output->frame_signal, &l->listener);
+
+	/* The renderer's buffer still holds the last composited frame. With
+	 * planes disabled, only the views leaving their planes get damaged,
+	 * so the next repaint need not redraw the whole output. */
 	weston_output_disable_planes_incr(output);
-	weston_output_damage(output);
+	weston_output_schedule_repaint(output);
+
+	return 0;
+}
+
+/* All the capture streams of one output share a single read-back of the
+ * damage into one persistent image. */
+struct weston_capture_source {
+	struct weston_output *output;
+	struct wl_listener frame_listener;
+	struct wl_listener output_destroy_listener;
+	struct wl_list stream_list;
+	pixman_image_t *image;
+	uint32_t *rect;
+	size_t rect_size;
+	uint32_t seq;
+	bool full;		/* the image is stale, read all of it */
+	bool delivering;
+	bool destroying;
+};
+
+struct weston_capture_stream {
+	struct weston_capture_source *source;
+	struct wl_list link;
+	weston_capture_stream_func_t frame;
+	void *data;
+	bool first;
+};
+
+static void
+capture_source_destroy(struct weston_capture_source *source)
+{
+	struct weston_capture_stream *stream, *tmp;
+
+	wl_list_for_each_safe(stream, tmp, &source->stream_list, link) {
+		stream->source = NULL;
+		wl_list_remove(&stream->link);
+		wl_list_init(&stream->link);
+	}
+
+	wl_list_remove(&source->frame_listener.link);
+	wl_list_remove(&source->output_destroy_listener.link);
+	weston_output_disable_planes_decr(source->output);
+
+	if (source->image)
+		pixman_image_unref(source->image);
+	free(source->rect);
+	free(source);
+}
+
+/* Reads one rectangle, in buffer coordinates, into the source image. */
+static int
+capture_source_read_rect(struct weston_capture_source *source,
+			 pixman_box32_t *r)
+{
+	struct weston_output *output = source->output;
+	struct weston_compositor *compositor = output->compositor;
+	pixman_format_code_t format = pixman_image_get_format(source->image);
+	int bpp = PIXMAN_FORMAT_BPP(format) / 8;
+	int width = r->x2 - r->x1;
+	int height = r->y2 - r->y1;
+	int stride = pixman_image_get_stride(source->image);
+	uint8_t *dst = (uint8_t *) pixman_image_get_data(source->image);
+	size_t size = (size_t) width * height * bpp;
+	bool yflip;
+	int y_orig;
+
+	if (size > source->rect_size) {
+		free(source->rect);
+		source->rect = malloc(size);
+		if (!source->rect) {
+			source->rect_size = 0;
+			return -1;
+		}
+		source->rect_size = size;
+	}
+
+	yflip = compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP;
+	if (yflip)
+		y_orig = output->current_mode->height - r->y2;
+	else
+		y_orig = r->y1;
+
+	compositor->renderer->read_pixels(output, format, source->rect,
+					  r->x1, y_orig, width, height);
+
+	copy_rows(dst + r->y1 * stride + r->x1 * bpp, stride,
+		  (uint8_t *) source->rect, width * bpp, width * bpp, height,
+		  yflip, false);
 
 	return 0;
 }
 
+static void
+capture_source_frame_notify(struct wl_listener *listener, void *data)
+{
+	struct weston_capture_source *source =
+		container_of(listener, struct weston_capture_source,
+			     frame_listener);
+	struct weston_output *output = source->output;
+	struct weston_compositor *compositor = output->compositor;
+	struct weston_capture_stream *stream, *tmp;
+	struct weston_capture_frame frame;
+	pixman_region32_t damage, whole;
+	pixman_box32_t *r;
+	int width = output->current_mode->width;
+	int height = output->current_mode->height;
+	int i, n;
+
+	if (!source->image ||
+	    pixman_image_get_format(source->image) != compositor->read_format ||
+	    pixman_image_get_width(source->image) != width ||
+	    pixman_image_get_height(source->image) != height) {
+		if (source->image)
+			pixman_image_unref(source->image);
+		source->image = pixman_image_create_bits(compositor->read_format,
+							 width, height,
+							 NULL, 0);
+		if (!source->image)
+			return;
+		source->full = true;
+	}
+
+	pixman_region32_init_rect(&whole, 0, 0, width, height);
+	pixman_region32_init(&damage);
+	if (source->full) {
+		pixman_region32_copy(&damage, &whole);
+	} else {
+		pixman_region32_intersect(&damage, &output->region, data);
+		pixman_region32_translate(&damage, -output->x, -output->y);
+		weston_transformed_region(output->width, output->height,
+					  output->transform,
+					  output->current_scale,
+					  &damage, &damage);
+		pixman_region32_intersect(&damage, &damage, &whole);
+	}
+
+	r = pixman_region32_rectangles(&damage, &n);
+	for (i = 0; i < n; i++) {
+		if (capture_source_read_rect(source, &r[i]) < 0) {
+			weston_log("capture: out of memory reading output %s\n",
+				   output->name);
+			source->full = true;
+			goto out;
+		}
+	}
+	source->full = false;
+
+	frame.output = output;
+	frame.seq = ++source->seq;
+	frame.frame_time = &output->frame_time;
+	frame.image = source->image;
+
+	source->delivering = true;
+	wl_list_for_each_safe(stream, tmp, &source->stream_list, link) {
+		frame.damage = stream->first ? &whole : &damage;
+		stream->first = false;
+		stream->frame(&frame, stream->data);
+	}
+	source->delivering = false;
+
+out:
+	pixman_region32_fini(&damage);
+	pixman_region32_fini(&whole);
+
+	if (source->destroying)
+		capture_source_destroy(source);
+}
+
+static void
+capture_source_output_destroy(struct wl_listener *listener, void *data)
+{
+	struct weston_capture_source *source =
+		container_of(listener, struct weston_capture_source,
+			     output_destroy_listener);
+
+	capture_source_destroy(source);
+}
+
+static struct weston_capture_source *
+capture_source_get(struct weston_output *output)
+{
+	struct weston_capture_source *source;
+	struct wl_listener *listener;
+
+	listener = wl_signal_get(&output->frame_signal,
+				 capture_source_frame_notify);
+	if (listener)
+		return container_of(listener, struct weston_capture_source,
+				    frame_listener);
+
+	source = zalloc(sizeof *source);
+	if (!source)
+		return NULL;
+
+	source->output = output;
+	source->full = true;
+	wl_list_init(&source->stream_list);
+
+	source->frame_listener.notify = capture_source_frame_notify;
+	wl_signal_add(&output->frame_signal, &source->frame_listener);
+	source->output_destroy_listener.notify = capture_source_output_destroy;
+	wl_signal_add(&output->destroy_signal,
+		      &source->output_destroy_listener);
+
+	/* Views on planes never reach the renderer's buffer */
+	weston_output_disable_planes_incr(output);
+
+	return source;
+}
+
+/** Start receiving the content of an output as it changes
+ *
+ * \param output The output to capture.
+ * \param frame Called after every repaint of the output.
+ * \param data User data passed to \c frame.
+ * \return The new stream, or NULL on failure.
+ *
+ * All the streams of an output share one read-back: only the damaged part
+ * of the output is read from the renderer, once per repaint, no matter how
+ * many subscribers there are. If the output goes away, the stream stops
+ * receiving frames but still has to be unsubscribed.
+ */
+WL_EXPORT struct weston_capture_stream *
+weston_capture_stream_subscribe(struct weston_output *output,
+				weston_capture_stream_func_t frame,
+				void *data)
+{
+	struct weston_capture_source *source;
+	struct weston_capture_stream *stream;
+
+	stream = zalloc(sizeof *stream);
+	if (!stream)
+		return NULL;
+
+	source = capture_source_get(output);
+	if (!source) {
+		free(stream);
+		return NULL;
+	}
+	source->destroying = false;
+
+	stream->source = source;
+	stream->frame = frame;
+	stream->data = data;
+	stream->first = true;
+	wl_list_insert(source->stream_list.prev, &stream->link);
+
+	weston_output_schedule_repaint(output);
+
+	return stream;
+}
+
+/** Stop a capture stream
+ *
+ * \param stream The stream to stop; may be called from its frame callback.
+ */
+WL_EXPORT void
+weston_capture_stream_unsubscribe(struct weston_capture_stream *stream)
+{
+	struct weston_capture_source *source = stream->source;
+
+	wl_list_remove(&stream->link);
+	free(stream);
+
+	if (!source || !wl_list_empty(&source->stream_list))
+		return;
+
+	if (source->delivering)
+		source->destroying = true;
+	else
+		capture_source_destroy(source);
+}
+
+/* Lets wcap-decode start decoding at a key frame instead of the first one */
+#define WCAP_KEY_FRAME_INTERVAL_MS 2000
+
 struct weston_recorder {
 	struct weston_output *output;
-	uint32_t *frame, *rect;
+	struct weston_capture_stream *stream;
+	uint32_t *frame;
 	uint32_t *tmpbuf;
-	uint32_t total;
+	uint64_t total;
 	int fd;
-	struct wl_listener frame_listener;
 	int count, destroying;
+	uint32_t key_msecs;
+	struct wl_array index;
 };
 
 static uint32_t *
@@ -259,49 +560,48 @@ static void
 weston_recorder_destroy(struct weston_recorder *recorder);
 
 static void
-weston_recorder_frame_notify(struct wl_listener *listener, void *data)
+weston_recorder_frame_notify(struct weston_capture_frame *frame, void *data)
 {
-	struct weston_recorder *recorder =
-		container_of(listener, struct weston_recorder, frame_listener);
+	struct weston_recorder *recorder = data;
 	struct weston_output *output = recorder->output;
-	struct weston_compositor *compositor = output->compositor;
-	uint32_t msecs = timespec_to_msec(&output->frame_time);
-	pixman_box32_t *r;
-	pixman_region32_t damage, transformed_damage;
-	int i, j, k, n, width, height, run, stride;
-	uint32_t delta, prev, *d, *s, *p, next;
-	struct {
-		uint32_t msecs;
-		uint32_t nrects;
-	} header;
+	uint32_t msecs = timespec_to_msec(frame->frame_time);
+	pixman_box32_t *r, whole;
+	int i, j, k, n, width, height, run, stride, image_stride;
+	uint32_t delta, prev, *d, *s, *p, next, *image;
+	struct wcap_frame_header header;
+	struct wcap_index_entry *entry;
 	struct iovec v[2];
-	int do_yflip;
 	int y_orig;
-	uint32_t *outbuf;
+	bool key;
 
-	do_yflip = !!(compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP);
-	if (do_yflip)
-		outbuf = recorder->rect;
-	else
-		outbuf = recorder->tmpbuf;
+	r = pixman_region32_rectangles(frame->damage, &n);
+	if (n == 0)
+		goto out;
 
-	pixman_region32_init(&damage);
-	pixman_region32_init(&transformed_damage);
-	pixman_region32_intersect(&damage, &output->region, data);
-	pixman_region32_translate(&damage, -output->x, -output->y);
-	weston_transformed_region(output->width, output->height,
-				 output->transform, output->current_scale,
-				 &damage, &transformed_damage);
-	pixman_region32_fini(&damage);
+	header.msecs = msecs;
+	header.nrects = n;
 
-	r = pixman_region32_rectangles(&transformed_damage, &n);
-	if (n == 0) {
-		pixman_region32_fini(&transformed_damage);
-		return;
+	key = recorder->count == 0 ||
+	      msecs - recorder->key_msecs >= WCAP_KEY_FRAME_INTERVAL_MS;
+	if (key) {
+		entry = wl_array_add(&recorder->index, sizeof *entry);
+		if (entry) {
+			entry->offset = recorder->total;
+			entry->frame = recorder->count;
+			entry->msecs = msecs;
+		}
+
+		whole.x1 = 0;
+		whole.y1 = 0;
+		whole.x2 = output->current_mode->width;
+		whole.y2 = output->current_mode->height;
+		r = &whole;
+		n = 1;
+		header.nrects = 1 | WCAP_FRAME_KEY;
+		memset(recorder->frame, 0, whole.x2 * whole.y2 * 4);
+		recorder->key_msecs = msecs;
 	}
 
-	header.msecs = msecs;
-	header.nrects = n;
 	v[0].iov_base = &header;
 	v[0].iov_len = sizeof header;
 	v[1].iov_base = r;
@@ -309,27 +609,18 @@ weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 	recorder->total += writev(recorder->fd, v, 2);
 	stride = output->current_mode->width;
 
+	image = pixman_image_get_data(frame->image);
+	image_stride = pixman_image_get_stride(frame->image) / 4;
+
 	for (i = 0; i < n; i++) {
 		width = r[i].x2 - r[i].x1;
 		height = r[i].y2 - r[i].y1;
 
-		if (do_yflip)
-			y_orig = output->current_mode->height - r[i].y2;
-		else
-			y_orig = r[i].y1;
-
-		compositor->renderer->read_pixels(output,
-				compositor->read_format, recorder->rect,
-				r[i].x1, y_orig, width, height);
-
-		p = outbuf;
+		p = recorder->tmpbuf;
 		run = prev = 0; /* quiet gcc */
 		for (j = 0; j < height; j++) {
-			if (do_yflip)
-				s = recorder->rect + width * j;
-			else
-				s = recorder->rect + width * (height - j - 1);
 			y_orig = r[i].y2 - j - 1;
+			s = image + image_stride * y_orig + r[i].x1;
 			d = recorder->frame + stride * y_orig + r[i].x1;
 
 			for (k = 0; k < width; k++) {
@@ -349,21 +640,13 @@ weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 		p = output_run(p, prev, run);
 
 		recorder->total += write(recorder->fd,
-					 outbuf, (p - outbuf) * 4);
-
-#if 0
-		fprintf(stderr,
-			"%dx%d at %d,%d rle from %d to %d bytes (%f) total %dM\n",
-			width, height, r[i].x1, r[i].y1,
-			width * height * 4, (int) (p - outbuf) * 4,
-			(float) (p - outbuf) / (width * height),
-			recorder->total / 1024 / 1024);
-#endif
+					 recorder->tmpbuf,
+					 (p - recorder->tmpbuf) * 4);
 	}
 
-	pixman_region32_fini(&transformed_damage);
 	recorder->count++;
 
+out:
 	if (recorder->destroying)
 		weston_recorder_destroy(recorder);
 }
@@ -374,8 +657,8 @@ weston_recorder_free(struct weston_recorder *recorder)
 	if (recorder == NULL)
 		return;
 
+	wl_array_release(&recorder->index);
 	free(recorder->tmpbuf);
-	free(recorder->rect);
 	free(recorder->frame);
 	free(recorder);
 }
@@ -387,9 +670,6 @@ weston_recorder_create(struct weston_output *output, const char *filename)
 	struct weston_recorder *recorder;
 	int stride, size;
 	struct { uint32_t magic, format, width, height; } header;
-	int do_yflip;
-
-	do_yflip = !!(compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP);
 
 	recorder = zalloc(sizeof *recorder);
 	if (recorder == NULL) {
@@ -397,25 +677,19 @@ weston_recorder_create(struct weston_output *output, const char *filename)
 		return NULL;
 	}
 
+	wl_array_init(&recorder->index);
+
 	stride = output->current_mode->width;
 	size = stride * 4 * output->current_mode->height;
 	recorder->frame = zalloc(size);
-	recorder->rect = malloc(size);
+	recorder->tmpbuf = malloc(size);
 	recorder->output = output;
 
-	if ((recorder->frame == NULL) || (recorder->rect == NULL)) {
+	if ((recorder->frame == NULL) || (recorder->tmpbuf == NULL)) {
 		weston_log("%s: out of memory\n", __func__);
 		goto err_recorder;
 	}
 
-	if (!do_yflip) {
-		recorder->tmpbuf = malloc(size);
-		if (recorder->tmpbuf == NULL) {
-			weston_log("%s: out of memory\n", __func__);
-			goto err_recorder;
-		}
-	}
-
 	header.magic = WCAP_HEADER_MAGIC;
 
 	switch (compositor->read_format) {
@@ -444,10 +718,14 @@ weston_recorder_create(struct weston_output *output, const char *filename)
 	header.height = output->current_mode->height;
 	recorder->total += write(recorder->fd, &header, sizeof header);
 
-	recorder->frame_listener.notify = weston_recorder_frame_notify;
-	wl_signal_add(&output->frame_signal, &recorder->frame_listener);
-	weston_output_disable_planes_incr(output);
-	weston_output_damage(output);
+	recorder->stream =
+		weston_capture_stream_subscribe(output,
+						weston_recorder_frame_notify,
+						recorder);
+	if (!recorder->stream) {
+		close(recorder->fd);
+		goto err_recorder;
+	}
 
 	return recorder;
 
@@ -456,26 +734,53 @@ err_recorder:
 	return NULL;
 }
 
+static void
+weston_recorder_write_index(struct weston_recorder *recorder)
+{
+	struct wcap_index_footer footer;
+	struct iovec v[2];
+
+	footer.magic = WCAP_INDEX_MAGIC;
+	footer.count = recorder->index.size / sizeof(struct wcap_index_entry);
+	v[0].iov_base = recorder->index.data;
+	v[0].iov_len = recorder->index.size;
+	v[1].iov_base = &footer;
+	v[1].iov_len = sizeof footer;
+
+	if (writev(recorder->fd, v, 2) < 0)
+		weston_log("failed to write the recording index: %s\n",
+			   strerror(errno));
+}
+
 static void
 weston_recorder_destroy(struct weston_recorder *recorder)
 {
-	wl_list_remove(&recorder->frame_listener.link);
+	weston_capture_stream_unsubscribe(recorder->stream);
+	weston_recorder_write_index(recorder);
 	close(recorder->fd);
-	weston_output_disable_planes_decr(recorder->output);
 	weston_recorder_free(recorder);
 }
 
 WL_EXPORT struct weston_recorder *
 weston_recorder_start(struct weston_output *output, const char *filename)
 {
+	struct weston_capture_source *source;
+	struct weston_capture_stream *stream;
 	struct wl_listener *listener;
 
 	listener = wl_signal_get(&output->frame_signal,
-				 weston_recorder_frame_notify);
+				 capture_source_frame_notify);
 	if (listener) {
-		weston_log("a recorder on output %s is already running\n",
-			   output->name);
-		return NULL;
+		source = container_of(listener, struct weston_capture_source,
+				      frame_listener);
+		wl_list_for_each(stream, &source->stream_list, link) {
+			if (stream->frame != weston_recorder_frame_notify)
+				continue;
+
+			weston_log("a recorder on output %s is already running\n",
+				   output->name);
+			return NULL;
+		}
 	}
 
 	weston_log("starting recorder for output %s, file %s\n",
@@ -486,7 +791,8 @@ weston_recorder_start(struct weston_output *output, const char *filename)
 WL_EXPORT void
 weston_recorder_stop(struct weston_recorder *recorder)
 {
-	weston_log("stopping recorder, total file size %dM, %d frames\n",
+	weston_log("stopping recorder, total file size %" PRIu64 "M, "
+		   "%d frames\n",
 		   recorder->total / (1024 * 1024), recorder->count);
 
 	recorder->destroying = 1;
@@ -85,12 +85,24 @@ struct pipewire_output {
 
 	struct spa_video_info_raw video_format;
 
+	/* Damage in buffer coordinates not yet folded into the buffers */
+	pixman_region32_t damage;
+	struct wl_listener frame_listener;
+	struct wl_list buffer_list;
+
 	struct wl_event_source *finish_frame_timer;
 	struct wl_list link;
 	bool submitted_frame;
 	enum dpms_enum dpms;
 };
 
+/* Attached to each pw_buffer: what the buffer is missing compared to the
+ * latest frame, so only that has to be copied when it is dequeued again. */
+struct pipewire_buffer {
+	struct wl_list link;
+	pixman_region32_t damage;
+};
+
 struct pipewire_frame_data {
 	struct pipewire_output *output;
 	int fd;
@@ -178,6 +190,62 @@ lookup_pipewire_output(struct weston_output *base_output)
 	return NULL;
 }
 
+static void
+pipewire_output_damage_all(struct pipewire_output *output)
+{
+	pixman_region32_fini(&output->damage);
+	pixman_region32_init_rect(&output->damage, 0, 0,
+				  output->video_format.size.width,
+				  output->video_format.size.height);
+}
+
+static void
+pipewire_output_frame_notify(struct wl_listener *listener, void *data)
+{
+	struct pipewire_output *output =
+		wl_container_of(listener, output, frame_listener);
+	struct weston_output *base = output->output;
+	pixman_region32_t *frame_damage = data;
+	pixman_region32_t damage;
+
+	pixman_region32_init(&damage);
+	pixman_region32_intersect(&damage, &base->region, frame_damage);
+	pixman_region32_translate(&damage, -base->x, -base->y);
+	weston_transformed_region(base->width, base->height,
+				  base->transform, base->current_scale,
+				  &damage, &damage);
+	pixman_region32_union(&output->damage, &output->damage, &damage);
+	pixman_region32_fini(&damage);
+}
+
+static void
+pipewire_output_copy_damage(struct pipewire_output *output,
+			    pixman_region32_t *damage,
+			    uint8_t *dst, int dst_stride,
+			    const uint8_t *src, int src_stride)
+{
+	const int bpp = 4;
+	pixman_box32_t *rects;
+	size_t offset, len;
+	int i, n, y;
+
+	pixman_region32_intersect_rect(damage, damage, 0, 0,
+				       output->video_format.size.width,
+				       output->video_format.size.height);
+
+	rects = pixman_region32_rectangles(damage, &n);
+	for (i = 0; i < n; i++) {
+		len = (rects[i].x2 - rects[i].x1) * bpp;
+		for (y = rects[i].y1; y < rects[i].y2; y++) {
+			offset = rects[i].x1 * bpp;
+			memcpy(dst + y * dst_stride + offset,
+			       src + y * src_stride + offset, len);
+		}
+	}
+
+	pixman_region32_clear(damage);
+}
+
 static void
 pipewire_output_handle_frame(struct pipewire_output *output, int fd,
 			     int stride, struct drm_fb *drm_buffer)
@@ -185,23 +253,43 @@ pipewire_output_handle_frame(struct pipewire_output *output, int fd,
 	const struct weston_drm_virtual_output_api *api =
 		output->pipewire->virtual_output_api;
 	size_t size = output->output->height * stride;
+	int dst_stride = output->video_format.size.width * 4;
 	struct pw_type *t = output->pipewire->t;
 	struct pw_buffer *buffer;
 	struct spa_buffer *spa_buffer;
 	struct spa_meta_header *h;
+	struct pipewire_buffer *pw_buffer;
+	pixman_region32_t full, *damage;
 	void *ptr;
 
 	if (pw_stream_get_state(output->stream, NULL) !=
 	    PW_STREAM_STATE_STREAMING)
 		goto out;
 
+	/* The consumer already has the latest content. */
+	if (!pixman_region32_not_empty(&output->damage)) {
+		pipewire_output_debug(output, "skip frame: no damage");
+		goto out;
+	}
+
 	buffer = pw_stream_dequeue_buffer(output->stream);
 	if (!buffer) {
 		weston_log("Failed to dequeue a pipewire buffer\n");
 		goto out;
 	}
 
+	wl_list_for_each(pw_buffer, &output->buffer_list, link)
+		pixman_region32_union(&pw_buffer->damage, &pw_buffer->damage,
+				      &output->damage);
+	pixman_region32_clear(&output->damage);
+
 	spa_buffer = buffer->buffer;
+	pw_buffer = buffer->user_data;
+
+	pixman_region32_init_rect(&full, 0, 0,
+				  output->video_format.size.width,
+				  output->video_format.size.height);
+	damage = pw_buffer ? &pw_buffer->damage : &full;
 
 	if ((h = spa_buffer_find_meta(spa_buffer, t->meta.Header))) {
 		h->pts = -1;
@@ -211,11 +299,20 @@ pipewire_output_handle_frame(struct pipewire_output *output, int fd,
 	}
 
 	ptr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
-	memcpy(spa_buffer->datas[0].data, ptr, size);
-	munmap(ptr, size);
+	if (ptr == MAP_FAILED) {
+		weston_log("Failed to map the virtual output buffer: %s\n",
+			   strerror(errno));
+		pixman_region32_union(damage, damage, &full);
+	} else {
+		pipewire_output_copy_damage(output, damage,
+					    spa_buffer->datas[0].data,
+					    dst_stride, ptr, stride);
+		munmap(ptr, size);
+	}
+	pixman_region32_fini(&full);
 
 	spa_buffer->datas[0].chunk->offset = 0;
-	spa_buffer->datas[0].chunk->stride = stride;
+	spa_buffer->datas[0].chunk->stride = dst_stride;
 	spa_buffer->datas[0].chunk->size = spa_buffer->datas[0].maxsize;
 
 	pipewire_output_debug(output, "push frame");
@@ -340,6 +437,7 @@ pipewire_output_destroy(struct weston_output *base_output)
 	output->saved_destroy(base_output);
 
 	pw_stream_destroy(output->stream);
+	pixman_region32_fini(&output->damage);
 
 	wl_list_remove(&output->link);
 	weston_head_release(output->head);
@@ -446,6 +544,9 @@ pipewire_output_enable(struct weston_output *base_output)
 					output);
 	output->dpms = WESTON_DPMS_ON;
 
+	output->frame_listener.notify = pipewire_output_frame_notify;
+	wl_signal_add(&base_output->frame_signal, &output->frame_listener);
+
 	return 0;
 }
 
@@ -455,6 +556,7 @@ pipewire_output_disable(struct weston_output *base_output)
 	struct pipewire_output *output = lookup_pipewire_output(base_output);
 
 	wl_event_source_remove(output->finish_frame_timer);
+	wl_list_remove(&output->frame_listener.link);
 
 	pw_stream_disconnect(output->stream);
 
@@ -474,6 +576,7 @@ pipewire_output_stream_state_changed(void *data, enum pw_stream_state old,
 
 	switch (state) {
 	case PW_STREAM_STATE_STREAMING:
+		pipewire_output_damage_all(output);
 		weston_output_schedule_repaint(output->output);
 		break;
 	default:
@@ -529,10 +632,44 @@ pipewire_output_stream_format_changed(void *data, const struct spa_pod *format)
 	pw_stream_finish_format(output->stream, 0, params, 2);
 }
 
+static void
+pipewire_output_stream_add_buffer(void *data, struct pw_buffer *buffer)
+{
+	struct pipewire_output *output = data;
+	struct pipewire_buffer *pw_buffer;
+
+	pw_buffer = zalloc(sizeof *pw_buffer);
+	if (!pw_buffer)
+		return;
+
+	/* Nothing has been copied into a new buffer yet. */
+	pixman_region32_init_rect(&pw_buffer->damage, 0, 0,
+				  output->video_format.size.width,
+				  output->video_format.size.height);
+	wl_list_insert(&output->buffer_list, &pw_buffer->link);
+	buffer->user_data = pw_buffer;
+}
+
+static void
+pipewire_output_stream_remove_buffer(void *data, struct pw_buffer *buffer)
+{
+	struct pipewire_buffer *pw_buffer = buffer->user_data;
+
+	if (!pw_buffer)
+		return;
+
+	wl_list_remove(&pw_buffer->link);
+	pixman_region32_fini(&pw_buffer->damage);
+	free(pw_buffer);
+	buffer->user_data = NULL;
+}
+
 static const struct pw_stream_events stream_events = {
 	PW_VERSION_STREAM_EVENTS,
 	.state_changed = pipewire_output_stream_state_changed,
 	.format_changed = pipewire_output_stream_format_changed,
+	.add_buffer = pipewire_output_stream_add_buffer,
+	.remove_buffer = pipewire_output_stream_remove_buffer,
 };
 
 static struct weston_output *
@@ -556,6 +693,9 @@ pipewire_output_create(struct weston_compositor *c, char *name)
 	if (!output)
 		return NULL;
 
+	pixman_region32_init(&output->damage);
+	wl_list_init(&output->buffer_list);
+
 	head = zalloc(sizeof *head);
 	if (!head)
 		goto err;
@@ -600,6 +740,7 @@ err:
 		pw_stream_destroy(output->stream);
 	if (head)
 		free(head);
+	pixman_region32_fini(&output->damage);
 	free(output);
 	return NULL;
 }
@@ -52,6 +52,13 @@
 
 #define MAX_RETRY_COUNT	3
 
+/* Push a frame at least this often even when nothing changed, so that
+ * receivers joining late and encoders waiting for a keyframe catch up. */
+#define IDLE_FRAME_INTERVAL_MS	1000
+
+/* Above this many damage rectangles, hint the encoder with their extents */
+#define MAX_ROI_RECTS	16
+
 struct weston_remoting {
 	struct weston_compositor *compositor;
 	struct wl_list output_list;
@@ -120,6 +127,19 @@ struct remoted_output {
 	GstClockTime start_time;
 	int retry_count;
 	enum dpms_enum dpms;
+
+	/* Damage in buffer coordinates since the last pushed frame */
+	pixman_region32_t damage;
+	struct wl_listener frame_listener;
+	struct timespec last_push;
+	struct wl_event_source *idle_frame_timer;
+
+	struct {
+		uint32_t pushed;
+		uint32_t skipped;
+		uint64_t damaged_pixels;
+		uint64_t total_pixels;
+	} stats;
 };
 
 struct mem_free_cb_data {
@@ -274,6 +294,53 @@ err:
 	return -1;
 }
 
+static void
+remoting_output_damage_all(struct remoted_output *output)
+{
+	struct weston_mode *mode = output->output->current_mode;
+
+	pixman_region32_fini(&output->damage);
+	pixman_region32_init_rect(&output->damage, 0, 0,
+				  mode->width, mode->height);
+}
+
+static void
+remoting_output_frame_notify(struct wl_listener *listener, void *data)
+{
+	struct remoted_output *output =
+		wl_container_of(listener, output, frame_listener);
+	struct weston_output *base = output->output;
+	pixman_region32_t *frame_damage = data;
+	pixman_region32_t damage;
+
+	pixman_region32_init(&damage);
+	pixman_region32_intersect(&damage, &base->region, frame_damage);
+	pixman_region32_translate(&damage, -base->x, -base->y);
+	weston_transformed_region(base->width, base->height,
+				  base->transform, base->current_scale,
+				  &damage, &damage);
+	pixman_region32_union(&output->damage, &output->damage, &damage);
+	pixman_region32_fini(&damage);
+}
+
+static void
+remoting_output_report_stats(struct remoted_output *output)
+{
+	uint32_t frames = output->stats.pushed + output->stats.skipped;
+
+	if (frames == 0)
+		return;
+
+	weston_log("remoting: %s: %u frames, %u pushed, %u skipped, "
+		   "%.1f%% of pushed pixels damaged\n",
+		   output->output->name, frames, output->stats.pushed,
+		   output->stats.skipped,
+		   output->stats.total_pixels ?
+			100.0 * output->stats.damaged_pixels /
+				output->stats.total_pixels : 0.0);
+	memset(&output->stats, 0, sizeof output->stats);
+}
+
 static void
 remoting_gst_pipeline_deinit(struct remoted_output *output)
 {
@@ -298,7 +365,11 @@ remoting_gst_restart(void *data)
 	if (remoting_gst_pipeline_init(output) < 0) {
 		weston_log("gst: Could not restart pipeline!!\n");
 		remoting_output_disable(output->output);
+		return;
 	}
+
+	/* The new pipeline has not seen anything yet. */
+	remoting_output_damage_all(output);
 }
 
 static void
@@ -545,6 +616,55 @@ remoting_output_gst_push_buffer(struct remoted_output *output,
 	output->submitted_frame = true;
 }
 
+/* Tell the encoder which areas changed, then start over for the next frame. */
+static void
+remoting_output_add_damage_meta(struct remoted_output *output, GstBuffer *buf)
+{
+	struct weston_mode *mode = output->output->current_mode;
+	pixman_box32_t *rects, *extents;
+	int i, n;
+
+	rects = pixman_region32_rectangles(&output->damage, &n);
+	if (n > MAX_ROI_RECTS) {
+		extents = pixman_region32_extents(&output->damage);
+		rects = extents;
+		n = 1;
+	}
+
+	for (i = 0; i < n; i++) {
+		gst_buffer_add_video_region_of_interest_meta(buf, "damage",
+			rects[i].x1, rects[i].y1,
+			rects[i].x2 - rects[i].x1,
+			rects[i].y2 - rects[i].y1);
+		output->stats.damaged_pixels +=
+			(uint64_t)(rects[i].x2 - rects[i].x1) *
+			(rects[i].y2 - rects[i].y1);
+	}
+
+	output->stats.total_pixels += (uint64_t)mode->width * mode->height;
+	output->stats.pushed++;
+
+	weston_compositor_read_presentation_clock(output->remoting->compositor,
+						  &output->last_push);
+	pixman_region32_clear(&output->damage);
+
+	/* Without damage the compositor has no reason to repaint, so the
+	 * next idle frame has to be asked for. */
+	wl_event_source_timer_update(output->idle_frame_timer,
+				     IDLE_FRAME_INTERVAL_MS);
+}
+
+static int
+remoting_output_idle_frame_handler(void *data)
+{
+	struct remoted_output *output = data;
+
+	if (output->dpms == WESTON_DPMS_ON)
+		weston_output_schedule_repaint(output->output);
+
+	return 0;
+}
+
 static int
 remoting_output_fence_sync_handler(int fd, uint32_t mask, void *data)
 {
@@ -575,15 +695,33 @@ remoting_output_frame(struct weston_output *output_base, int fd, int stride,
 	gsize offset = 0;
 	struct mem_free_cb_data *cb_data;
 	struct gst_frame_buffer_data *frame_data;
+	struct timespec now;
 
 	if (!output)
 		return -1;
 
+	mode = output->output->current_mode;
+	pixman_region32_intersect_rect(&output->damage, &output->damage,
+				       0, 0, mode->width, mode->height);
+
+	/* Nothing changed since the last pushed frame, don't make the
+	 * encoder and the network carry an identical one. */
+	weston_compositor_read_presentation_clock(remoting->compositor, &now);
+	if (!pixman_region32_not_empty(&output->damage) &&
+	    !timespec_is_zero(&output->last_push) &&
+	    timespec_sub_to_msec(&now, &output->last_push) <
+	    IDLE_FRAME_INTERVAL_MS) {
+		close(fd);
+		api->buffer_released(output_buffer);
+		output->submitted_frame = true;
+		output->stats.skipped++;
+		return 0;
+	}
+
 	cb_data = zalloc(sizeof *cb_data);
 	if (!cb_data)
 		return -1;
 
-	mode = output->output->current_mode;
 	buf = gst_buffer_new();
 	mem = gst_dmabuf_allocator_alloc(remoting->allocator, fd,
 					 stride * mode->height);
@@ -596,6 +734,7 @@ remoting_output_frame(struct weston_output *output_base, int fd, int stride,
 				       1,
 				       &offset,
 				       &stride);
+	remoting_output_add_damage_meta(output, buf);
 
 	cb_data->output = output;
 	cb_data->output_buffer = output_buffer;
@@ -644,6 +783,7 @@ remoting_output_destroy(struct weston_output *output)
 
 	remoting_gst_pipeline_deinit(remoted_output);
 	remoting_gstpipe_release(&remoted_output->gstpipe);
+	pixman_region32_fini(&remoted_output->damage);
 
 	if (remoted_output->host)
 		free(remoted_output->host);
@@ -714,8 +854,19 @@ remoting_output_enable(struct weston_output *output)
 		wl_event_loop_add_timer(loop,
 					remoting_output_finish_frame_handler,
 					remoted_output);
+	remoted_output->idle_frame_timer =
+		wl_event_loop_add_timer(loop,
+					remoting_output_idle_frame_handler,
+					remoted_output);
 
 	remoted_output->dpms = WESTON_DPMS_ON;
+
+	remoting_output_damage_all(remoted_output);
+	remoted_output->last_push.tv_sec = 0;
+	remoted_output->last_push.tv_nsec = 0;
+	remoted_output->frame_listener.notify = remoting_output_frame_notify;
+	wl_signal_add(&output->frame_signal, &remoted_output->frame_listener);
+
 	return 0;
 }
 
@@ -725,7 +876,11 @@ remoting_output_disable(struct weston_output *output)
 	struct remoted_output *remoted_output = lookup_remoted_output(output);
 
 	wl_event_source_remove(remoted_output->finish_frame_timer);
+	wl_event_source_remove(remoted_output->idle_frame_timer);
+	wl_list_remove(&remoted_output->frame_listener.link);
+	wl_list_init(&remoted_output->frame_listener.link);
 	remoting_gst_pipeline_deinit(remoted_output);
+	remoting_output_report_stats(remoted_output);
 
 	return remoted_output->saved_disable(output);
 }
@@ -751,6 +906,9 @@ remoting_output_create(struct weston_compositor *c, char *name)
 	if (!output)
 		return NULL;
 
+	pixman_region32_init(&output->damage);
+	wl_list_init(&output->frame_listener.link);
+
 	head = zalloc(sizeof *head);
 	if (!head)
 		goto err;
@@ -793,6 +951,7 @@ err:
 		remoting_gstpipe_release(&output->gstpipe);
 	if (head)
 		free(head);
+	pixman_region32_fini(&output->damage);
 	free(output);
 	return NULL;
 }
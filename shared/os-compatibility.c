@@ -33,6 +33,7 @@
 #include <sys/epoll.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <libweston/zalloc.h>
 #include <sys/mman.h>
 
@@ -237,6 +238,7 @@ strchrnul(const char *s, int c)
 struct ro_anonymous_file {
 	int fd;
 	size_t size;
+	bool sealed;
 };
 
 /** Create a new anonymous read-only file of the given size and the given data
@@ -282,7 +284,8 @@ os_ro_anonymous_file_create(size_t size,
 	 * sealed read-only and will instead create a new anonymous file on
 	 * each invocation.
 	 */
-	fcntl(file->fd, F_ADD_SEALS, READONLY_SEALS);
+	if (fcntl(file->fd, F_ADD_SEALS, READONLY_SEALS) == 0)
+		file->sealed = true;
 #endif
 
 	return file;
@@ -316,6 +319,21 @@ os_ro_anonymous_file_size(struct ro_anonymous_file *file)
 	return file->size;
 }
 
+/** Check whether an anonymous read-only file is sealed
+ *
+ * \param file The file to check.
+ * \return Whether the file could be sealed read-only when it was created.
+ *
+ * Only the file descriptor os_ro_anonymous_file_get_fd() returns for a
+ * sealed file with RO_ANONYMOUS_FILE_MAPMODE_PRIVATE can be sent to more
+ * than one client.
+ */
+bool
+os_ro_anonymous_file_is_sealed(struct ro_anonymous_file *file)
+{
+	return file->sealed;
+}
+
 /** Returns a file descriptor for the given file, ready to be send to a client.
  *
  * \param file The file for which to get a file descriptor.
@@ -324,7 +342,11 @@ os_ro_anonymous_file_size(struct ro_anonymous_file *file)
  * \return A file descriptor for the given file that can be send to a client
  * or -1 on failure.
  *
- * The returned file descriptor must not be shared between multiple clients.
+ * If the file is sealed (see os_ro_anonymous_file_is_sealed()) and \p mapmode
+ * is RO_ANONYMOUS_FILE_MAPMODE_PRIVATE, the file's own read-only file
+ * descriptor is returned, and it may be sent to any number of clients.
+ * Otherwise the returned file descriptor is a writable copy, which must not
+ * be shared between multiple clients.
  * When \p mapmode is RO_ANONYMOUS_FILE_MAPMODE_PRIVATE the file descriptor is
  * only guaranteed to be mmapable with \c MAP_PRIVATE, when \p mapmode is
  * RO_ANONYMOUS_FILE_MAPMODE_SHARED the file descriptor can be mmaped with
@@ -340,16 +362,12 @@ os_ro_anonymous_file_get_fd(struct ro_anonymous_file *file,
 	void *src, *dst;
 	int fd;
 
-#ifdef HAVE_MEMFD_CREATE
-	int seals = fcntl(file->fd, F_GET_SEALS);
-
 	/* file was sealed for read-only and we don't have to support MAP_SHARED
-	 * so we can simply pass the memfd fd
+	 * so we can simply pass the memfd fd, which is then shared by every
+	 * client the file is sent to
 	 */
-	if (seals != -1 && mapmode == RO_ANONYMOUS_FILE_MAPMODE_PRIVATE &&
-	    (seals & READONLY_SEALS) == READONLY_SEALS)
+	if (file->sealed && mapmode == RO_ANONYMOUS_FILE_MAPMODE_PRIVATE)
 		return file->fd;
-#endif
 
 	/* for all other cases we create a new anonymous file that can be mapped
 	 * with MAP_SHARED and copy the contents to it and return that instead
@@ -28,6 +28,7 @@
 
 #include "config.h"
 
+#include <stdbool.h>
 #include <sys/types.h>
 
 int
@@ -64,6 +65,9 @@ os_ro_anonymous_file_destroy(struct ro_anonymous_file *file);
 size_t
 os_ro_anonymous_file_size(struct ro_anonymous_file *file);
 
+bool
+os_ro_anonymous_file_is_sealed(struct ro_anonymous_file *file);
+
 int
 os_ro_anonymous_file_get_fd(struct ro_anonymous_file *file,
 			    enum ro_anonymous_file_mapmode mapmode);
@@ -0,0 +1,239 @@
+/*
+ * Copyright © 2021 Huawei Device Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libweston/libweston.h>
+#include "weston-test-runner.h"
+#include "weston-test-fixture-compositor.h"
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness)
+{
+	struct compositor_setup setup;
+
+	compositor_setup_defaults(&setup);
+	setup.renderer = RENDERER_PIXMAN;
+
+	return weston_test_harness_execute_as_plugin(harness, &setup);
+}
+DECLARE_FIXTURE_SETUP(fixture_setup);
+
+struct capture_subscriber {
+	struct weston_capture_stream *stream;
+	int frames;
+	uint32_t seq;
+	pixman_region32_t damage;
+	int unsubscribe_at;	/* unsubscribe from the callback on this frame */
+};
+
+static void
+subscriber_frame(struct weston_capture_frame *frame, void *data)
+{
+	struct capture_subscriber *sub = data;
+
+	assert(frame->image);
+	assert(frame->damage);
+
+	sub->frames++;
+	sub->seq = frame->seq;
+	pixman_region32_copy(&sub->damage, frame->damage);
+
+	if (sub->frames == sub->unsubscribe_at) {
+		weston_capture_stream_unsubscribe(sub->stream);
+		sub->stream = NULL;
+	}
+}
+
+static void
+subscriber_init(struct capture_subscriber *sub, struct weston_output *output)
+{
+	sub->frames = 0;
+	sub->seq = 0;
+	sub->unsubscribe_at = 0;
+	pixman_region32_init(&sub->damage);
+	sub->stream = weston_capture_stream_subscribe(output, subscriber_frame,
+						      sub);
+	assert(sub->stream);
+}
+
+static void
+subscriber_fini(struct capture_subscriber *sub)
+{
+	if (sub->stream)
+		weston_capture_stream_unsubscribe(sub->stream);
+	pixman_region32_fini(&sub->damage);
+}
+
+/* What a backend does once it has rendered the output: damage is in
+ * global coordinates, and may be empty. */
+static void
+repaint(struct weston_output *output, int x, int y, int width, int height)
+{
+	pixman_region32_t damage;
+
+	pixman_region32_init_rect(&damage, x, y, width, height);
+	wl_signal_emit(&output->frame_signal, &damage);
+	pixman_region32_fini(&damage);
+}
+
+static bool
+damage_is(pixman_region32_t *damage, int x, int y, int width, int height)
+{
+	pixman_box32_t *box;
+	int n;
+
+	box = pixman_region32_rectangles(damage, &n);
+	if (width == 0 || height == 0)
+		return n == 0;
+
+	return n == 1 &&
+	       box->x1 == x && box->y1 == y &&
+	       box->x2 == x + width && box->y2 == y + height;
+}
+
+static struct weston_output *
+get_output(struct weston_compositor *compositor)
+{
+	struct weston_output *output;
+
+	assert(!wl_list_empty(&compositor->output_list));
+	output = wl_container_of(compositor->output_list.next, output, link);
+	assert(output->x == 0 && output->y == 0);
+	assert(output->transform == WL_OUTPUT_TRANSFORM_NORMAL);
+	assert(output->current_scale == 1);
+
+	return output;
+}
+
+PLUGIN_TEST(capture_stream_damage)
+{
+	/* struct weston_compositor *compositor; */
+	struct weston_output *output = get_output(compositor);
+	int width = output->current_mode->width;
+	int height = output->current_mode->height;
+	int disable_planes = output->disable_planes;
+	struct capture_subscriber a, b;
+
+	subscriber_init(&a, output);
+	assert(output->disable_planes == disable_planes + 1);
+
+	/* The first frame covers the whole output whatever was damaged */
+	repaint(output, 10, 10, 20, 20);
+	assert(a.frames == 1);
+	assert(a.seq == 1);
+	assert(damage_is(&a.damage, 0, 0, width, height));
+
+	repaint(output, 10, 20, 30, 40);
+	assert(a.frames == 2);
+	assert(a.seq == 2);
+	assert(damage_is(&a.damage, 10, 20, 30, 40));
+
+	/* A repaint without damage still produces a frame */
+	repaint(output, 0, 0, 0, 0);
+	assert(a.frames == 3);
+	assert(a.seq == 3);
+	assert(damage_is(&a.damage, 0, 0, 0, 0));
+
+	/* Damage outside the output is clipped away */
+	repaint(output, width - 10, height - 10, 100, 100);
+	assert(a.seq == 4);
+	assert(damage_is(&a.damage, width - 10, height - 10, 10, 10));
+
+	/* A late subscriber shares the read-back and its sequence, but
+	 * starts with the whole image */
+	subscriber_init(&b, output);
+	assert(output->disable_planes == disable_planes + 1);
+
+	repaint(output, 5, 5, 10, 10);
+	assert(a.frames == 5 && b.frames == 1);
+	assert(a.seq == 5 && b.seq == 5);
+	assert(damage_is(&a.damage, 5, 5, 10, 10));
+	assert(damage_is(&b.damage, 0, 0, width, height));
+
+	repaint(output, 0, 0, 0, 0);
+	assert(a.seq == 6 && b.seq == 6);
+	assert(damage_is(&a.damage, 0, 0, 0, 0));
+	assert(damage_is(&b.damage, 0, 0, 0, 0));
+
+	subscriber_fini(&a);
+	subscriber_fini(&b);
+	assert(output->disable_planes == disable_planes);
+
+	/* Nobody is listening any more */
+	repaint(output, 0, 0, width, height);
+	assert(a.frames == 6 && b.frames == 2);
+}
+
+PLUGIN_TEST(capture_stream_unsubscribe_in_callback)
+{
+	/* struct weston_compositor *compositor; */
+	struct weston_output *output = get_output(compositor);
+	int disable_planes = output->disable_planes;
+	struct capture_subscriber a, b, c;
+
+	subscriber_init(&a, output);
+	subscriber_init(&b, output);
+	subscriber_init(&c, output);
+	a.unsubscribe_at = 2;
+	b.unsubscribe_at = 1;
+
+	/* The others still get the frame one of them left on */
+	repaint(output, 0, 0, 10, 10);
+	assert(a.frames == 1 && b.frames == 1 && c.frames == 1);
+	assert(!b.stream);
+
+	repaint(output, 0, 0, 10, 10);
+	assert(a.frames == 2 && b.frames == 1 && c.frames == 2);
+	assert(!a.stream);
+	assert(c.seq == 2);
+	assert(damage_is(&c.damage, 0, 0, 10, 10));
+
+	/* The last stream leaving from its callback takes the shared
+	 * source with it once delivery is over */
+	c.unsubscribe_at = 3;
+	repaint(output, 0, 0, 10, 10);
+	assert(c.frames == 3);
+	assert(!c.stream);
+	assert(output->disable_planes == disable_planes);
+
+	repaint(output, 0, 0, 10, 10);
+	assert(a.frames == 2 && b.frames == 1 && c.frames == 3);
+
+	/* A new subscriber starts over with a fresh source */
+	subscriber_fini(&a);
+	subscriber_init(&a, output);
+	repaint(output, 0, 0, 10, 10);
+	assert(a.frames == 1 && a.seq == 1);
+
+	subscriber_fini(&a);
+	subscriber_fini(&b);
+	subscriber_fini(&c);
+	assert(output->disable_planes == disable_planes);
+}
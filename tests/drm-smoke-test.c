@@ -25,6 +25,8 @@
 
 #include "config.h"
 
+#include <stdlib.h>
+
 #include "weston-test-client-helper.h"
 #include "weston-test-fixture-compositor.h"
 
@@ -70,3 +72,80 @@ TEST(drm_smoke) {
 
 	client_destroy(client);
 }
+
+struct test_commit_stats {
+	uint32_t tests;
+	uint32_t hits;
+};
+
+static void
+get_test_commit_stats(struct client *client, struct test_commit_stats *stats)
+{
+	weston_test_get_drm_test_commit_stats(client->test->weston_test);
+	client_roundtrip(client);
+
+	stats->tests = client->test->drm_test_commits;
+	stats->hits = client->test->drm_test_commit_hits;
+}
+
+/* A steady scene repeats the same plane-assignment tests every frame, which
+ * the backend answers from its test-commit cache; moving the surface then
+ * has to go back to the kernel. Neither may stall the repaint loop. */
+TEST(drm_steady_scene)
+{
+	struct client *client;
+	struct buffer *buffer;
+	struct wl_surface *surface;
+	struct test_commit_stats settled, before_move, end;
+	pixman_color_t green;
+	int i, frame;
+
+	color_rgb888(&green, 0, 255, 0);
+
+	client = create_client_and_test_surface(0, 0, 200, 200);
+	assert(client);
+
+	surface = client->surface->wl_surface;
+	buffer = create_shm_buffer_a8r8g8b8(client, 200, 200);
+
+	fill_image_with_color(buffer->image, &green);
+
+	for (i = 0; i < 60; i++) {
+		if (i == 5)
+			get_test_commit_stats(client, &settled);
+		if (i == 30) {
+			get_test_commit_stats(client, &before_move);
+			move_client(client, 100, 50);
+		}
+
+		wl_surface_attach(surface, buffer->proxy, 0, 0);
+		wl_surface_damage(surface, 0, 0, 200, 200);
+		frame_callback_set(surface, &frame);
+		wl_surface_commit(surface);
+		frame_callback_wait(client, &frame);
+	}
+
+	get_test_commit_stats(client, &end);
+
+	testlog("test commits: %u frames 5-29 (%u cached), %u after the move "
+		"(%u cached)\n",
+		before_move.tests - settled.tests,
+		before_move.hits - settled.hits,
+		end.tests - before_move.tests,
+		end.hits - before_move.hits);
+
+	/* Once the scene has settled, every test is answered from the cache.
+	 * Plane assignment only tests when it is allowed to use planes. */
+	if (!getenv("WESTON_FORCE_RENDERER"))
+		assert(before_move.tests > settled.tests);
+	assert(before_move.hits - settled.hits ==
+	       before_move.tests - settled.tests);
+
+	/* The moved surface has a new signature, which needs the kernel */
+	if (end.tests > before_move.tests)
+		assert(end.tests - before_move.tests >
+		       end.hits - before_move.hits);
+
+	buffer_destroy(buffer);
+	client_destroy(client);
+}
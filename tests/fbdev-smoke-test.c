@@ -0,0 +1,146 @@
+/*
+ * Copyright © 2021 Huawei Device Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "weston-test-client-helper.h"
+#include "weston-test-fixture-compositor.h"
+
+/* The geometry fbdev-backend gives a regular file used as its device */
+#define FAKE_WIDTH 640
+#define FAKE_HEIGHT 480
+#define FAKE_PAGES 2
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness)
+{
+	struct compositor_setup setup;
+	enum test_result_code ret;
+	const char *dir;
+	char *path;
+	int fd;
+
+	/* fbdev-backend takes a regular file as a fake frame buffer */
+	dir = getenv("XDG_RUNTIME_DIR");
+	if (!dir) {
+		fprintf(stderr, "XDG_RUNTIME_DIR is not set, skipping.\n");
+		return RESULT_SKIP;
+	}
+
+	if (asprintf(&path, "%s/weston-test-suite-fbdev-XXXXXX", dir) < 0)
+		return RESULT_HARD_ERROR;
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		free(path);
+		return RESULT_HARD_ERROR;
+	}
+	close(fd);
+
+	setenv("WESTON_TEST_SUITE_FBDEV_DEVICE", path, 1);
+
+	compositor_setup_defaults(&setup);
+	setup.shell = SHELL_TEST_DESKTOP;
+	setup.backend = WESTON_BACKEND_FBDEV;
+	setup.renderer = RENDERER_PIXMAN;
+
+	ret = weston_test_harness_execute_as_client(harness, &setup);
+
+	unlink(path);
+	free(path);
+
+	return ret;
+}
+DECLARE_FIXTURE_SETUP(fixture_setup);
+
+static uint32_t
+fake_fb_pixel(const uint32_t *fb, int page, int x, int y)
+{
+	return fb[(page * FAKE_HEIGHT + y) * FAKE_WIDTH + x] & 0x00ffffff;
+}
+
+/* Frames are rendered into a shadow buffer and only the damage is copied
+ * out, alternating between the two pages of the fake frame buffer. Once
+ * a few identical frames went through, both pages show the surface. */
+TEST(fbdev_smoke)
+{
+	struct client *client;
+	struct buffer *buffer;
+	struct wl_surface *surface;
+	const char *device;
+	pixman_color_t red;
+	size_t size;
+	uint32_t *fb;
+	int i, frame, fd, page;
+
+	device = getenv("WESTON_TEST_SUITE_FBDEV_DEVICE");
+	assert(device);
+
+	color_rgb888(&red, 255, 0, 0);
+
+	client = create_client_and_test_surface(0, 0, 200, 200);
+	assert(client);
+
+	surface = client->surface->wl_surface;
+	buffer = create_shm_buffer_a8r8g8b8(client, 200, 200);
+
+	fill_image_with_color(buffer->image, &red);
+
+	for (i = 0; i < 5; i++) {
+		wl_surface_attach(surface, buffer->proxy, 0, 0);
+		wl_surface_damage(surface, 0, 0, 200, 200);
+		frame_callback_set(surface, &frame);
+		wl_surface_commit(surface);
+		frame_callback_wait(client, &frame);
+	}
+
+	fd = open(device, O_RDONLY | O_CLOEXEC);
+	assert(fd >= 0);
+
+	size = (size_t) FAKE_WIDTH * FAKE_HEIGHT * 4 * FAKE_PAGES;
+	fb = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	assert(fb != MAP_FAILED);
+	close(fd);
+
+	for (page = 0; page < FAKE_PAGES; page++) {
+		testlog("page %d: %06x inside, %06x outside the surface\n",
+			page, fake_fb_pixel(fb, page, 100, 100),
+			fake_fb_pixel(fb, page, 300, 300));
+		assert(fake_fb_pixel(fb, page, 100, 100) == 0xff0000);
+		assert(fake_fb_pixel(fb, page, 300, 300) != 0xff0000);
+	}
+
+	munmap(fb, size);
+	buffer_destroy(buffer);
+	client_destroy(client);
+}
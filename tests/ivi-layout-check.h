@@ -0,0 +1,169 @@
+/*
+ * Copyright © 2021 Huawei Device Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef IVI_LAYOUT_CHECK_H
+#define IVI_LAYOUT_CHECK_H
+
+#include <stdbool.h>
+
+#include <libweston/libweston.h>
+#include "ivi-shell/ivi-layout-private.h"
+
+/*
+ * ivi_layout_commit_changes() only revisits the surfaces, layers and
+ * screens that changed. These helpers recompute from scratch what a commit
+ * walking every object would have produced, and compare it with what the
+ * last commit left behind. Call them right after a commit.
+ */
+
+static inline bool
+ivi_layout_check_view_mapped(struct ivi_layout_view *ivi_view)
+{
+	return !wl_list_empty(&ivi_view->order_link) &&
+	       ivi_view->on_layer->on_screen &&
+	       ivi_view->on_layer->prop.visibility &&
+	       ivi_view->ivisurf->prop.visibility;
+}
+
+static inline bool
+ivi_layout_check_scenegraph(struct ivi_layout *layout)
+{
+	struct wl_list *head = &layout->layout_layer.view_list.link;
+	struct ivi_layout_screen *iviscrn;
+	struct ivi_layout_layer *ivilayer;
+	struct ivi_layout_view *ivi_view;
+	struct weston_view *view;
+	struct wl_list *entry;
+
+	/* The view list is built by inserting at the head, so the views
+	 * show up in reverse order of the screen and layer walk. */
+	entry = head->prev;
+	wl_list_for_each(iviscrn, &layout->screen_list, link) {
+		wl_list_for_each(ivilayer, &iviscrn->order.layer_list, order.link) {
+			if (!ivilayer->prop.visibility)
+				continue;
+
+			wl_list_for_each(ivi_view, &ivilayer->order.view_list,
+					 order_link) {
+				if (!ivi_view->ivisurf->prop.visibility)
+					continue;
+
+				if (entry == head)
+					return false;
+
+				view = wl_container_of(entry, view,
+						       layer_link.link);
+				if (view != ivi_view->view ||
+				    !weston_view_is_mapped(view))
+					return false;
+
+				entry = entry->prev;
+			}
+		}
+	}
+
+	if (entry != head)
+		return false;
+
+	wl_list_for_each(ivi_view, &layout->view_list, link) {
+		if (!ivi_layout_check_view_mapped(ivi_view) &&
+		    weston_view_is_mapped(ivi_view->view))
+			return false;
+	}
+
+	return true;
+}
+
+static inline bool
+ivi_layout_check_committed(struct ivi_layout *layout)
+{
+	struct ivi_layout_screen *iviscrn;
+	struct ivi_layout_layer *ivilayer;
+	struct ivi_layout_surface *ivisurf;
+	const struct ivi_layout_surface_properties *sprop, *spend;
+	const struct ivi_layout_layer_properties *lprop, *lpend;
+	struct ivi_layout_view *pending_view, *order_view;
+	struct wl_list *pending, *order;
+
+	wl_list_for_each(iviscrn, &layout->screen_list, link) {
+		if (iviscrn->order.dirty)
+			return false;
+	}
+
+	wl_list_for_each(ivilayer, &layout->layer_list, link) {
+		lprop = &ivilayer->prop;
+		lpend = &ivilayer->pending.prop;
+
+		if (ivilayer->order.dirty ||
+		    lprop->visibility != lpend->visibility ||
+		    lprop->opacity != lpend->opacity ||
+		    lprop->source_x != lpend->source_x ||
+		    lprop->source_y != lpend->source_y ||
+		    lprop->source_width != lpend->source_width ||
+		    lprop->source_height != lpend->source_height ||
+		    lprop->dest_x != lpend->dest_x ||
+		    lprop->dest_y != lpend->dest_y ||
+		    lprop->dest_width != lpend->dest_width ||
+		    lprop->dest_height != lpend->dest_height)
+			return false;
+
+		/* committing walks pending forward and inserts at the head */
+		pending = ivilayer->pending.view_list.next;
+		order = ivilayer->order.view_list.prev;
+		while (pending != &ivilayer->pending.view_list &&
+		       order != &ivilayer->order.view_list) {
+			pending_view = wl_container_of(pending, pending_view,
+						       pending_link);
+			order_view = wl_container_of(order, order_view,
+						     order_link);
+			if (pending_view != order_view)
+				return false;
+
+			pending = pending->next;
+			order = order->prev;
+		}
+
+		if (pending != &ivilayer->pending.view_list ||
+		    order != &ivilayer->order.view_list)
+			return false;
+	}
+
+	wl_list_for_each(ivisurf, &layout->surface_list, link) {
+		sprop = &ivisurf->prop;
+		spend = &ivisurf->pending.prop;
+
+		if (sprop->visibility != spend->visibility ||
+		    sprop->opacity != spend->opacity ||
+		    sprop->source_x != spend->source_x ||
+		    sprop->source_y != spend->source_y ||
+		    sprop->source_width != spend->source_width ||
+		    sprop->source_height != spend->source_height)
+			return false;
+	}
+
+	return true;
+}
+
+#endif /* IVI_LAYOUT_CHECK_H */
@@ -31,13 +31,17 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
 
 #include <libweston/libweston.h>
 #include "compositor/weston.h"
 #include "ivi-shell/ivi-layout-export.h"
 #include "ivi-shell/ivi-layout-private.h"
+#include "ivi-layout-check.h"
 #include "ivi-test.h"
 #include "shared/helpers.h"
+#include "shared/timespec-util.h"
 #include "weston-test-runner.h"
 #include "weston-test-fixture-compositor.h"
 
@@ -606,6 +610,7 @@ test_screen_add_layers(struct test_context *ctx)
 	}
 
 	lyt->commit_changes();
+	iassert(ivi_layout_check_committed(ivilayers[0]->layout));
 
 	iassert(lyt->get_layers_on_screen(output, &length, &array) == IVI_SUCCEEDED);
 	iassert(length == LAYER_NUM);
@@ -622,6 +627,7 @@ test_screen_add_layers(struct test_context *ctx)
 		iassert(lyt->screen_add_layer(output, ivilayers[i]) == IVI_SUCCEEDED);
 
 	lyt->commit_changes();
+	iassert(ivi_layout_check_committed(ivilayers[0]->layout));
 
 	iassert(lyt->get_layers_on_screen(output, &length, &array) == IVI_SUCCEEDED);
 	iassert(length == LAYER_NUM);
@@ -663,6 +669,7 @@ test_screen_remove_layer(struct test_context *ctx)
 
 	iassert(lyt->screen_remove_layer(output, ivilayer) == IVI_SUCCEEDED);
 	lyt->commit_changes();
+	iassert(ivi_layout_check_committed(ivilayer->layout));
 
 	if (length > 0)
 		free(array);
@@ -733,6 +740,248 @@ test_commit_changes_after_render_order_set_layer_destroy(
 #undef LAYER_NUM
 }
 
+static struct weston_view *
+get_first_view(struct ivi_layout_surface *ivisurf)
+{
+	struct ivi_layout_view *ivi_view;
+
+	if (wl_list_empty(&ivisurf->view_list))
+		return NULL;
+
+	ivi_view = wl_container_of(ivisurf->view_list.next, ivi_view, surf_link);
+
+	return ivi_view->view;
+}
+
+/*
+ * commit_changes only revisits what changed since the previous commit.
+ * After every step the scenegraph and committed properties must be what
+ * a commit walking all surfaces, layers and screens would have produced.
+ */
+static void
+test_commit_changes_incremental(struct test_context *ctx)
+{
+#define LAYER_NUM (2)
+#define SURFACE_NUM (4)
+	const struct ivi_layout_interface *lyt = ctx->layout_interface;
+	const struct ivi_layout_interface_for_wms *wms;
+	struct weston_surface *surfaces[SURFACE_NUM] = {};
+	struct ivi_layout_surface *ivisurfs[SURFACE_NUM] = {};
+	struct ivi_layout_layer *ivilayers[LAYER_NUM] = {};
+	struct ivi_layout *layout;
+	struct weston_output *output;
+	uint32_t i;
+
+	wms = ivi_layout_get_api_for_wms(ctx->compositor);
+	if (!iassert(wms != NULL))
+		return;
+
+	if (!iassert(!wl_list_empty(&ctx->compositor->output_list)))
+		return;
+
+	output = wl_container_of(ctx->compositor->output_list.next, output, link);
+
+	for (i = 0; i < LAYER_NUM; i++) {
+		ivilayers[i] = lyt->layer_create_with_dimension(IVI_TEST_LAYER_ID(i),
+								200, 300);
+		lyt->layer_set_visibility(ivilayers[i], true);
+		lyt->layer_set_destination_rectangle(ivilayers[i], 0, 0, 200, 300);
+		iassert(lyt->screen_add_layer(output, ivilayers[i]) == IVI_SUCCEEDED);
+	}
+	layout = ivilayers[0]->layout;
+
+	for (i = 0; i < SURFACE_NUM; i++) {
+		surfaces[i] = weston_surface_create(ctx->compositor);
+		ivisurfs[i] = wms->surface_create(surfaces[i], IVI_TEST_SURFACE_ID(i));
+		if (!iassert(ivisurfs[i] != NULL))
+			return;
+
+		lyt->surface_set_source_rectangle(ivisurfs[i], 0, 0, 50, 50);
+		lyt->surface_set_destination_rectangle(ivisurfs[i],
+						       i * 50, 0, 50, 50);
+		lyt->surface_set_visibility(ivisurfs[i], true);
+		lyt->layer_add_surface(ivilayers[i % LAYER_NUM], ivisurfs[i]);
+	}
+
+	lyt->commit_changes();
+	iassert(ivi_layout_check_scenegraph(layout));
+	iassert(ivi_layout_check_committed(layout));
+	for (i = 0; i < SURFACE_NUM; i++)
+		iassert(weston_view_is_mapped(get_first_view(ivisurfs[i])));
+
+	/* property only */
+	lyt->surface_set_opacity(ivisurfs[1], wl_fixed_from_double(0.5));
+	lyt->commit_changes();
+	iassert(ivi_layout_check_scenegraph(layout));
+	iassert(ivi_layout_check_committed(layout));
+	iassert(ivisurfs[1]->prop.event_mask & IVI_NOTIFICATION_OPACITY);
+
+	/* the committed event_mask is cleared by the next commit */
+	lyt->commit_changes();
+	iassert(ivisurfs[1]->prop.event_mask == 0);
+	iassert(wl_list_empty(&layout->dirty_surface_list));
+	iassert(wl_list_empty(&layout->dirty_layer_list));
+
+	/* surface visibility */
+	lyt->surface_set_visibility(ivisurfs[2], false);
+	lyt->commit_changes();
+	iassert(ivi_layout_check_scenegraph(layout));
+	iassert(ivi_layout_check_committed(layout));
+	iassert(!weston_view_is_mapped(get_first_view(ivisurfs[2])));
+
+	/* layer visibility */
+	lyt->layer_set_visibility(ivilayers[1], false);
+	lyt->commit_changes();
+	iassert(ivi_layout_check_scenegraph(layout));
+	iassert(ivi_layout_check_committed(layout));
+	iassert(!weston_view_is_mapped(get_first_view(ivisurfs[1])));
+	iassert(!weston_view_is_mapped(get_first_view(ivisurfs[3])));
+
+	lyt->layer_set_visibility(ivilayers[1], true);
+	lyt->surface_set_visibility(ivisurfs[2], true);
+	lyt->commit_changes();
+	iassert(ivi_layout_check_scenegraph(layout));
+	iassert(ivi_layout_check_committed(layout));
+
+	/* layer render order */
+	iassert(lyt->layer_set_render_order(ivilayers[0], &ivisurfs[2], 1) ==
+		IVI_SUCCEEDED);
+	lyt->commit_changes();
+	iassert(ivi_layout_check_scenegraph(layout));
+	iassert(ivi_layout_check_committed(layout));
+	iassert(!weston_view_is_mapped(get_first_view(ivisurfs[0])));
+
+	/* screen render order */
+	iassert(lyt->screen_set_render_order(output, &ivilayers[1], 1) ==
+		IVI_SUCCEEDED);
+	lyt->commit_changes();
+	iassert(ivi_layout_check_scenegraph(layout));
+	iassert(ivi_layout_check_committed(layout));
+	iassert(!weston_view_is_mapped(get_first_view(ivisurfs[2])));
+
+	/* nothing pending */
+	lyt->commit_changes();
+	lyt->commit_changes();
+	iassert(ivi_layout_check_scenegraph(layout));
+	iassert(ivi_layout_check_committed(layout));
+	iassert(wl_list_empty(&layout->dirty_surface_list));
+	iassert(wl_list_empty(&layout->dirty_layer_list));
+
+	iassert(lyt->screen_set_render_order(output, NULL, 0) == IVI_SUCCEEDED);
+	lyt->commit_changes();
+
+	for (i = 0; i < LAYER_NUM; i++)
+		lyt->layer_destroy(ivilayers[i]);
+
+	for (i = 0; i < SURFACE_NUM; i++) {
+		wms->surface_destroy(ivisurfs[i]);
+		weston_surface_destroy(surfaces[i]);
+	}
+
+	lyt->commit_changes();
+	iassert(ivi_layout_check_scenegraph(layout));
+
+#undef SURFACE_NUM
+#undef LAYER_NUM
+}
+
+/*
+ * Measures the per-call cost of commit_changes() with one surface property
+ * changing per commit, as the number of surfaces on a screen grows. Every
+ * surface is also resolved back through its id, which must stay exact
+ * regardless of how ids land in the lookup table.
+ */
+static void
+test_commit_changes_scaling(struct test_context *ctx)
+{
+#define MAX_SURFACES (512)
+#define COMMITS_PER_RUN (200)
+	static const uint32_t counts[] = { 16, 64, 256, MAX_SURFACES };
+	const struct ivi_layout_interface *lyt = ctx->layout_interface;
+	const struct ivi_layout_interface_for_wms *wms;
+	struct weston_surface *surfaces[MAX_SURFACES] = {};
+	struct ivi_layout_surface *ivisurfs[MAX_SURFACES] = {};
+	struct ivi_layout_layer *ivilayer;
+	struct weston_output *output;
+	struct timespec begin, end;
+	int64_t elapsed_ns;
+	uint32_t c, i, n;
+
+	wms = ivi_layout_get_api_for_wms(ctx->compositor);
+	if (!iassert(wms != NULL))
+		return;
+
+	if (!iassert(!wl_list_empty(&ctx->compositor->output_list)))
+		return;
+
+	output = wl_container_of(ctx->compositor->output_list.next, output, link);
+
+	for (c = 0; c < ARRAY_LENGTH(counts); c++) {
+		n = counts[c];
+
+		ivilayer = lyt->layer_create_with_dimension(IVI_TEST_LAYER_ID(c),
+							    1024, 768);
+		iassert(lyt->layer_set_visibility(ivilayer, true) == IVI_SUCCEEDED);
+		iassert(lyt->layer_set_destination_rectangle(ivilayer, 0, 0,
+							     1024, 768) == IVI_SUCCEEDED);
+		iassert(lyt->screen_add_layer(output, ivilayer) == IVI_SUCCEEDED);
+
+		for (i = 0; i < n; i++) {
+			surfaces[i] = weston_surface_create(ctx->compositor);
+			ivisurfs[i] = wms->surface_create(surfaces[i],
+							  IVI_TEST_SURFACE_ID(i));
+			if (!iassert(ivisurfs[i] != NULL))
+				return;
+
+			lyt->surface_set_source_rectangle(ivisurfs[i], 0, 0, 64, 64);
+			lyt->surface_set_destination_rectangle(ivisurfs[i],
+							       i % 16 * 64,
+							       i / 16 % 12 * 64,
+							       64, 64);
+			lyt->surface_set_visibility(ivisurfs[i], true);
+			lyt->layer_add_surface(ivilayer, ivisurfs[i]);
+		}
+
+		lyt->commit_changes();
+		iassert(ivi_layout_check_scenegraph(ivilayer->layout));
+
+		for (i = 0; i < n; i++) {
+			iassert(lyt->get_surface_from_id(IVI_TEST_SURFACE_ID(i)) ==
+				ivisurfs[i]);
+		}
+		iassert(lyt->get_layer_from_id(IVI_TEST_LAYER_ID(c)) == ivilayer);
+
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		for (i = 0; i < COMMITS_PER_RUN; i++) {
+			lyt->surface_set_opacity(ivisurfs[i % n],
+						 wl_fixed_from_double((i & 1) ? 1.0 : 0.5));
+			lyt->commit_changes();
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		iassert(ivi_layout_check_scenegraph(ivilayer->layout));
+		iassert(ivi_layout_check_committed(ivilayer->layout));
+
+		elapsed_ns = timespec_sub_to_nsec(&end, &begin);
+		weston_log("commit_changes with %u surfaces: %" PRId64 " ns/call\n",
+			   n, elapsed_ns / COMMITS_PER_RUN);
+
+		iassert(lyt->screen_remove_layer(output, ivilayer) == IVI_SUCCEEDED);
+		lyt->commit_changes();
+		lyt->layer_destroy(ivilayer);
+
+		for (i = 0; i < n; i++) {
+			wms->surface_destroy(ivisurfs[i]);
+			weston_surface_destroy(surfaces[i]);
+			iassert(lyt->get_surface_from_id(IVI_TEST_SURFACE_ID(i)) == NULL);
+		}
+		iassert(lyt->get_layer_from_id(IVI_TEST_LAYER_ID(c)) == NULL);
+	}
+
+#undef COMMITS_PER_RUN
+#undef MAX_SURFACES
+}
+
 static void
 test_layer_properties_changed_notification_callback(struct wl_listener *listener, void *data)
 {
@@ -989,6 +1238,8 @@ run_internal_tests(struct test_context *ctx)
 	test_screen_remove_layer(ctx);
 	test_screen_bad_remove_layer(ctx);
 	test_commit_changes_after_render_order_set_layer_destroy(ctx);
+	test_commit_changes_incremental(ctx);
+	test_commit_changes_scaling(ctx);
 
 	test_layer_properties_changed_notification(ctx);
 	test_layer_create_notification(ctx);
@@ -40,6 +40,7 @@
 #include "weston-test-server-protocol.h"
 #include "ivi-test.h"
 #include "ivi-shell/ivi-layout-export.h"
+#include "ivi-layout-check.h"
 #include "shared/helpers.h"
 
 struct test_context;
@@ -239,6 +240,14 @@ runner_assert_fail(const char *cond, const char *file, int line,
 	}							\
 } while (0)
 
+/* commit_changes() only revisits what changed; compare its result against
+ * what walking every surface, layer and screen would have produced. */
+static bool
+matches_full_recompute(struct ivi_layout_surface *ivisurf)
+{
+	return ivi_layout_check_scenegraph(ivisurf->layout) &&
+	       ivi_layout_check_committed(ivisurf->layout);
+}
 
 /*************************** tests **********************************/
 
@@ -312,6 +321,7 @@ RUNNER_TEST(surface_visibility)
 	runner_assert(ret == IVI_SUCCEEDED);
 
 	lyt->commit_changes();
+	runner_assert(matches_full_recompute(ivisurf));
 
 	prop = lyt->get_properties_of_surface(ivisurf);
 	runner_assert(prop->visibility == true);
@@ -336,6 +346,7 @@ RUNNER_TEST(surface_opacity)
 	runner_assert(prop->opacity == wl_fixed_from_double(1.0));
 
 	lyt->commit_changes();
+	runner_assert(matches_full_recompute(ivisurf));
 
 	runner_assert(prop->opacity == wl_fixed_from_double(0.5));
 }
@@ -526,6 +537,7 @@ RUNNER_TEST(surface_on_many_layer)
 	}
 
 	lyt->commit_changes();
+	runner_assert(matches_full_recompute(ivisurf));
 
 	runner_assert(lyt->get_layers_under_surface(
 		      ivisurf, &length, &array) == IVI_SUCCEEDED);
@@ -542,6 +554,7 @@ RUNNER_TEST(surface_on_many_layer)
 	array = NULL;
 
 	lyt->commit_changes();
+	runner_assert(matches_full_recompute(ivisurf));
 
 	runner_assert(lyt->get_layers_under_surface(
 		      ivisurf, &length, &array) == IVI_SUCCEEDED);
@@ -629,6 +642,7 @@ RUNNER_TEST(layer_render_order)
 		      ivilayer, ivisurfs, IVI_TEST_SURFACE_COUNT) == IVI_SUCCEEDED);
 
 	lyt->commit_changes();
+	runner_assert(matches_full_recompute(ivisurfs[0]));
 
 	runner_assert(lyt->get_surfaces_on_layer(
 		      ivilayer, &length, &array) == IVI_SUCCEEDED);
@@ -671,6 +685,7 @@ RUNNER_TEST(test_layer_render_order_destroy_one_surface_p1)
 		      ivilayer, ivisurfs, IVI_TEST_SURFACE_COUNT) == IVI_SUCCEEDED);
 
 	lyt->commit_changes();
+	runner_assert(matches_full_recompute(ivisurfs[0]));
 
 	runner_assert(lyt->get_surfaces_on_layer(
 		      ivilayer, &length, &array) == IVI_SUCCEEDED);
@@ -777,6 +792,7 @@ RUNNER_TEST(layer_add_surfaces)
 				      ivilayer, ivisurfs[i]) == IVI_SUCCEEDED);
 
 	lyt->commit_changes();
+	runner_assert(matches_full_recompute(ivisurfs[0]));
 
 	runner_assert(lyt->get_surfaces_on_layer(
 		      ivilayer, &length, &array) == IVI_SUCCEEDED);
@@ -0,0 +1,112 @@
+/*
+ * Copyright © 2021 Huawei Device Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "shared/timespec-util.h"
+#include "weston-test-client-helper.h"
+#include "weston-test-fixture-compositor.h"
+
+#define NUM_CLIENTS 200
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness)
+{
+	struct compositor_setup setup;
+
+	compositor_setup_defaults(&setup);
+
+	return weston_test_harness_execute_as_client(harness, &setup);
+}
+DECLARE_FIXTURE_SETUP(fixture_setup);
+
+/* The compositor runs in this process, so this covers its memory too. */
+static long
+read_vm_rss_kb(void)
+{
+	char line[128];
+	long kb = -1;
+	FILE *fp;
+
+	fp = fopen("/proc/self/status", "r");
+	if (!fp)
+		return -1;
+
+	while (fgets(line, sizeof line, fp)) {
+		if (sscanf(line, "VmRSS: %ld kB", &kb) == 1)
+			break;
+	}
+	fclose(fp);
+
+	return kb;
+}
+
+TEST(keymap_shared_by_many_clients)
+{
+	struct client *clients[NUM_CLIENTS];
+	struct keyboard *first, *keyboard;
+	struct timespec begin, end;
+	long rss_begin, rss_end;
+	int i;
+
+	rss_begin = read_vm_rss_kb();
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	for (i = 0; i < NUM_CLIENTS; i++)
+		clients[i] = create_client();
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	rss_end = read_vm_rss_kb();
+
+	testlog("%d clients connected in %" PRId64 " us, VmRSS %ld -> %ld kB\n",
+		NUM_CLIENTS, timespec_sub_to_nsec(&end, &begin) / 1000,
+		rss_begin, rss_end);
+
+	/* wl_seat version 7 clients must all receive the same sealed
+	 * keymap file instead of a private copy each. This only guards
+	 * that; sharing across seats and updates is in keymap-update-test. */
+	first = clients[0]->input->keyboard;
+	assert(first);
+	assert(first->keymap.count == 1);
+	assert(first->keymap.size > 0);
+
+	for (i = 1; i < NUM_CLIENTS; i++) {
+		keyboard = clients[i]->input->keyboard;
+		assert(keyboard);
+		assert(keyboard->keymap.count == 1);
+		assert(keyboard->keymap.size == first->keymap.size);
+		assert(keyboard->keymap.dev == first->keymap.dev);
+		assert(keyboard->keymap.ino == first->keymap.ino);
+	}
+
+	for (i = 0; i < NUM_CLIENTS; i++)
+		client_destroy(clients[i]);
+}
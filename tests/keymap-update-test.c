@@ -0,0 +1,291 @@
+/*
+ * Copyright © 2021 Huawei Device Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libweston/libweston.h>
+#include "weston-test-runner.h"
+#include "weston-test-fixture-compositor.h"
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness)
+{
+	struct compositor_setup setup;
+
+	compositor_setup_defaults(&setup);
+
+	return weston_test_harness_execute_as_plugin(harness, &setup);
+}
+DECLARE_FIXTURE_SETUP(fixture_setup);
+
+/* A wl_keyboard of an in-process client, whose events are read back raw
+ * from the other end of its socket. */
+struct keyboard_client {
+	struct wl_client *client;
+	struct wl_resource *resource;
+	int fd;
+	/* the file of the last keymap received */
+	dev_t keymap_dev;
+	ino_t keymap_ino;
+};
+
+static void
+keyboard_client_resource_destroy(struct wl_resource *resource)
+{
+	wl_list_remove(wl_resource_get_link(resource));
+}
+
+static void
+keyboard_client_init(struct keyboard_client *kc,
+		     struct weston_compositor *compositor,
+		     struct weston_keyboard *keyboard)
+{
+	int sv[2];
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == 0);
+
+	kc->client = wl_client_create(compositor->wl_display, sv[0]);
+	assert(kc->client);
+	kc->fd = sv[1];
+
+	kc->resource = wl_resource_create(kc->client, &wl_keyboard_interface,
+					  7, 0);
+	assert(kc->resource);
+	wl_resource_set_implementation(kc->resource, NULL, NULL,
+				       keyboard_client_resource_destroy);
+	wl_list_insert(&keyboard->resource_list,
+		       wl_resource_get_link(kc->resource));
+}
+
+static void
+keyboard_client_fini(struct keyboard_client *kc)
+{
+	wl_client_destroy(kc->client);
+	close(kc->fd);
+}
+
+/* Returns how many wl_keyboard.keymap events were sent since last time */
+static int
+keyboard_client_count_keymaps(struct keyboard_client *kc)
+{
+	uint32_t buf[1024];
+	char control[CMSG_SPACE(sizeof(int) * 28)];
+	uint32_t id = wl_resource_get_id(kc->resource);
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct stat st;
+	struct iovec iov;
+	ssize_t len;
+	size_t i, n, size;
+	int *fds;
+	int count = 0;
+
+	wl_client_flush(kc->client);
+
+	for (;;) {
+		iov.iov_base = buf;
+		iov.iov_len = sizeof buf;
+		memset(&msg, 0, sizeof msg);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof control;
+
+		len = recvmsg(kc->fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+		if (len <= 0)
+			break;
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+		     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level != SOL_SOCKET ||
+			    cmsg->cmsg_type != SCM_RIGHTS)
+				continue;
+
+			fds = (int *) CMSG_DATA(cmsg);
+			n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			for (i = 0; i < n; i++) {
+				if (fstat(fds[i], &st) == 0) {
+					kc->keymap_dev = st.st_dev;
+					kc->keymap_ino = st.st_ino;
+				}
+				close(fds[i]);
+			}
+		}
+
+		/* Every event starts with its object id, then its size in
+		 * bytes and its opcode. */
+		for (i = 0; i + 2 <= (size_t) len / 4; i += size / 4) {
+			size = buf[i + 1] >> 16;
+			if (size < 8)
+				break;
+
+			if (buf[i] == id &&
+			    (buf[i + 1] & 0xffff) == WL_KEYBOARD_KEYMAP)
+				count++;
+		}
+	}
+
+	return count;
+}
+
+static struct xkb_keymap *
+compile_keymap(struct weston_compositor *compositor, const char *variant)
+{
+	struct xkb_rule_names names = compositor->xkb_names;
+	struct xkb_keymap *keymap;
+
+	names.variant = variant;
+	keymap = xkb_keymap_new_from_names(compositor->xkb_context, &names, 0);
+	assert(keymap);
+
+	return keymap;
+}
+
+PLUGIN_TEST(keymap_shared_between_seats)
+{
+	/* struct weston_compositor *compositor; */
+	struct weston_seat seat_a, seat_b, seat_c;
+	struct weston_keyboard *keyboard_a, *keyboard_b, *keyboard_c;
+	struct xkb_keymap *keymap_a, *keymap_b;
+
+	/* Two compilations of the same names: different objects, same
+	 * content. */
+	keymap_a = compile_keymap(compositor, compositor->xkb_names.variant);
+	keymap_b = compile_keymap(compositor, compositor->xkb_names.variant);
+	assert(keymap_a != keymap_b);
+
+	weston_seat_init(&seat_a, compositor, "keymap-a");
+	weston_seat_init(&seat_b, compositor, "keymap-b");
+	assert(weston_seat_init_keyboard(&seat_a, keymap_a) == 0);
+	assert(weston_seat_init_keyboard(&seat_b, keymap_b) == 0);
+	xkb_keymap_unref(keymap_a);
+	xkb_keymap_unref(keymap_b);
+
+	keyboard_a = weston_seat_get_keyboard(&seat_a);
+	keyboard_b = weston_seat_get_keyboard(&seat_b);
+	assert(keyboard_a && keyboard_b);
+	assert(keyboard_a->xkb_info == keyboard_b->xkb_info);
+	assert(keyboard_a->xkb_info->keymap_rofile);
+	assert(keyboard_a->xkb_info->ref_count >= 2);
+
+	/* So does a seat using the compositor's global keymap */
+	weston_seat_init(&seat_c, compositor, "keymap-c");
+	assert(weston_seat_init_keyboard(&seat_c, NULL) == 0);
+	keyboard_c = weston_seat_get_keyboard(&seat_c);
+	assert(keyboard_c);
+	assert(keyboard_c->xkb_info == keyboard_a->xkb_info);
+
+	weston_seat_release(&seat_a);
+	weston_seat_release(&seat_b);
+	weston_seat_release(&seat_c);
+}
+
+PLUGIN_TEST(keymap_identical_update_not_resent)
+{
+	/* struct weston_compositor *compositor; */
+	struct weston_seat seat;
+	struct weston_keyboard *keyboard;
+	struct weston_xkb_info *xkb_info;
+	struct keyboard_client kc;
+	struct xkb_keymap *keymap;
+
+	keymap = compile_keymap(compositor, compositor->xkb_names.variant);
+	weston_seat_init(&seat, compositor, "keymap");
+	assert(weston_seat_init_keyboard(&seat, keymap) == 0);
+	xkb_keymap_unref(keymap);
+
+	keyboard = weston_seat_get_keyboard(&seat);
+	assert(keyboard);
+	keyboard_client_init(&kc, compositor, keyboard);
+	assert(keyboard_client_count_keymaps(&kc) == 0);
+
+	/* Same keymap again: clients already have it */
+	xkb_info = keyboard->xkb_info;
+	keymap = compile_keymap(compositor, compositor->xkb_names.variant);
+	weston_seat_update_keymap(&seat, keymap);
+	xkb_keymap_unref(keymap);
+	assert(keyboard->xkb_info == xkb_info);
+	assert(keyboard_client_count_keymaps(&kc) == 0);
+
+	/* A real change is sent, once */
+	keymap = compile_keymap(compositor, "dvorak");
+	weston_seat_update_keymap(&seat, keymap);
+	xkb_keymap_unref(keymap);
+	assert(keyboard->xkb_info != xkb_info);
+	assert(keyboard_client_count_keymaps(&kc) == 1);
+
+	keyboard_client_fini(&kc);
+	weston_seat_release(&seat);
+}
+
+PLUGIN_TEST(keymap_update_shared_between_seats)
+{
+	/* struct weston_compositor *compositor; */
+	struct weston_seat seat_a, seat_b;
+	struct keyboard_client kc_a, kc_b;
+	struct xkb_keymap *keymap;
+
+	keymap = compile_keymap(compositor, compositor->xkb_names.variant);
+	weston_seat_init(&seat_a, compositor, "keymap-a");
+	weston_seat_init(&seat_b, compositor, "keymap-b");
+	assert(weston_seat_init_keyboard(&seat_a, keymap) == 0);
+	assert(weston_seat_init_keyboard(&seat_b, keymap) == 0);
+	xkb_keymap_unref(keymap);
+
+	keyboard_client_init(&kc_a, compositor,
+			     weston_seat_get_keyboard(&seat_a));
+	keyboard_client_init(&kc_b, compositor,
+			     weston_seat_get_keyboard(&seat_b));
+
+	/* Both seats switch to the same new layout, each from its own
+	 * compilation of it */
+	keymap = compile_keymap(compositor, "dvorak");
+	weston_seat_update_keymap(&seat_a, keymap);
+	xkb_keymap_unref(keymap);
+	keymap = compile_keymap(compositor, "dvorak");
+	weston_seat_update_keymap(&seat_b, keymap);
+	xkb_keymap_unref(keymap);
+
+	assert(keyboard_client_count_keymaps(&kc_a) == 1);
+	assert(keyboard_client_count_keymaps(&kc_b) == 1);
+
+#ifdef HAVE_MEMFD_CREATE
+	/* Version 7 clients of both seats get the one sealed file */
+	assert(kc_a.keymap_dev == kc_b.keymap_dev);
+	assert(kc_a.keymap_ino == kc_b.keymap_ino);
+#endif
+
+	keyboard_client_fini(&kc_a);
+	keyboard_client_fini(&kc_b);
+	weston_seat_release(&seat_a);
+	weston_seat_release(&seat_b);
+}
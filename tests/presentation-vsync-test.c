@@ -0,0 +1,183 @@
+/*
+ * Copyright © 2021 Huawei Device Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "shared/helpers.h"
+#include "shared/xalloc.h"
+#include "shared/timespec-util.h"
+#include "weston-test-client-helper.h"
+#include "presentation-time-client-protocol.h"
+#include "weston-test-fixture-compositor.h"
+#include "test-config.h"
+
+/* must match presentation-vsync.ini */
+#define REFRESH_NSEC 20000000
+#define NUM_FRAMES 10
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness)
+{
+	struct compositor_setup setup;
+
+	compositor_setup_defaults(&setup);
+	setup.config_file = TESTSUITE_PRESENTATION_VSYNC_CONFIG_PATH;
+
+	return weston_test_harness_execute_as_client(harness, &setup);
+}
+DECLARE_FIXTURE_SETUP(fixture_setup);
+
+struct feedback {
+	bool done;
+	bool presented;
+	uint64_t seq;
+	struct timespec time;
+	uint32_t refresh_nsec;
+	uint32_t flags;
+};
+
+static void
+feedback_sync_output(void *data,
+		     struct wp_presentation_feedback *presentation_feedback,
+		     struct wl_output *output)
+{
+}
+
+static void
+feedback_presented(void *data,
+		   struct wp_presentation_feedback *presentation_feedback,
+		   uint32_t tv_sec_hi,
+		   uint32_t tv_sec_lo,
+		   uint32_t tv_nsec,
+		   uint32_t refresh_nsec,
+		   uint32_t seq_hi,
+		   uint32_t seq_lo,
+		   uint32_t flags)
+{
+	struct feedback *fb = data;
+
+	fb->done = true;
+	fb->presented = true;
+	fb->seq = ((uint64_t)seq_hi << 32) + seq_lo;
+	timespec_from_proto(&fb->time, tv_sec_hi, tv_sec_lo, tv_nsec);
+	fb->refresh_nsec = refresh_nsec;
+	fb->flags = flags;
+}
+
+static void
+feedback_discarded(void *data,
+		   struct wp_presentation_feedback *presentation_feedback)
+{
+	struct feedback *fb = data;
+
+	fb->done = true;
+}
+
+static const struct wp_presentation_feedback_listener feedback_listener = {
+	feedback_sync_output,
+	feedback_presented,
+	feedback_discarded
+};
+
+static struct wp_presentation *
+get_presentation(struct client *client)
+{
+	struct global *g;
+
+	wl_list_for_each(g, &client->global_list, link) {
+		if (strcmp(g->interface, wp_presentation_interface.name) == 0)
+			return wl_registry_bind(client->wl_registry, g->name,
+						&wp_presentation_interface, 1);
+	}
+
+	assert(0 && "no presentation found");
+	return NULL;
+}
+
+static void
+present_frame(struct client *client, struct wp_presentation *pres,
+	      struct feedback *fb)
+{
+	struct wl_surface *surface = client->surface->wl_surface;
+	struct wp_presentation_feedback *obj;
+
+	memset(fb, 0, sizeof *fb);
+
+	wl_surface_attach(surface, client->surface->buffer->proxy, 0, 0);
+	obj = wp_presentation_feedback(pres, surface);
+	wp_presentation_feedback_add_listener(obj, &feedback_listener, fb);
+	wl_surface_damage(surface, 0, 0, 100, 100);
+	wl_surface_commit(surface);
+
+	while (!fb->done)
+		assert(wl_display_dispatch(client->wl_display) >= 0);
+
+	wp_presentation_feedback_destroy(obj);
+}
+
+TEST(simulated_vsync_presents_on_vblanks)
+{
+	struct client *client;
+	struct wp_presentation *pres;
+	struct feedback first, fb;
+	int64_t delta;
+	int i;
+
+	client = create_client_and_test_surface(100, 50, 123, 77);
+	assert(client);
+	pres = get_presentation(client);
+
+	present_frame(client, pres, &first);
+	assert(first.presented);
+	assert(first.flags & WP_PRESENTATION_FEEDBACK_KIND_VSYNC);
+	assert(first.refresh_nsec == REFRESH_NSEC);
+
+	for (i = 1; i < NUM_FRAMES; i++) {
+		present_frame(client, pres, &fb);
+		assert(fb.presented);
+		assert(fb.flags & WP_PRESENTATION_FEEDBACK_KIND_VSYNC);
+		assert(fb.refresh_nsec == REFRESH_NSEC);
+
+		/* Without jitter every frame lands exactly on a vblank
+		 * of the simulated clock, whose number is reported. */
+		assert(fb.seq > first.seq);
+		delta = timespec_sub_to_nsec(&fb.time, &first.time);
+		assert(delta == (int64_t)(fb.seq - first.seq) * REFRESH_NSEC);
+
+		testlog("frame %d: seq %" PRIu64 ", +%" PRId64 " us\n",
+			i, fb.seq, delta / 1000);
+		first.seq = fb.seq;
+		first.time = fb.time;
+	}
+
+	wp_presentation_destroy(pres);
+	client_destroy(client);
+}
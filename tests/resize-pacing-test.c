@@ -0,0 +1,341 @@
+/*
+ * Copyright © 2021 Huawei Device Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <inttypes.h>
+#include <linux/input.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "shared/xalloc.h"
+#include "shared/timespec-util.h"
+#include "weston-test-client-helper.h"
+#include "weston-test-fixture-compositor.h"
+#include "xdg-shell-client-protocol.h"
+#include "test-config.h"
+
+#define RESIZE_STEPS 60
+#define MOTIONS_PER_FRAME 4
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness)
+{
+	struct compositor_setup setup;
+
+	compositor_setup_defaults(&setup);
+	setup.config_file = TESTSUITE_RESIZE_PACING_CONFIG_PATH;
+
+	return weston_test_harness_execute_as_client(harness, &setup);
+}
+DECLARE_FIXTURE_SETUP(fixture_setup);
+
+struct window {
+	struct client *client;
+	struct xdg_wm_base *wm_base;
+	struct xdg_surface *xdg_surface;
+	struct xdg_toplevel *xdg_toplevel;
+	struct surface *surface;
+
+	uint32_t configure_serial; /* 0 once acked */
+	int configure_count;
+	int pending_width;
+	int pending_height;
+	bool pending_resizing;
+};
+
+static void
+wm_base_handle_ping(void *data, struct xdg_wm_base *wm_base, uint32_t serial)
+{
+	xdg_wm_base_pong(wm_base, serial);
+}
+
+static const struct xdg_wm_base_listener wm_base_listener = {
+	wm_base_handle_ping,
+};
+
+static void
+xdg_surface_handle_configure(void *data, struct xdg_surface *xdg_surface,
+			     uint32_t serial)
+{
+	struct window *window = data;
+
+	window->configure_serial = serial;
+	window->configure_count++;
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+	xdg_surface_handle_configure,
+};
+
+static void
+xdg_toplevel_handle_configure(void *data, struct xdg_toplevel *xdg_toplevel,
+			      int32_t width, int32_t height,
+			      struct wl_array *states)
+{
+	struct window *window = data;
+	uint32_t *state;
+
+	window->pending_width = width;
+	window->pending_height = height;
+	window->pending_resizing = false;
+	wl_array_for_each(state, states) {
+		if (*state == XDG_TOPLEVEL_STATE_RESIZING)
+			window->pending_resizing = true;
+	}
+}
+
+static void
+xdg_toplevel_handle_close(void *data, struct xdg_toplevel *xdg_toplevel)
+{
+}
+
+static const struct xdg_toplevel_listener xdg_toplevel_listener = {
+	xdg_toplevel_handle_configure,
+	xdg_toplevel_handle_close,
+};
+
+/* Acks the last configure and commits a buffer of the configured size. */
+static void
+window_ack_and_commit(struct window *window)
+{
+	struct surface *surface = window->surface;
+	struct buffer *old = surface->buffer;
+	int width = window->pending_width;
+	int height = window->pending_height;
+
+	if (width == 0 || height == 0) {
+		width = surface->width ? surface->width : 320;
+		height = surface->height ? surface->height : 240;
+	}
+
+	xdg_surface_ack_configure(window->xdg_surface,
+				  window->configure_serial);
+	window->configure_serial = 0;
+
+	surface->buffer = create_shm_buffer_a8r8g8b8(window->client,
+						     width, height);
+	surface->width = width;
+	surface->height = height;
+	wl_surface_attach(surface->wl_surface, surface->buffer->proxy, 0, 0);
+	wl_surface_damage(surface->wl_surface, 0, 0, width, height);
+	wl_surface_commit(surface->wl_surface);
+
+	/* Let the compositor take the commit and send whatever it releases. */
+	client_roundtrip(window->client);
+	client_roundtrip(window->client);
+
+	if (old)
+		buffer_destroy(old);
+}
+
+static void
+window_settle(struct window *window)
+{
+	int i;
+
+	for (i = 0; i < 10 && window->configure_serial != 0; i++)
+		window_ack_and_commit(window);
+	assert(window->configure_serial == 0);
+}
+
+static struct window *
+window_create(struct client *client)
+{
+	struct window *window;
+	struct global *g;
+
+	window = xzalloc(sizeof *window);
+	window->client = client;
+
+	wl_list_for_each(g, &client->global_list, link) {
+		if (strcmp(g->interface, "xdg_wm_base") == 0) {
+			window->wm_base = wl_registry_bind(client->wl_registry,
+							   g->name,
+							   &xdg_wm_base_interface,
+							   1);
+			break;
+		}
+	}
+	assert(window->wm_base);
+	xdg_wm_base_add_listener(window->wm_base, &wm_base_listener, window);
+
+	window->surface = create_test_surface(client);
+	client->surface = window->surface;
+
+	window->xdg_surface =
+		xdg_wm_base_get_xdg_surface(window->wm_base,
+					    window->surface->wl_surface);
+	xdg_surface_add_listener(window->xdg_surface, &xdg_surface_listener,
+				 window);
+	window->xdg_toplevel = xdg_surface_get_toplevel(window->xdg_surface);
+	xdg_toplevel_add_listener(window->xdg_toplevel,
+				  &xdg_toplevel_listener, window);
+	wl_surface_commit(window->surface->wl_surface);
+	client_roundtrip(client);
+
+	/* The window is as large as the output, so the shell places it at
+	 * the origin of the work area and the pointer below is on it. */
+	window_settle(window);
+
+	return window;
+}
+
+static void
+window_destroy(struct window *window)
+{
+	xdg_toplevel_destroy(window->xdg_toplevel);
+	xdg_surface_destroy(window->xdg_surface);
+	xdg_wm_base_destroy(window->wm_base);
+	free(window);
+}
+
+static void
+send_motion(struct client *client, int x, int y)
+{
+	weston_test_move_pointer(client->test->weston_test, 0, 1, 0, x, y);
+	client_roundtrip(client);
+}
+
+static void
+send_button(struct client *client, uint32_t state)
+{
+	weston_test_send_button(client->test->weston_test, 0, 1, 0,
+				BTN_LEFT, state);
+	client_roundtrip(client);
+}
+
+/* Grabs the bottom-right corner of the window at x, y and starts resizing. */
+static void
+window_begin_resize(struct window *window, int x, int y)
+{
+	struct client *client = window->client;
+	struct pointer *pointer = client->input->pointer;
+
+	send_motion(client, x, y);
+	assert(pointer->focus == window->surface);
+
+	send_button(client, WL_POINTER_BUTTON_STATE_PRESSED);
+	/* Clicking activates the window */
+	window_settle(window);
+
+	xdg_toplevel_resize(window->xdg_toplevel, client->input->wl_seat,
+			    pointer->button_serial,
+			    XDG_TOPLEVEL_RESIZE_EDGE_BOTTOM_RIGHT);
+	client_roundtrip(client);
+	client_roundtrip(client);
+	assert(window->configure_serial != 0);
+	assert(window->pending_resizing);
+}
+
+static void
+window_end_resize(struct window *window)
+{
+	send_button(window->client, WL_POINTER_BUTTON_STATE_RELEASED);
+	client_roundtrip(window->client);
+	window_settle(window);
+	assert(!window->pending_resizing);
+}
+
+TEST(resize_pacing_coalesces_sizes)
+{
+	struct client *client;
+	struct window *window;
+	int count;
+	int i;
+
+	client = create_client();
+	window = window_create(client);
+	window_begin_resize(window, 160, 150);
+
+	/* The client sits on the configure in flight, none of these sizes
+	 * may reach it. */
+	count = window->configure_count;
+	for (i = 1; i <= 20; i++)
+		send_motion(client, 160 - i, 150 - i);
+	assert(window->configure_count == count);
+
+	/* Acking and committing releases only the latest size. */
+	window_ack_and_commit(window);
+	assert(window->configure_count == count + 1);
+	assert(window->pending_width == 320 - 20);
+	assert(window->pending_height == 240 - 20);
+	assert(window->pending_resizing);
+
+	window_end_resize(window);
+	window_destroy(window);
+	client_destroy(client);
+}
+
+TEST(resize_pacing_fps)
+{
+	struct client *client;
+	struct window *window;
+	struct timespec begin, end;
+	int64_t elapsed_us;
+	int resizes = 0;
+	int motions = 0;
+	int count;
+	int i, j;
+
+	client = create_client();
+	window = window_create(client);
+	window_begin_resize(window, 160, 150);
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	for (i = 0; i < RESIZE_STEPS; i++) {
+		count = window->configure_count;
+
+		/* The pointer moves several times per client frame */
+		for (j = 0; j < MOTIONS_PER_FRAME; j++) {
+			motions++;
+			send_motion(client, 160 - motions % 100,
+				    150 - motions % 100);
+		}
+
+		/* Never more than one configure between two commits */
+		assert(window->configure_count - count <= 1);
+
+		if (window->configure_serial != 0) {
+			window_ack_and_commit(window);
+			resizes++;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed_us = timespec_sub_to_nsec(&end, &begin) / 1000;
+
+	testlog("%d resizes for %d motion events in %" PRId64 " us, "
+		"%.1f resizes/s\n", resizes, motions, elapsed_us,
+		elapsed_us > 0 ? resizes * 1e6 / elapsed_us : 0.0);
+	assert(resizes > 0);
+
+	window_end_resize(window);
+	window_destroy(window);
+	client_destroy(client);
+}
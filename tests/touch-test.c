@@ -25,6 +25,8 @@
 
 #include "config.h"
 
+#include <inttypes.h>
+#include <string.h>
 #include <time.h>
 
 #include "input-timestamps-helper.h"
@@ -133,3 +135,117 @@ TEST(touch_timestamps_stop_after_client_releases_wl_touch)
 
 	input_timestamps_destroy(input_ts);
 }
+
+#define TOUCH_MOTION_EVENTS 1000
+
+static void
+send_touch_at(struct client *client, const struct timespec *time,
+	      int x, int y, uint32_t touch_type)
+{
+	uint32_t tv_sec_hi, tv_sec_lo, tv_nsec;
+
+	timespec_to_proto(time, &tv_sec_hi, &tv_sec_lo, &tv_nsec);
+	weston_test_send_touch(client->test->weston_test, tv_sec_hi, tv_sec_lo,
+			       tv_nsec, 1, wl_fixed_from_int(x),
+			       wl_fixed_from_int(y), touch_type);
+	client_roundtrip(client);
+}
+
+/* Moves the touch point all over a size x size view whose top left corner
+ * is at x, y in the global space, checking the surface-local position of
+ * the last motion. */
+static void
+touch_motion_burst(struct client *client, const char *name,
+		   int x, int y, int size)
+{
+	struct touch *touch = client->input->touch;
+	struct timespec begin, end;
+	uint32_t tv_sec_hi, tv_sec_lo, tv_nsec;
+	int64_t elapsed_us;
+	int i;
+
+	/* Queue all motion events first so the compositor handles them
+	 * back to back, then wait for the last one to come through. */
+	timespec_to_proto(&t2, &tv_sec_hi, &tv_sec_lo, &tv_nsec);
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (i = 0; i < TOUCH_MOTION_EVENTS; i++) {
+		weston_test_send_touch(client->test->weston_test,
+				       tv_sec_hi, tv_sec_lo, tv_nsec, 1,
+				       wl_fixed_from_int(x + i % size),
+				       wl_fixed_from_int(y + size - 1 - i % size),
+				       WL_TOUCH_MOTION);
+	}
+	client_roundtrip(client);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	assert(touch->x == (TOUCH_MOTION_EVENTS - 1) % size);
+	assert(touch->y == size - 1 - (TOUCH_MOTION_EVENTS - 1) % size);
+
+	elapsed_us = timespec_sub_to_nsec(&end, &begin) / 1000;
+	testlog("%d touch motion events on %s view in %" PRId64 " us\n",
+		TOUCH_MOTION_EVENTS, name, elapsed_us);
+}
+
+static struct wl_subcompositor *
+get_subcompositor(struct client *client)
+{
+	struct global *g;
+	struct wl_subcompositor *sub = NULL;
+
+	wl_list_for_each(g, &client->global_list, link) {
+		if (strcmp(g->interface, "wl_subcompositor"))
+			continue;
+
+		sub = wl_registry_bind(client->wl_registry, g->name,
+				       &wl_subcompositor_interface, 1);
+		break;
+	}
+
+	assert(sub && "no wl_subcompositor found");
+
+	return sub;
+}
+
+TEST(touch_motion_throughput)
+{
+	struct client *client = create_touch_test_client();
+	struct touch *touch = client->input->touch;
+	struct wl_subcompositor *subco;
+	struct wl_surface *child;
+	struct wl_subsurface *sub;
+	struct buffer *buffer;
+
+	send_touch(client, &t1, WL_TOUCH_DOWN);
+	touch_motion_burst(client, "an untransformed", 0, 0, 100);
+	send_touch(client, &t3, WL_TOUCH_UP);
+
+	/* A sub-surface view is positioned through its parent's transform,
+	 * so the compositor maps the touch points with a matrix. */
+	subco = get_subcompositor(client);
+	child = wl_compositor_create_surface(client->wl_compositor);
+	sub = wl_subcompositor_get_subsurface(subco, child,
+					      client->surface->wl_surface);
+	buffer = create_shm_buffer_a8r8g8b8(client, 50, 50);
+	wl_surface_attach(child, buffer->proxy, 0, 0);
+	wl_surface_damage(child, 0, 0, 50, 50);
+	wl_surface_commit(child);
+	wl_subsurface_set_position(sub, 20, 30);
+	move_client(client, 40, 10);
+
+	send_touch_at(client, &t1, 65, 45, WL_TOUCH_DOWN);
+	assert(touch->down_x == 5 && touch->down_y == 5);
+
+	touch_motion_burst(client, "a translated", 60, 40, 50);
+
+	/* Moving the parent mid-sequence moves the view under the finger */
+	move_client(client, 20, 20);
+	send_touch_at(client, &t2, 45, 60, WL_TOUCH_MOTION);
+	assert(touch->x == 5 && touch->y == 10);
+
+	send_touch(client, &t3, WL_TOUCH_UP);
+
+	wl_subsurface_destroy(sub);
+	wl_surface_destroy(child);
+	buffer_destroy(buffer);
+	wl_subcompositor_destroy(subco);
+}
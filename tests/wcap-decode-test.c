@@ -0,0 +1,233 @@
+/*
+ * Copyright © 2021 Huawei Device Co., Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "shared/helpers.h"
+#include "wcap/wcap-decode.h"
+#include "weston-test-runner.h"
+
+#define WIDTH 4
+#define HEIGHT 2
+
+/* One run of 'length' pixels, each differing by 'delta' from the
+ * previous frame's. */
+#define RUN(length, delta) ((((uint32_t) (length) - 1) << 24) | (delta))
+
+struct wcap_writer {
+	uint32_t data[64];
+	size_t size; /* in 32 bit words */
+};
+
+static size_t
+put(struct wcap_writer *w, const void *p, size_t size)
+{
+	size_t offset = w->size * 4;
+
+	assert(size % 4 == 0);
+	assert(w->size + size / 4 <= ARRAY_LENGTH(w->data));
+	memcpy(&w->data[w->size], p, size);
+	w->size += size / 4;
+
+	return offset;
+}
+
+static size_t
+put_frame(struct wcap_writer *w, uint32_t msecs, bool key,
+	  const struct wcap_rectangle *rect, uint32_t run)
+{
+	struct wcap_frame_header header = {
+		.msecs = msecs,
+		.nrects = 1 | (key ? WCAP_FRAME_KEY : 0),
+	};
+	size_t offset;
+
+	offset = put(w, &header, sizeof header);
+	put(w, rect, sizeof *rect);
+	put(w, &run, sizeof run);
+
+	return offset;
+}
+
+static char *
+write_file(struct wcap_writer *w)
+{
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+	char *path;
+	int fd;
+
+	assert(asprintf(&path, "%s/weston-wcap-test-XXXXXX",
+			dir ? dir : "/tmp") > 0);
+	fd = mkstemp(path);
+	assert(fd >= 0);
+	assert(write(fd, w->data, w->size * 4) == (ssize_t) (w->size * 4));
+	close(fd);
+
+	return path;
+}
+
+static uint32_t
+pixel(struct wcap_decoder *decoder, int x, int y)
+{
+	return decoder->frame[y * decoder->width + x];
+}
+
+static bool
+all_pixels_are(struct wcap_decoder *decoder, uint32_t value)
+{
+	int i;
+
+	for (i = 0; i < decoder->width * decoder->height; i++)
+		if (decoder->frame[i] != value)
+			return false;
+
+	return true;
+}
+
+static const struct wcap_rectangle whole = { 0, 0, WIDTH, HEIGHT };
+static const struct wcap_rectangle top_left = { 0, 0, 1, 1 };
+static const struct wcap_rectangle bottom_right = { 3, 1, 4, 2 };
+
+/* Key frame, delta, key frame, delta, then the index of both key frames.
+ * Before WCAP_HEADER_MAGIC, there were neither key frames nor an index. */
+static char *
+write_recording(uint32_t magic)
+{
+	bool v2 = magic == WCAP_HEADER_MAGIC;
+	struct wcap_header header = {
+		.magic = magic,
+		.format = WCAP_FORMAT_XRGB8888,
+		.width = WIDTH,
+		.height = HEIGHT,
+	};
+	struct wcap_index_entry index[2];
+	struct wcap_index_footer footer = {
+		.magic = WCAP_INDEX_MAGIC,
+		.count = ARRAY_LENGTH(index),
+	};
+	struct wcap_writer w = { .size = 0 };
+
+	put(&w, &header, sizeof header);
+
+	index[0].offset = put_frame(&w, 0, v2, &whole,
+				    RUN(WIDTH * HEIGHT, 0x10));
+	index[0].frame = 0;
+	index[0].msecs = 0;
+	put_frame(&w, 100, false, &top_left, RUN(1, 0x01));
+	index[1].offset = put_frame(&w, 200, v2, &whole,
+				    RUN(WIDTH * HEIGHT, 0x20));
+	index[1].frame = 2;
+	index[1].msecs = 200;
+	put_frame(&w, 300, false, &bottom_right, RUN(1, 0x02));
+
+	if (v2) {
+		put(&w, index, sizeof index);
+		put(&w, &footer, sizeof footer);
+	}
+
+	return write_file(&w);
+}
+
+TEST(wcap_seek_to_key_frame)
+{
+	struct wcap_decoder *decoder;
+	char *path;
+
+	path = write_recording(WCAP_HEADER_MAGIC);
+	decoder = wcap_decoder_create(path);
+	assert(decoder);
+	assert(decoder->index_count == 2);
+
+	/* Decode from the start up to the first delta frame */
+	assert(wcap_decoder_get_frame(decoder) == 1);
+	assert(all_pixels_are(decoder, 0xff000010));
+	assert(wcap_decoder_get_frame(decoder) == 1);
+	assert(pixel(decoder, 0, 0) == 0xff000011);
+
+	/* The second key frame replaces everything decoded before it */
+	assert(wcap_decoder_seek(decoder, 1) == 0);
+	assert(wcap_decoder_get_frame(decoder) == 1);
+	assert(decoder->count == 3);
+	assert(decoder->msecs == 200);
+	assert(all_pixels_are(decoder, 0xff000020));
+
+	assert(wcap_decoder_get_frame(decoder) == 1);
+	assert(decoder->msecs == 300);
+	assert(pixel(decoder, 0, 0) == 0xff000020);
+	assert(pixel(decoder, 3, 1) == 0xff000022);
+
+	/* The index is not a frame */
+	assert(wcap_decoder_get_frame(decoder) == 0);
+
+	assert(wcap_decoder_seek(decoder, 2) < 0);
+
+	assert(wcap_decoder_seek(decoder, 0) == 0);
+	assert(wcap_decoder_get_frame(decoder) == 1);
+	assert(decoder->count == 1);
+	assert(decoder->msecs == 0);
+	assert(all_pixels_are(decoder, 0xff000010));
+
+	wcap_decoder_destroy(decoder);
+	unlink(path);
+	free(path);
+}
+
+TEST(wcap_magic)
+{
+	struct wcap_decoder *decoder;
+	char *path;
+
+	/* Old files have no index, nothing to seek to, and every frame is
+	 * decoded against the previous one */
+	path = write_recording(WCAP_HEADER_MAGIC_V1);
+	decoder = wcap_decoder_create(path);
+	assert(decoder);
+	assert(decoder->index_count == 0);
+	assert(wcap_decoder_seek(decoder, 0) < 0);
+
+	assert(wcap_decoder_get_frame(decoder) == 1);
+	assert(wcap_decoder_get_frame(decoder) == 1);
+	assert(wcap_decoder_get_frame(decoder) == 1);
+	assert(pixel(decoder, 0, 0) == 0xff000031);
+	assert(pixel(decoder, 1, 0) == 0xff000030);
+	assert(wcap_decoder_get_frame(decoder) == 1);
+	assert(wcap_decoder_get_frame(decoder) == 0);
+	wcap_decoder_destroy(decoder);
+	unlink(path);
+	free(path);
+
+	path = write_recording(0x12345678);
+	assert(wcap_decoder_create(path) == NULL);
+	unlink(path);
+	free(path);
+}
@@ -34,6 +34,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <cairo.h>
 
 #include "test-config.h"
@@ -173,6 +174,7 @@ pointer_handle_button(void *data, struct wl_pointer *wl_pointer,
 	struct pointer *pointer = data;
 
 	pointer->button = button;
+	pointer->button_serial = serial;
 	pointer->state = state;
 	pointer->button_time_msec = time_msec;
 	pointer->button_time_timespec = pointer->input_timestamp;
@@ -247,6 +249,15 @@ static void
 keyboard_handle_keymap(void *data, struct wl_keyboard *wl_keyboard,
 		       uint32_t format, int fd, uint32_t size)
 {
+	struct keyboard *keyboard = data;
+	struct stat st;
+
+	keyboard->keymap.count++;
+	keyboard->keymap.size = size;
+	if (fstat(fd, &st) == 0) {
+		keyboard->keymap.dev = st.st_dev;
+		keyboard->keymap.ino = st.st_ino;
+	}
 	close(fd);
 
 	testlog("test-client: got keyboard keymap\n");
@@ -548,9 +559,20 @@ test_handle_capture_screenshot_done(void *data, struct weston_test *weston_test)
 	test->buffer_copy_done = 1;
 }
 
+static void
+test_handle_drm_test_commit_stats(void *data, struct weston_test *weston_test,
+				  uint32_t tests, uint32_t hits)
+{
+	struct test *test = data;
+
+	test->drm_test_commits = tests;
+	test->drm_test_commit_hits = hits;
+}
+
 static const struct weston_test_listener test_listener = {
 	test_handle_pointer_position,
 	test_handle_capture_screenshot_done,
+	test_handle_drm_test_commit_stats,
 };
 
 static void
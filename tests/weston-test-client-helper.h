@@ -31,6 +31,7 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <sys/types.h>
 #include <time.h>
 #include <pixman.h>
 
@@ -74,6 +75,8 @@ struct test {
 	int pointer_y;
 	uint32_t n_egl_buffers;
 	int buffer_copy_done;
+	uint32_t drm_test_commits;
+	uint32_t drm_test_commit_hits;
 };
 
 struct input {
@@ -94,6 +97,7 @@ struct pointer {
 	int x;
 	int y;
 	uint32_t button;
+	uint32_t button_serial;
 	uint32_t state;
 	uint32_t axis;
 	double axis_value;
@@ -124,6 +128,12 @@ struct keyboard {
 	uint32_t key_time_msec;
 	struct timespec input_timestamp;
 	struct timespec key_time_timespec;
+	struct {
+		int count;
+		uint32_t size;
+		dev_t dev;
+		ino_t ino;
+	} keymap;
 };
 
 struct touch {
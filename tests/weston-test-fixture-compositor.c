@@ -220,6 +220,10 @@ renderer_to_arg(enum weston_compositor_backend b, enum renderer_type r)
 	case WESTON_BACKEND_DRM:
 		assert(r >= RENDERER_PIXMAN && r <= RENDERER_GL);
 		return drm_names[r];
+	case WESTON_BACKEND_FBDEV:
+		/* fbdev-backend only ever uses the Pixman renderer */
+		assert(r == RENDERER_PIXMAN);
+		return NULL;
 	default:
 		assert(0 && "renderer_to_str() does not know the backend");
 	}
@@ -273,7 +277,7 @@ execute_compositor(const struct compositor_setup *setup,
 {
 	struct prog_args args;
 	char *tmp;
-	const char *ctmp, *drm_device;
+	const char *ctmp, *drm_device, *fbdev_device;
 	int ret, lock_fd = -1;
 
 	if (setenv("WESTON_MODULE_MAP", WESTON_MODULE_MAP, 0) < 0 ||
@@ -362,6 +366,27 @@ execute_compositor(const struct compositor_setup *setup,
 			return RESULT_FAIL;
 	}
 
+	if (setup->backend == WESTON_BACKEND_FBDEV) {
+		fbdev_device = getenv("WESTON_TEST_SUITE_FBDEV_DEVICE");
+		if (!fbdev_device) {
+			fprintf(stderr, "Skipping fbdev-backend tests because " \
+				"WESTON_TEST_SUITE_FBDEV_DEVICE is not set.\n");
+			return RESULT_SKIP;
+		}
+
+		/* Like DRM, this needs launcher-direct on the test seat */
+		if (geteuid() != 0) {
+			fprintf(stderr, "Skipping fbdev-backend tests because " \
+				"they need to run as root.\n");
+			return RESULT_SKIP;
+		}
+
+		asprintf(&tmp, "--device=%s", fbdev_device);
+		prog_args_take(&args, tmp);
+
+		prog_args_take(&args, strdup("--seat=weston-test-seat"));
+	}
+
 	asprintf(&tmp, "--socket=%s", setup->testset_name);
 	prog_args_take(&args, tmp);
 
@@ -37,6 +37,7 @@
 
 #include <libweston/libweston.h>
 #include <libweston/weston-log.h>
+#include <libweston/backend-drm.h>
 #include "backend.h"
 #include "libweston-internal.h"
 #include "compositor/weston.h"
@@ -599,6 +600,22 @@ send_touch(struct wl_client *client, struct wl_resource *resource,
 		     wl_fixed_to_double(y), touch_type);
 }
 
+static void
+get_drm_test_commit_stats(struct wl_client *client,
+			  struct wl_resource *resource)
+{
+	struct weston_test *test = wl_resource_get_user_data(resource);
+	const struct weston_drm_test_commit_api *api;
+	struct weston_drm_test_commit_stats stats = { 0 };
+
+	api = weston_drm_test_commit_get_api(test->compositor);
+	if (api)
+		api->get_stats(test->compositor, &stats);
+
+	weston_test_send_drm_test_commit_stats(resource, stats.tests,
+					       stats.hits);
+}
+
 static const struct weston_test_interface test_implementation = {
 	move_surface,
 	move_pointer,
@@ -610,6 +627,7 @@ static const struct weston_test_interface test_implementation = {
 	device_add,
 	capture_screenshot,
 	send_touch,
+	get_drm_test_commit_stats,
 };
 
 static void
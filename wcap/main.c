@@ -36,6 +36,12 @@
 #include <string.h>
 #include <fcntl.h>
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include <cairo.h>
 
@@ -98,13 +104,121 @@ int clamp_uv(int u)
 		return clamp;
 }
 
+#if defined(__SSE2__)
+/* x * c in each 32-bit lane, for x in the int16 range and c below 65536:
+ * x goes in both halves of the lane and c is split so that each half of
+ * it fits an int16, then madd adds the two products back together. */
+static inline __m128i
+mul_const(__m128i x, int c)
+{
+	const __m128i lo = _mm_set1_epi32(0xffff);
+	__m128i pair = _mm_or_si128(_mm_and_si128(x, lo),
+				    _mm_slli_epi32(x, 16));
+
+	return _mm_madd_epi16(pair,
+			      _mm_set1_epi32(((c - c / 2) << 16) | (c / 2)));
+}
+
+/* The same arithmetic as rgb_to_yuv(), for four pixels */
+static inline __m128i
+rgb_to_yuv_sse2(__m128i p, __m128i rshift, __m128i bshift,
+		__m128i *u, __m128i *v)
+{
+	const __m128i mask = _mm_set1_epi32(0xff);
+	__m128i r, g, b, y;
+
+	r = _mm_and_si128(_mm_srl_epi32(p, rshift), mask);
+	g = _mm_and_si128(_mm_srli_epi32(p, 8), mask);
+	b = _mm_and_si128(_mm_srl_epi32(p, bshift), mask);
+
+	y = _mm_add_epi32(_mm_add_epi32(mul_const(r, 19595),
+					mul_const(g, 38469)),
+			  mul_const(b, 7472));
+	y = _mm_srli_epi32(y, 16);
+
+	*u = mul_const(_mm_sub_epi32(r, y), 46727);
+	*v = mul_const(_mm_sub_epi32(b, y), 36962);
+
+	return y;
+}
+
+/* Sums the accumulators of horizontally adjacent pixels and applies
+ * clamp_uv() to the four results. */
+static inline uint32_t
+clamp_uv_sse2(__m128i a, __m128i b)
+{
+	__m128i x;
+
+	a = _mm_add_epi32(a, _mm_srli_epi64(a, 32));
+	b = _mm_add_epi32(b, _mm_srli_epi64(b, 32));
+	x = _mm_unpacklo_epi64(_mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0)),
+			       _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0)));
+	x = _mm_add_epi32(_mm_srai_epi32(x, 18), _mm_set1_epi32(128));
+	x = _mm_packs_epi32(x, x);
+	x = _mm_packus_epi16(x, x);
+
+	return _mm_cvtsi128_si32(x);
+}
+#endif
+
+static void
+convert_row_pair_420(uint32_t format, const uint32_t *p1, const uint32_t *p2,
+		     unsigned char *y1, unsigned char *y2,
+		     unsigned char *u, unsigned char *v, int width)
+{
+	int x = 0, u_accum, v_accum;
+
+#if defined(__SSE2__)
+	__m128i rshift, bshift, ya, yb, ua1, ub1, va1, vb1, ua2, ub2, va2, vb2;
+	uint32_t uv;
+
+	rshift = _mm_cvtsi32_si128(format == WCAP_FORMAT_XRGB8888 ? 16 : 0);
+	bshift = _mm_cvtsi32_si128(format == WCAP_FORMAT_XRGB8888 ? 0 : 16);
+
+	for (; x + 8 <= width; x += 8) {
+		ya = rgb_to_yuv_sse2(_mm_loadu_si128((const __m128i *) &p1[x]),
+				     rshift, bshift, &ua1, &va1);
+		yb = rgb_to_yuv_sse2(_mm_loadu_si128((const __m128i *) &p1[x + 4]),
+				     rshift, bshift, &ub1, &vb1);
+		_mm_storel_epi64((__m128i *) &y1[x],
+				 _mm_packus_epi16(_mm_packs_epi32(ya, yb),
+						  _mm_setzero_si128()));
+
+		ya = rgb_to_yuv_sse2(_mm_loadu_si128((const __m128i *) &p2[x]),
+				     rshift, bshift, &ua2, &va2);
+		yb = rgb_to_yuv_sse2(_mm_loadu_si128((const __m128i *) &p2[x + 4]),
+				     rshift, bshift, &ub2, &vb2);
+		_mm_storel_epi64((__m128i *) &y2[x],
+				 _mm_packus_epi16(_mm_packs_epi32(ya, yb),
+						  _mm_setzero_si128()));
+
+		uv = clamp_uv_sse2(_mm_add_epi32(ua1, ua2),
+				   _mm_add_epi32(ub1, ub2));
+		memcpy(&u[x / 2], &uv, sizeof uv);
+		uv = clamp_uv_sse2(_mm_add_epi32(va1, va2),
+				   _mm_add_epi32(vb1, vb2));
+		memcpy(&v[x / 2], &uv, sizeof uv);
+	}
+#endif
+
+	for (; x + 2 <= width; x += 2) {
+		u_accum = 0;
+		v_accum = 0;
+		y1[x] = rgb_to_yuv(format, p1[x], &u_accum, &v_accum);
+		y1[x + 1] = rgb_to_yuv(format, p1[x + 1], &u_accum, &v_accum);
+		y2[x] = rgb_to_yuv(format, p2[x], &u_accum, &v_accum);
+		y2[x + 1] = rgb_to_yuv(format, p2[x + 1], &u_accum, &v_accum);
+		u[x / 2] = clamp_uv(u_accum);
+		v[x / 2] = clamp_uv(v_accum);
+	}
+}
+
 static void
 convert_to_yv12(struct wcap_decoder *decoder, unsigned char *out)
 {
 	unsigned char *y1, *y2, *u, *v;
-	uint32_t *p1, *p2, *end;
-	int i, u_accum, v_accum, stride0, stride1;
-	uint32_t format = decoder->format;
+	uint32_t *p1, *p2;
+	int i, stride0, stride1;
 
 	stride0 = decoder->width;
 	stride1 = decoder->width / 2;
@@ -115,25 +229,9 @@ convert_to_yv12(struct wcap_decoder *decoder, unsigned char *out)
 		u = v + stride1 * decoder->height / 2;
 		p1 = decoder->frame + decoder->width * i;
 		p2 = p1 + decoder->width;
-		end = p1 + decoder->width;
-
-		while (p1 < end) {
-			u_accum = 0;
-			v_accum = 0;
-			y1[0] = rgb_to_yuv(format, p1[0], &u_accum, &v_accum);
-			y1[1] = rgb_to_yuv(format, p1[1], &u_accum, &v_accum);
-			y2[0] = rgb_to_yuv(format, p2[0], &u_accum, &v_accum);
-			y2[1] = rgb_to_yuv(format, p2[1], &u_accum, &v_accum);
-			u[0] = clamp_uv(u_accum);
-			v[0] = clamp_uv(v_accum);
-
-			y1 += 2;
-			p1 += 2;
-			y2 += 2;
-			p2 += 2;
-			u++;
-			v++;
-		}
+
+		convert_row_pair_420(decoder->format, p1, p2, y1, y2, u, v,
+				     decoder->width);
 	}
 }
 
@@ -169,28 +267,199 @@ convert_to_yuv444(struct wcap_decoder *decoder, unsigned char *out)
 	}
 }
 
-static void
-output_yuv_frame(struct wcap_decoder *decoder, int depth)
+#define FRAME_TAG "FRAME\n"
+
+/* YUV output, either one stream written in order or a regular file that
+ * several threads fill in at once, each frame at its own offset. */
+struct yuv_export {
+	const char *filename;
+	int depth;
+	int raw;
+	int fd;
+	off_t data_offset;
+	size_t frame_size;
+	size_t record_size;
+	uint32_t start_msecs;
+	uint32_t frame_time;
+
+	pthread_mutex_t mutex;
+	uint32_t next_key;
+	uint64_t nframes;
+	int error;
+};
+
+static int
+write_record(struct yuv_export *exp, const unsigned char *record,
+	     uint64_t frame)
 {
-	static unsigned char *out;
-	int size;
-
-	if (depth == 444) {
-		size = decoder->width * decoder->height * 3;
-	} else {
-		size = decoder->width * decoder->height * 3 / 2;
+	off_t offset = exp->data_offset + (off_t) (frame * exp->record_size);
+	size_t done = 0;
+	ssize_t ret;
+
+	if (exp->fd < 0)
+		return fwrite(record, 1, exp->record_size, stdout) ==
+		       exp->record_size ? 0 : -1;
+
+	while (done < exp->record_size) {
+		ret = pwrite(exp->fd, record + done, exp->record_size - done,
+			     offset + done);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+		done += ret;
 	}
-	if (out == NULL)
-		out = malloc(size);
 
-	if (depth == 444) {
+	return 0;
+}
+
+static void
+convert_frame(struct yuv_export *exp, struct wcap_decoder *decoder,
+	      unsigned char *record)
+{
+	unsigned char *out = record + (exp->raw ? 0 : strlen(FRAME_TAG));
+
+	if (exp->depth == 444)
 		convert_to_yuv444(decoder, out);
-	} else {
+	else
 		convert_to_yv12(decoder, out);
+}
+
+/* The output frame shown at a key frame's timestamp. Earlier output frames
+ * belong to the previous segment, which decodes up to this key frame. */
+static uint64_t
+first_output_frame(struct yuv_export *exp, const struct wcap_index_entry *key)
+{
+	uint32_t elapsed = key->msecs - exp->start_msecs;
+
+	return (elapsed + exp->frame_time - 1) / exp->frame_time;
+}
+
+/* Writes the output frames from 'first' up to, but not including, 'last',
+ * starting with the frame the decoder currently holds. Each output frame
+ * shows the first recorded frame at or after its time. Returns the number
+ * of frames written, or -1 on error. */
+static int64_t
+export_frames(struct yuv_export *exp, struct wcap_decoder *decoder,
+	      unsigned char *record, uint64_t first, uint64_t last)
+{
+	uint64_t i;
+	uint32_t msecs;
+
+	for (i = first; i < last; i++) {
+		msecs = exp->start_msecs + (uint32_t) (i * exp->frame_time);
+		while (decoder->msecs < msecs) {
+			if (!wcap_decoder_get_frame(decoder))
+				return i - first;
+		}
+
+		convert_frame(exp, decoder, record);
+		if (write_record(exp, record, i) < 0)
+			return -1;
+	}
+
+	return i - first;
+}
+
+static void *
+export_worker(void *data)
+{
+	struct yuv_export *exp = data;
+	struct wcap_decoder *decoder;
+	unsigned char *record;
+	uint64_t first, last;
+	uint32_t key;
+	int64_t n;
+
+	decoder = wcap_decoder_create(exp->filename);
+	record = malloc(exp->record_size);
+	if (!decoder || !record) {
+		pthread_mutex_lock(&exp->mutex);
+		exp->error = 1;
+		pthread_mutex_unlock(&exp->mutex);
+		goto out;
+	}
+	if (!exp->raw)
+		memcpy(record, FRAME_TAG, strlen(FRAME_TAG));
+
+	for (;;) {
+		pthread_mutex_lock(&exp->mutex);
+		key = exp->next_key++;
+		n = exp->error;
+		pthread_mutex_unlock(&exp->mutex);
+		if (n || key >= decoder->index_count)
+			break;
+
+		first = key == 0 ? 0 :
+			first_output_frame(exp, &decoder->index[key]);
+		last = key + 1 == decoder->index_count ? UINT64_MAX :
+		       first_output_frame(exp, &decoder->index[key + 1]);
+
+		if (wcap_decoder_seek(decoder, key) < 0 ||
+		    !wcap_decoder_get_frame(decoder))
+			n = -1;
+		else
+			n = export_frames(exp, decoder, record, first, last);
+
+		pthread_mutex_lock(&exp->mutex);
+		if (n < 0)
+			exp->error = 1;
+		else
+			exp->nframes += n;
+		pthread_mutex_unlock(&exp->mutex);
+	}
+
+out:
+	free(record);
+	if (decoder)
+		wcap_decoder_destroy(decoder);
+
+	return NULL;
+}
+
+/* Decodes the segments between key frames on all threads at once. */
+static int
+export_parallel(struct yuv_export *exp, int nthreads)
+{
+	pthread_t *threads;
+	int i, started = 0;
+
+	threads = calloc(nthreads, sizeof *threads);
+	if (!threads)
+		return -1;
+
+	pthread_mutex_init(&exp->mutex, NULL);
+	exp->next_key = 0;
+	exp->nframes = 0;
+	exp->error = 0;
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, export_worker, exp) != 0)
+			break;
+		started++;
 	}
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
 
-	printf("FRAME\n");
-	fwrite(out, 1, size, stdout);
+	pthread_mutex_destroy(&exp->mutex);
+	free(threads);
+
+	return started > 0 && !exp->error ? 0 : -1;
+}
+
+static int
+can_export_parallel(struct yuv_export *exp, struct wcap_decoder *decoder)
+{
+	struct stat st;
+
+	if (exp->fd < 0 || fstat(exp->fd, &st) < 0 || !S_ISREG(st.st_mode))
+		return 0;
+
+	/* Every output frame has to land at a known place, and the first
+	 * segment has to start at the first frame. */
+	return decoder->index_count > 0 &&
+	       decoder->index[0].frame == 0 &&
+	       decoder->index[0].offset == sizeof(struct wcap_header);
 }
 
 static void
@@ -198,10 +467,15 @@ usage(int exit_code)
 {
 	fprintf(stderr, "usage: wcap-decode "
 		"[--help] [--yuv4mpeg2] [--frame=<frame>] [--all] \n"
-		"\t[--rate=<num:denom>] <wcap file>\n\n"
+		"\t[--rate=<num:denom>] [--raw] [--output=<file>]\n"
+		"\t[--threads=<n>] <wcap file>\n\n"
 		"\t--help\t\t\tthis help text\n"
 		"\t--yuv4mpeg2\t\tdump wcap file to stdout in yuv4mpeg2 format\n"
 		"\t--yuv4mpeg2-444\t\tdump wcap file to stdout in yuv4mpeg2 444 format\n"
+		"\t--raw\t\t\twrite planar YUV frames without yuv4mpeg2 framing\n"
+		"\t--output=<file>\t\twrite the YUV data to a file instead of stdout\n"
+		"\t--threads=<n>\t\tdecoding threads when writing to a file,\n"
+		"\t\t\t\tdefaults to the number of CPUs\n"
 		"\t--frame=<frame>\t\twrite out the given frame number as png\n"
 		"\t--all\t\t\twrite all frames as pngs\n"
 		"\t--rate=<num:denom>\treplay frame rate for yuv4mpeg2,\n"
@@ -213,17 +487,27 @@ usage(int exit_code)
 int main(int argc, char *argv[])
 {
 	struct wcap_decoder *decoder;
+	struct yuv_export exp = { .fd = -1 };
 	int i, j, output_frame = -1, yuv4mpeg2 = 0, all = 0, has_frame;
-	int num = 30, denom = 1;
+	int num = 30, denom = 1, raw = 0, nthreads = 0;
 	char filename[200];
-	char *mode;
+	char header[128];
+	char *mode, *output = NULL;
+	unsigned char *record = NULL;
 	uint32_t msecs, frame_time;
+	int header_len = 0;
 
 	for (i = 1, j = 1; i < argc; i++) {
 		if (strcmp(argv[i], "--yuv4mpeg2-444") == 0) {
 			yuv4mpeg2 = 444;
 		} else if (strcmp(argv[i], "--yuv4mpeg2") == 0) {
 			yuv4mpeg2 = 420;
+		} else if (strcmp(argv[i], "--raw") == 0) {
+			raw = 1;
+		} else if (strncmp(argv[i], "--output=", 9) == 0) {
+			output = argv[i] + 9;
+		} else if (sscanf(argv[i], "--threads=%d", &nthreads) == 1) {
+			;
 		} else if (strcmp(argv[i], "--help") == 0) {
 			usage(EXIT_SUCCESS);
 		} else if (strcmp(argv[i], "--all") == 0) {
@@ -248,10 +532,16 @@ int main(int argc, char *argv[])
 
 	if (argc != 2)
 		usage(EXIT_FAILURE);
-	if (denom == 0) {
-		fprintf(stderr, "invalid rate, denom can not be 0\n");
+	if (denom == 0 || num <= 0) {
+		fprintf(stderr, "invalid rate, num and denom must be positive\n");
 		exit(EXIT_FAILURE);
 	}
+	if (raw && !yuv4mpeg2)
+		yuv4mpeg2 = 420;
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads <= 0)
+		nthreads = 1;
 
 	decoder = wcap_decoder_create(argv[1]);
 	if (decoder == NULL) {
@@ -259,7 +549,7 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
-	if (yuv4mpeg2 && isatty(1)) {
+	if (yuv4mpeg2 && !output && isatty(1)) {
 		fprintf(stderr, "Not dumping yuv4mpeg2 data to terminal.  Pipe output to a file or a process.\n");
 		fprintf(stderr, "For example, to encode to webm, use something like\n\n");
 		fprintf(stderr, "\t$ wcap-decode  --yuv4mpeg2 ../capture.wcap |\n"
@@ -268,21 +558,78 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
+	frame_time = 1000 * denom / num;
+	if (frame_time == 0)
+		frame_time = 1;
+
 	if (yuv4mpeg2) {
+		if (output) {
+			exp.fd = open(output, O_WRONLY | O_CREAT | O_TRUNC,
+				      0644);
+			if (exp.fd < 0) {
+				fprintf(stderr, "could not open %s: %s\n",
+					output, strerror(errno));
+				exit(EXIT_FAILURE);
+			}
+		}
+
 		if (yuv4mpeg2 == 444) {
 			mode = "C444";
+			exp.frame_size = decoder->width * decoder->height * 3;
 		} else {
 			mode = "C420jpeg";
+			exp.frame_size =
+				decoder->width * decoder->height * 3 / 2;
 		}
-		printf("YUV4MPEG2 %s W%d H%d F%d:%d Ip A0:0\n",
-					 mode, decoder->width, decoder->height, num, denom);
-		fflush(stdout);
+
+		if (!raw)
+			header_len = snprintf(header, sizeof header,
+					      "YUV4MPEG2 %s W%d H%d F%d:%d Ip A0:0\n",
+					      mode, decoder->width,
+					      decoder->height, num, denom);
+
+		exp.filename = argv[1];
+		exp.depth = yuv4mpeg2;
+		exp.raw = raw;
+		exp.data_offset = header_len;
+		exp.record_size = exp.frame_size +
+				  (raw ? 0 : strlen(FRAME_TAG));
+		exp.frame_time = frame_time;
+
+		if (exp.fd >= 0) {
+			if (pwrite(exp.fd, header, header_len, 0) != header_len) {
+				fprintf(stderr, "could not write %s\n", output);
+				exit(EXIT_FAILURE);
+			}
+		} else {
+			fwrite(header, 1, header_len, stdout);
+			fflush(stdout);
+		}
+
+		record = malloc(exp.record_size);
+		if (!record) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		if (!raw)
+			memcpy(record, FRAME_TAG, strlen(FRAME_TAG));
 	}
 
 	i = 0;
 	has_frame = wcap_decoder_get_frame(decoder);
 	msecs = decoder->msecs;
-	frame_time = 1000 * denom / num;
+	exp.start_msecs = msecs;
+
+	if (yuv4mpeg2 && !all && output_frame < 0 && has_frame &&
+	    nthreads > 1 && can_export_parallel(&exp, decoder)) {
+		if (export_parallel(&exp, nthreads) < 0) {
+			fprintf(stderr, "could not write %s\n", output);
+			exit(EXIT_FAILURE);
+		}
+		i = exp.nframes;
+		has_frame = 0;
+	}
+
 	while (has_frame) {
 		if (all || i == output_frame) {
 			snprintf(filename, sizeof filename,
@@ -290,8 +637,13 @@ int main(int argc, char *argv[])
 			write_png(decoder, filename);
 			fprintf(stderr, "wrote %s\n", filename);
 		}
-		if (yuv4mpeg2)
-			output_yuv_frame(decoder, yuv4mpeg2);
+		if (yuv4mpeg2) {
+			convert_frame(&exp, decoder, record);
+			if (write_record(&exp, record, i) < 0) {
+				fprintf(stderr, "could not write frame %d\n", i);
+				exit(EXIT_FAILURE);
+			}
+		}
 		i++;
 		msecs += frame_time;
 		while (decoder->msecs < msecs && has_frame)
@@ -301,6 +653,9 @@ int main(int argc, char *argv[])
 	fprintf(stderr, "wcap file: size %dx%d, %d frames\n",
 		decoder->width, decoder->height, i);
 
+	free(record);
+	if (exp.fd >= 0)
+		close(exp.fd);
 	wcap_decoder_destroy(decoder);
 
 	return EXIT_SUCCESS;
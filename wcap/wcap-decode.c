@@ -90,7 +90,7 @@ wcap_decoder_get_frame(struct wcap_decoder *decoder)
 {
 	struct wcap_rectangle *rects;
 	struct wcap_frame_header *header;
-	uint32_t i;
+	uint32_t i, nrects;
 
 	if (decoder->p == decoder->end)
 		return 0;
@@ -99,14 +99,70 @@ wcap_decoder_get_frame(struct wcap_decoder *decoder)
 	decoder->msecs = header->msecs;
 	decoder->count++;
 
+	nrects = header->nrects;
+	if (decoder->magic == WCAP_HEADER_MAGIC) {
+		nrects &= ~WCAP_FRAME_KEY;
+		if (header->nrects & WCAP_FRAME_KEY)
+			memset(decoder->frame, 0,
+			       decoder->width * decoder->height * 4);
+	}
+
 	rects = (void *) (header + 1);
-	decoder->p = (uint32_t *) (rects + header->nrects);
-	for (i = 0; i < header->nrects; i++)
+	decoder->p = (uint32_t *) (rects + nrects);
+	for (i = 0; i < nrects; i++)
 		wcap_decoder_decode_rectangle(decoder, &rects[i]);
 
 	return 1;
 }
 
+/* Positions the decoder so that the next wcap_decoder_get_frame() returns
+ * the given key frame of the index. */
+int
+wcap_decoder_seek(struct wcap_decoder *decoder, uint32_t key)
+{
+	const struct wcap_index_entry *entry;
+
+	if (key >= decoder->index_count)
+		return -1;
+
+	entry = &decoder->index[key];
+	if (entry->offset >= (size_t) ((char *) decoder->end -
+				       (char *) decoder->map))
+		return -1;
+
+	decoder->p = (char *) decoder->map + entry->offset;
+	decoder->count = entry->frame;
+
+	return 0;
+}
+
+static void
+wcap_decoder_read_index(struct wcap_decoder *decoder)
+{
+	const struct wcap_index_footer *footer;
+	size_t index_size;
+	char *end = decoder->end;
+
+	decoder->index = NULL;
+	decoder->index_count = 0;
+
+	if (decoder->size < sizeof(struct wcap_header) + sizeof *footer)
+		return;
+
+	footer = (const void *) (end - sizeof *footer);
+	if (footer->magic != WCAP_INDEX_MAGIC)
+		return;
+
+	index_size = (size_t) footer->count * sizeof *decoder->index;
+	if (index_size > decoder->size - sizeof(struct wcap_header) -
+			 sizeof *footer)
+		return;
+
+	decoder->index = (const void *) ((const char *) footer - index_size);
+	decoder->index_count = footer->count;
+	decoder->end = (void *) decoder->index;
+}
+
 struct wcap_decoder *
 wcap_decoder_create(const char *filename)
 {
@@ -137,12 +193,30 @@ wcap_decoder_create(const char *filename)
 	}
 
 	header = decoder->map;
+	if (decoder->size < sizeof *header ||
+	    (header->magic != WCAP_HEADER_MAGIC &&
+	     header->magic != WCAP_HEADER_MAGIC_V1)) {
+		fprintf(stderr, "not a wcap file\n");
+		munmap(decoder->map, decoder->size);
+		close(decoder->fd);
+		free(decoder);
+		return NULL;
+	}
+
+	decoder->magic = header->magic;
 	decoder->format = header->format;
 	decoder->count = 0;
 	decoder->width = header->width;
 	decoder->height = header->height;
 	decoder->p = header + 1;
 	decoder->end = decoder->map + decoder->size;
+	if (decoder->magic == WCAP_HEADER_MAGIC) {
+		wcap_decoder_read_index(decoder);
+	} else {
+		decoder->index = NULL;
+		decoder->index_count = 0;
+	}
+	madvise(decoder->map, decoder->size, MADV_SEQUENTIAL);
 
 	frame_size = header->width * header->height * 4;
 	decoder->frame = malloc(frame_size);
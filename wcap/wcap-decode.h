@@ -28,7 +28,11 @@
 
 #include <stdint.h>
 
-#define WCAP_HEADER_MAGIC	0x57434150
+/* "WCA2": may have key frames and a key frame index */
+#define WCAP_HEADER_MAGIC	0x57434132
+/* "WCAP": delta frames only, still decoded */
+#define WCAP_HEADER_MAGIC_V1	0x57434150
+#define WCAP_INDEX_MAGIC	0x57494458
 
 #define WCAP_FORMAT_XRGB8888	0x34325258
 #define WCAP_FORMAT_XBGR8888	0x34324258
@@ -41,11 +45,27 @@ struct wcap_header {
 	uint32_t width, height;
 };
 
+/* Set in nrects: the frame covers the whole output and is encoded
+ * against all 0x00000000 pixels instead of the previous frame. */
+#define WCAP_FRAME_KEY		0x80000000
+
 struct wcap_frame_header {
 	uint32_t msecs;
 	uint32_t nrects;
 };
 
+struct wcap_index_entry {
+	uint64_t offset;
+	uint32_t frame;
+	uint32_t msecs;
+};
+
+/* Last bytes of the file, right after the index entries */
+struct wcap_index_footer {
+	uint32_t magic;
+	uint32_t count;
+};
+
 struct wcap_rectangle {
 	int32_t x1, y1, x2, y2;
 };
@@ -55,13 +75,18 @@ struct wcap_decoder {
 	size_t size;
 	void *map, *p, *end;
 	uint32_t *frame;
+	uint32_t magic;
 	uint32_t format;
 	uint32_t msecs;
 	uint32_t count;
 	int width, height;
+
+	const struct wcap_index_entry *index;
+	uint32_t index_count;
 };
 
 int wcap_decoder_get_frame(struct wcap_decoder *decoder);
+int wcap_decoder_seek(struct wcap_decoder *decoder, uint32_t key);
 struct wcap_decoder *wcap_decoder_create(const char *filename);
 void wcap_decoder_destroy(struct wcap_decoder *decoder);
 
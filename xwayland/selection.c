@@ -309,7 +309,12 @@ weston_wm_handle_selection_notify(struct weston_wm *wm,
 	}
 }
 
-static const size_t incr_chunk_size = 64 * 1024;
+/* INCR chunks start small so short transfers stay cheap, and double
+ * every time the requestor has consumed a chunk, up to the lesser of
+ * INCR_CHUNK_MAX and what fits in a single X request. This also bounds
+ * how much of the Wayland source we buffer. */
+#define INCR_CHUNK_MIN (64 * 1024)
+#define INCR_CHUNK_MAX (4 * 1024 * 1024)
 
 static void
 weston_wm_send_selection_notify(struct weston_wm *wm, xcb_atom_t property)
@@ -391,17 +396,21 @@ static int
 weston_wm_read_data_source(int fd, uint32_t mask, void *data)
 {
 	struct weston_wm *wm = data;
+	size_t chunk_size = wm->selection_chunk_size;
+	uint32_t incr_size;
 	int len, current, available;
 	void *p;
 
 	current = wm->source_data.size;
-	if (wm->source_data.size < incr_chunk_size)
-		p = wl_array_add(&wm->source_data, incr_chunk_size);
-	else
-		p = (char *) wm->source_data.data + wm->source_data.size;
-	available = wm->source_data.alloc - current;
+	available = chunk_size - current;
+	if (wl_array_add(&wm->source_data, available)) {
+		p = (char *) wm->source_data.data + current;
+		len = read(fd, p, available);
+	} else {
+		len = -1;
+		errno = ENOMEM;
+	}
 
-	len = read(fd, p, available);
 	if (len == -1) {
 		weston_log("read error from data source: %s\n",
 			   strerror(errno));
@@ -414,22 +423,23 @@ weston_wm_read_data_source(int fd, uint32_t mask, void *data)
 		return 1;
 	}
 
-	weston_log("read %d (available %d, mask 0x%x) bytes: \"%.*s\"\n",
-		len, available, mask, len, (char *) p);
+	wm_log("read %d (available %d, mask 0x%x) bytes\n",
+	       len, available, mask);
 
 	wm->source_data.size = current + len;
-	if (wm->source_data.size >= incr_chunk_size) {
+	if (wm->source_data.size >= chunk_size) {
 		if (!wm->incr) {
 			weston_log("got %zu bytes, starting incr\n",
 				wm->source_data.size);
 			wm->incr = 1;
+			incr_size = chunk_size;
 			xcb_change_property(wm->conn,
 					    XCB_PROP_MODE_REPLACE,
 					    wm->selection_request.requestor,
 					    wm->selection_request.property,
 					    wm->atom.incr,
 					    32, /* format */
-					    1, &incr_chunk_size);
+					    1, &incr_size);
 			wm->selection_property_set = 1;
 			wm->flush_property_on_delete = 1;
 			if (wm->property_source)
@@ -503,6 +513,7 @@ weston_wm_send_data(struct weston_wm *wm, xcb_atom_t target, const char *mime_ty
 	}
 
 	wl_array_init(&wm->source_data);
+	wm->selection_chunk_size = INCR_CHUNK_MIN;
 	wm->selection_target = target;
 	wm->data_source_fd = p[0];
 	wm->property_source = wl_event_loop_add_fd(wm->server->loop,
@@ -530,6 +541,12 @@ weston_wm_send_incr_chunk(struct weston_wm *wm)
 		wm->flush_property_on_delete = 0;
 		length = weston_wm_flush_source_data(wm);
 
+		/* The requestor keeps up, let it have bigger chunks. */
+		if (wm->selection_chunk_size < wm->selection_chunk_max)
+			wm->selection_chunk_size =
+				MIN(wm->selection_chunk_size * 2,
+				    wm->selection_chunk_max);
+
 		if (wm->data_source_fd >= 0) {
 			wm->property_source =
 				wl_event_loop_add_fd(wm->server->loop,
@@ -727,6 +744,12 @@ weston_wm_selection_init(struct weston_wm *wm)
 
 	wm->selection_request.requestor = XCB_NONE;
 
+	/* Leave room for the ChangeProperty request header. */
+	wm->selection_chunk_max =
+		(size_t) xcb_get_maximum_request_length(wm->conn) * 4 - 64;
+	wm->selection_chunk_max = MIN(wm->selection_chunk_max, INCR_CHUNK_MAX);
+	wm->selection_chunk_max = MAX(wm->selection_chunk_max, INCR_CHUNK_MIN);
+
 	values[0] = XCB_EVENT_MASK_PROPERTY_CHANGE;
 	wm->selection_window = xcb_generate_id(wm->conn);
 	xcb_create_window(wm->conn,
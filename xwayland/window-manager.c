@@ -133,12 +133,19 @@ struct weston_output_weak_ref {
 	struct wl_listener destroy_listener;
 };
 
+#define WM_WINDOW_PROPERTY_COUNT 11
+
 struct weston_wm_window {
 	struct weston_wm *wm;
 	xcb_window_t id;
 	xcb_window_t frame_id;
 	struct frame *frame;
 	cairo_surface_t *cairo_surface;
+	struct {
+		bool valid;
+		const char *how;
+		int width, height;
+	} drawn_decoration;	/* what the frame window currently shows */
 	uint32_t surface_id;
 	struct weston_surface *surface;
 	struct weston_desktop_xwayland_surface *shsurf;
@@ -146,6 +153,15 @@ struct weston_wm_window {
 	struct wl_event_source *repaint_source;
 	struct wl_event_source *configure_source;
 	int properties_dirty;
+	struct {
+		bool pending;
+		bool repaint;	/* a property shown in the frame changed */
+		uint32_t requested;	/* bitmask of properties being fetched */
+		uint32_t resolved;	/* bitmask of received replies */
+		xcb_get_property_cookie_t cookie[WM_WINDOW_PROPERTY_COUNT];
+		xcb_get_property_reply_t *reply[WM_WINDOW_PROPERTY_COUNT];
+		struct wl_list link;	/* weston_wm::property_fetch_list */
+	} prop_fetch;
 	int pid;
 	char *machine;
 	char *class;
@@ -500,17 +516,20 @@ read_and_dump_property(FILE *fp, struct weston_wm *wm,
 #define TYPE_NET_WM_STATE	XCB_ATOM_CUT_BUFFER2
 #define TYPE_WM_NORMAL_HINTS	XCB_ATOM_CUT_BUFFER3
 
+struct weston_wm_window_property {
+	xcb_atom_t atom;
+	xcb_atom_t type;
+	void *ptr;
+};
+
 static void
-weston_wm_window_read_properties(struct weston_wm_window *window)
+weston_wm_window_get_property_table(struct weston_wm_window *window,
+				    struct weston_wm_window_property *props)
 {
 	struct weston_wm *wm = window->wm;
 
 #define F(field) (&window->field)
-	const struct {
-		xcb_atom_t atom;
-		xcb_atom_t type;
-		void *ptr;
-	} props[] = {
+	const struct weston_wm_window_property table[] = {
 		{ XCB_ATOM_WM_CLASS,           XCB_ATOM_STRING,            F(class) },
 		{ XCB_ATOM_WM_NAME,            XCB_ATOM_STRING,            F(name) },
 		{ XCB_ATOM_WM_TRANSIENT_FOR,   XCB_ATOM_WINDOW,            F(transient_for) },
@@ -525,40 +544,159 @@ weston_wm_window_read_properties(struct weston_wm_window *window)
 	};
 #undef F
 
-	xcb_get_property_cookie_t cookie[ARRAY_LENGTH(props)];
+	static_assert(ARRAY_LENGTH(table) == WM_WINDOW_PROPERTY_COUNT,
+		      "property table size mismatch");
+	memcpy(props, table, sizeof table);
+}
+
+/* Drop any property requests still in flight for the window, along with
+ * the replies collected so far. */
+static void
+weston_wm_window_cancel_property_fetch(struct weston_wm_window *window)
+{
+	struct weston_wm *wm = window->wm;
+	uint32_t i;
+
+	if (!window->prop_fetch.pending)
+		return;
+
+	for (i = 0; i < WM_WINDOW_PROPERTY_COUNT; i++) {
+		if (!(window->prop_fetch.requested & (1u << i)))
+			continue;
+
+		if (window->prop_fetch.resolved & (1u << i))
+			free(window->prop_fetch.reply[i]);
+		else
+			xcb_discard_reply(wm->conn,
+					  window->prop_fetch.cookie[i].sequence);
+		window->prop_fetch.reply[i] = NULL;
+	}
+
+	window->prop_fetch.requested = 0;
+	window->prop_fetch.resolved = 0;
+	window->prop_fetch.pending = false;
+	wl_list_remove(&window->prop_fetch.link);
+}
+
+/* Send the request for one property, replacing any request for it still
+ * in flight: its reply may carry a value older than the latest
+ * PropertyNotify. */
+static void
+weston_wm_window_fetch_property(struct weston_wm_window *window,
+				const struct weston_wm_window_property *prop,
+				uint32_t i)
+{
+	struct weston_wm *wm = window->wm;
+
+	if (window->prop_fetch.resolved & (1u << i))
+		free(window->prop_fetch.reply[i]);
+	else if (window->prop_fetch.requested & (1u << i))
+		xcb_discard_reply(wm->conn,
+				  window->prop_fetch.cookie[i].sequence);
+	window->prop_fetch.reply[i] = NULL;
+
+	window->prop_fetch.cookie[i] =
+		xcb_get_property(wm->conn,
+				 0, /* delete */
+				 window->id,
+				 prop->atom,
+				 XCB_ATOM_ANY, 0, 2048);
+	window->prop_fetch.requested |= 1u << i;
+	window->prop_fetch.resolved &= ~(1u << i);
+
+	if (!window->prop_fetch.pending) {
+		window->prop_fetch.pending = true;
+		wl_list_insert(&wm->property_fetch_list,
+			       &window->prop_fetch.link);
+	}
+}
+
+/* Send the requests for all the properties we track without waiting for
+ * the replies. They are collected in weston_wm_handle_event() as they
+ * arrive, or waited for in weston_wm_window_read_properties() if the
+ * window state is needed before that.
+ */
+static void
+weston_wm_window_fetch_properties(struct weston_wm_window *window)
+{
+	struct weston_wm_window_property props[WM_WINDOW_PROPERTY_COUNT];
+	uint32_t i;
+
+	weston_wm_window_get_property_table(window, props);
+	for (i = 0; i < WM_WINDOW_PROPERTY_COUNT; i++)
+		weston_wm_window_fetch_property(window, &props[i], i);
+}
+
+/* Refetch the property a PropertyNotify is about, if it is one we track.
+ * Entries sharing a field, like WM_NAME and _NET_WM_NAME, are refetched
+ * together so the table order still decides which one wins.
+ *
+ * Returns false for atoms we don't track.
+ */
+static bool
+weston_wm_window_refetch_property(struct weston_wm_window *window,
+				  xcb_atom_t atom)
+{
+	struct weston_wm_window_property props[WM_WINDOW_PROPERTY_COUNT];
+	uint32_t i, j;
+
+	weston_wm_window_get_property_table(window, props);
+	for (i = 0; i < WM_WINDOW_PROPERTY_COUNT; i++)
+		if (props[i].atom == atom)
+			break;
+
+	if (i == WM_WINDOW_PROPERTY_COUNT)
+		return false;
+
+	for (j = 0; j < WM_WINDOW_PROPERTY_COUNT; j++)
+		if (j == i || (props[i].ptr && props[j].ptr == props[i].ptr))
+			weston_wm_window_fetch_property(window, &props[j], j);
+
+	return true;
+}
+
+static void
+weston_wm_window_apply_properties(struct weston_wm_window *window)
+{
+	struct weston_wm *wm = window->wm;
+	struct weston_wm_window_property props[WM_WINDOW_PROPERTY_COUNT];
 	xcb_get_property_reply_t *reply;
 	void *p;
 	uint32_t *xid;
 	xcb_atom_t *atom;
-	uint32_t i;
+	uint32_t i, j;
 	char name[1024];
 
-	if (!window->properties_dirty)
-		return;
-	window->properties_dirty = 0;
+	weston_wm_window_get_property_table(window, props);
 
-	for (i = 0; i < ARRAY_LENGTH(props); i++)
-		cookie[i] = xcb_get_property(wm->conn,
-					     0, /* delete */
-					     window->id,
-					     props[i].atom,
-					     XCB_ATOM_ANY, 0, 2048);
+	for (i = 0; i < WM_WINDOW_PROPERTY_COUNT; i++)  {
+		if (!(window->prop_fetch.resolved & (1u << i)))
+			continue;
 
-	window->decorate = window->override_redirect ? 0 : MWM_DECOR_EVERYTHING;
-	window->size_hints.flags = 0;
-	window->motif_hints.flags = 0;
-	window->delete_window = 0;
+		/* What a refetched property implies starts over */
+		switch (props[i].type) {
+		case TYPE_WM_PROTOCOLS:
+			window->delete_window = 0;
+			break;
+		case TYPE_WM_NORMAL_HINTS:
+			window->size_hints.flags = 0;
+			break;
+		case TYPE_MOTIF_WM_HINTS:
+			window->motif_hints.flags = 0;
+			window->decorate = window->override_redirect ?
+					   0 : MWM_DECOR_EVERYTHING;
+			break;
+		default:
+			break;
+		}
 
-	for (i = 0; i < ARRAY_LENGTH(props); i++)  {
-		reply = xcb_get_property_reply(wm->conn, cookie[i], NULL);
+		reply = window->prop_fetch.reply[i];
 		if (!reply)
 			/* Bad window, typically */
 			continue;
-		if (reply->type == XCB_ATOM_NONE) {
+		if (reply->type == XCB_ATOM_NONE)
 			/* No such property */
-			free(reply);
 			continue;
-		}
 
 		p = props[i].ptr;
 
@@ -587,8 +725,8 @@ weston_wm_window_read_properties(struct weston_wm_window *window)
 			break;
 		case TYPE_WM_PROTOCOLS:
 			atom = xcb_get_property_value(reply);
-			for (i = 0; i < reply->value_len; i++)
-				if (atom[i] == wm->atom.wm_delete_window) {
+			for (j = 0; j < reply->value_len; j++)
+				if (atom[j] == wm->atom.wm_delete_window) {
 					window->delete_window = 1;
 					break;
 				}
@@ -601,12 +739,12 @@ weston_wm_window_read_properties(struct weston_wm_window *window)
 		case TYPE_NET_WM_STATE:
 			window->fullscreen = 0;
 			atom = xcb_get_property_value(reply);
-			for (i = 0; i < reply->value_len; i++) {
-				if (atom[i] == wm->atom.net_wm_state_fullscreen)
+			for (j = 0; j < reply->value_len; j++) {
+				if (atom[j] == wm->atom.net_wm_state_fullscreen)
 					window->fullscreen = 1;
-				if (atom[i] == wm->atom.net_wm_state_maximized_vert)
+				if (atom[j] == wm->atom.net_wm_state_maximized_vert)
 					window->maximized_vert = 1;
-				if (atom[i] == wm->atom.net_wm_state_maximized_horz)
+				if (atom[j] == wm->atom.net_wm_state_maximized_horz)
 					window->maximized_horz = 1;
 			}
 			break;
@@ -627,7 +765,6 @@ weston_wm_window_read_properties(struct weston_wm_window *window)
 		default:
 			break;
 		}
-		free(reply);
 	}
 
 	if (window->pid > 0) {
@@ -647,6 +784,88 @@ weston_wm_window_read_properties(struct weston_wm_window *window)
 	}
 }
 
+/* Collect the replies of an outstanding property fetch. With wait false
+ * this only picks up replies libxcb has already read from the X server.
+ * Once every reply is in, the new properties are applied to the window.
+ *
+ * Returns true if the properties were applied.
+ */
+static bool
+weston_wm_window_collect_properties(struct weston_wm_window *window, bool wait)
+{
+	struct weston_wm *wm = window->wm;
+	xcb_get_property_reply_t *reply;
+	xcb_generic_error_t *error;
+	uint32_t i;
+
+	if (!window->prop_fetch.pending)
+		return false;
+
+	for (i = 0; i < WM_WINDOW_PROPERTY_COUNT; i++) {
+		if (!(window->prop_fetch.requested & (1u << i)) ||
+		    window->prop_fetch.resolved & (1u << i))
+			continue;
+
+		if (wait) {
+			reply = xcb_get_property_reply(wm->conn,
+						       window->prop_fetch.cookie[i],
+						       NULL);
+		} else {
+			error = NULL;
+			if (!xcb_poll_for_reply(wm->conn,
+						window->prop_fetch.cookie[i].sequence,
+						(void **) &reply, &error))
+				continue;
+			free(error);
+		}
+
+		window->prop_fetch.reply[i] = reply;
+		window->prop_fetch.resolved |= 1u << i;
+	}
+
+	if (window->prop_fetch.resolved != window->prop_fetch.requested)
+		return false;
+
+	window->properties_dirty = 0;
+	weston_wm_window_apply_properties(window);
+
+	/* Consumes the replies and takes the window off the pending list. */
+	weston_wm_window_cancel_property_fetch(window);
+
+	return true;
+}
+
+static void
+weston_wm_window_read_properties(struct weston_wm_window *window)
+{
+	if (!window->properties_dirty)
+		return;
+
+	if (!window->prop_fetch.pending)
+		weston_wm_window_fetch_properties(window);
+
+	weston_wm_window_collect_properties(window, true);
+}
+
+/* Apply the properties of every window whose replies have all arrived,
+ * without blocking on the ones still in flight. */
+static void
+weston_wm_collect_properties(struct weston_wm *wm)
+{
+	struct weston_wm_window *window, *tmp;
+
+	wl_list_for_each_safe(window, tmp, &wm->property_fetch_list,
+			      prop_fetch.link) {
+		if (!weston_wm_window_collect_properties(window, false))
+			continue;
+
+		if (window->prop_fetch.repaint) {
+			window->prop_fetch.repaint = false;
+			weston_wm_window_schedule_repaint(window);
+		}
+	}
+}
+
 #undef TYPE_WM_PROTOCOLS
 #undef TYPE_MOTIF_WM_HINTS
 #undef TYPE_NET_WM_STATE
@@ -1130,6 +1349,7 @@ weston_wm_window_create_frame(struct weston_wm_window *window)
 							     window->frame_id,
 							     &wm->format_rgba,
 							     width, height);
+	window->drawn_decoration.valid = false;
 
 	hash_table_insert(wm->window_hash, window->frame_id, window);
 }
@@ -1213,6 +1433,8 @@ weston_wm_handle_map_request(struct weston_wm *wm, xcb_generic_event_t *event)
 	}
 
 	xcb_map_window(wm->conn, map_request->window);
+	/* A newly mapped frame window has no contents yet */
+	window->drawn_decoration.valid = false;
 	xcb_map_window(wm->conn, window->frame_id);
 
 	/* Mapped in the X server, we can draw immediately.
@@ -1289,18 +1511,42 @@ weston_wm_window_draw_decoration(struct weston_wm_window *window)
 
 	weston_wm_window_get_frame_size(window, &width, &height);
 
+	if (window->fullscreen) {
+		how = "fullscreen";
+	} else if (window->decorate) {
+		how = "decorate";
+		frame_set_title(window->frame, window->name);
+	} else {
+		how = "shadow";
+	}
+
+	/* Most repaints are for state that does not show in the frame,
+	 * and the X server keeps the frame window contents for us, so
+	 * only draw when the frame would actually look different. */
+	if (window->drawn_decoration.valid &&
+	    window->drawn_decoration.how == how &&
+	    window->drawn_decoration.width == width &&
+	    window->drawn_decoration.height == height &&
+	    !(window->decorate && !window->fullscreen &&
+	      frame_status(window->frame) & FRAME_STATUS_REPAINT)) {
+		wm_printf(window->wm, "XWM: decoration unchanged, win %d, %s\n",
+			  window->id, how);
+		return;
+	}
+
+	window->drawn_decoration.valid = true;
+	window->drawn_decoration.how = how;
+	window->drawn_decoration.width = width;
+	window->drawn_decoration.height = height;
+
 	cairo_xcb_surface_set_size(window->cairo_surface, width, height);
 	cr = cairo_create(window->cairo_surface);
 
 	if (window->fullscreen) {
-		how = "fullscreen";
 		/* nothing */
 	} else if (window->decorate) {
-		how = "decorate";
-		frame_set_title(window->frame, window->name);
 		frame_repaint(window->frame, cr);
 	} else {
-		how = "shadow";
 		cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
 		cairo_set_source_rgba(cr, 0, 0, 0, 0);
 		cairo_paint(cr);
@@ -1376,6 +1622,7 @@ weston_wm_window_do_repaint(void *data)
 	struct weston_wm_window *window = data;
 
 	window->repaint_source = NULL;
+	window->prop_fetch.repaint = false;
 
 	weston_wm_window_set_allow_commits(window, false);
 	weston_wm_window_read_properties(window);
@@ -1445,7 +1692,8 @@ weston_wm_handle_property_notify(struct weston_wm *wm, xcb_generic_event_t *even
 	if (!wm_lookup_window(wm, property_notify->window, &window))
 		return;
 
-	window->properties_dirty = 1;
+	if (weston_wm_window_refetch_property(window, property_notify->atom))
+		window->properties_dirty = 1;
 
 	if (wm_debug_is_enabled(wm))
 		fp = open_memstream(&logstr, &logsize);
@@ -1474,9 +1722,11 @@ weston_wm_handle_property_notify(struct weston_wm *wm, xcb_generic_event_t *even
 		get_atom_name(wm->conn, property_notify->atom);
 	}
 
+	/* The title is redrawn once the new value has arrived, see
+	 * weston_wm_collect_properties(). */
 	if (property_notify->atom == wm->atom.net_wm_name ||
 	    property_notify->atom == XCB_ATOM_WM_NAME)
-		weston_wm_window_schedule_repaint(window);
+		window->prop_fetch.repaint = true;
 }
 
 static void
@@ -1503,6 +1753,7 @@ weston_wm_window_create(struct weston_wm *wm,
 	window->wm = wm;
 	window->id = id;
 	window->properties_dirty = 1;
+	wl_list_init(&window->prop_fetch.link);
 	window->override_redirect = override;
 	window->width = width;
 	window->height = height;
@@ -1521,6 +1772,10 @@ weston_wm_window_create(struct weston_wm *wm,
 	free(geometry_reply);
 
 	hash_table_insert(wm->window_hash, id, window);
+
+	/* Have the properties on their way by the time the window is
+	 * mapped. */
+	weston_wm_window_fetch_properties(window);
 }
 
 static void
@@ -1530,6 +1785,8 @@ weston_wm_window_destroy(struct weston_wm_window *window)
 
 	weston_output_weak_ref_clear(&window->legacy_fullscreen_output);
 
+	weston_wm_window_cancel_property_fetch(window);
+
 	if (window->configure_source)
 		wl_event_source_remove(window->configure_source);
 	if (window->repaint_source)
@@ -2325,6 +2582,10 @@ weston_wm_handle_event(int fd, uint32_t mask, void *data)
 		count++;
 	}
 
+	/* Replies may have been read in even if no event was, so always
+	 * look for completed property fetches. */
+	weston_wm_collect_properties(wm);
+
 	if (count != 0)
 		xcb_flush(wm->conn);
 
@@ -2649,6 +2910,7 @@ weston_wm_create(struct weston_xserver *wxs, int fd)
 	wl_signal_add(&wxs->compositor->kill_signal,
 		      &wm->kill_listener);
 	wl_list_init(&wm->unpaired_window_list);
+	wl_list_init(&wm->property_fetch_list);
 
 	weston_wm_create_cursors(wm);
 	weston_wm_window_set_cursor(wm, wm->screen->root, XWM_CURSOR_LEFT_PTR);
@@ -75,6 +75,7 @@ struct weston_wm {
 	struct wl_listener activate_listener;
 	struct wl_listener kill_listener;
 	struct wl_list unpaired_window_list;
+	struct wl_list property_fetch_list; /* weston_wm_window::prop_fetch.link */
 
 	xcb_window_t selection_window;
 	xcb_window_t selection_owner;
@@ -84,6 +85,8 @@ struct weston_wm {
 	xcb_get_property_reply_t *property_reply;
 	int property_start;
 	struct wl_array source_data;
+	size_t selection_chunk_size;
+	size_t selection_chunk_max;
 	xcb_selection_request_event_t selection_request;
 	xcb_atom_t selection_target;
 	xcb_timestamp_t selection_timestamp;